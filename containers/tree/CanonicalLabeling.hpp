@@ -0,0 +1,317 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "NTree.hpp"
+#include "Parallel.hpp"
+
+// Canonical labeling (AHU): every subtree of a forest gets an integer label
+// such that two subtrees have the same label exactly when they have the same
+// shape, so an isomorphism test is an integer comparison.
+//
+// A node's label is the interned list of its children's labels, sorted first
+// when the order of children does not matter. Children are labeled before
+// their parents, so a label is always larger than the labels it is made of
+// and label 0 is the leaf. Sorting the children costs O(n log n) per tree in
+// the worst case, the interning is a hash lookup.
+//
+// Only the shape is labeled; HashConsedNTree interns the values as well.
+//
+// A forest is labeled in two steps. Each tree is labeled alone, with a
+// dictionary of its own, and the trees are shared between threads. The
+// local dictionaries, one entry per distinct shape and not per node, are
+// then merged serially into the global one in the order of the trees, which
+// gives the same labels as labeling the trees one after the other. Nodes are
+// named by their preorder index within their tree.
+namespace blib {
+  namespace container {
+    namespace tree {
+      namespace _private {
+        //=====================================================================
+        // Shape Dictionary
+        // Interned child label lists, flattened
+        class ShapeDictionary {
+        public:
+          typedef std::uint32_t LabelType;
+
+        private:
+          std::vector<std::size_t> _childBegin;
+          std::vector<LabelType> _childLabels;
+          std::unordered_multimap<std::size_t, LabelType> _table;
+
+        public:
+          ShapeDictionary( ) {
+            _childBegin.push_back( 0 );
+          }
+
+          std::size_t size( ) const {
+            return _childBegin.size( ) - 1;
+          }
+
+          LabelType const* children( LabelType aLabel ) const {
+            return _childLabels.data( ) + _childBegin[ aLabel ];
+          }
+
+          std::size_t arity( LabelType aLabel ) const {
+            return _childBegin[ aLabel + 1 ] - _childBegin[ aLabel ];
+          }
+
+          LabelType intern( LabelType const* aChildren, std::size_t aCount ) {
+            const std::size_t h = hashOf( aChildren, aCount );
+            auto range = _table.equal_range( h );
+            for ( auto it = range.first; it != range.second; ++it ) {
+              if ( arity( it->second ) == aCount && std::equal( aChildren, aChildren + aCount, children( it->second ) ) ) {
+                return it->second;
+              }
+            }
+            if ( size( ) >= std::numeric_limits<LabelType>::max( ) ) {
+              throw std::length_error( "CanonicalLabeling: too many shapes" );
+            }
+            const LabelType ret = static_cast< LabelType >( size( ) );
+            _childLabels.insert( _childLabels.end( ), aChildren, aChildren + aCount );
+            _childBegin.push_back( _childLabels.size( ) );
+            _table.insert( std::make_pair( h, ret ) );
+            return ret;
+          }
+
+        private:
+          static std::size_t hashOf( LabelType const* aChildren, std::size_t aCount ) {
+            std::uint64_t h = 0x6a09e667f3bcc908ULL;
+            h ^= aCount + 0x9e3779b97f4a7c15ULL + ( h << 6 ) + ( h >> 2 );
+            for ( std::size_t i = 0; i < aCount; ++i ) {
+              h ^= aChildren[ i ] + 0x9e3779b97f4a7c15ULL + ( h << 6 ) + ( h >> 2 );
+            }
+            return static_cast< std::size_t >( h );
+          }
+        };
+      } // _private
+
+      //=====================================================================
+      // Canonical Labeling
+      template<typename NodeType>
+      class CanonicalLabeling {
+      public:
+        typedef _private::ShapeDictionary::LabelType LabelType;
+        typedef std::uint32_t IndexType;
+        typedef CanonicalLabeling<NodeType> SelfType;
+
+      private:
+        typedef _private::ShapeDictionary Dictionary;
+
+        // A tree labeled against a dictionary of its own
+        struct Local {
+          std::vector<LabelType> labels;
+          Dictionary dictionary;
+        };
+
+        bool _ordered;
+        Dictionary _dictionary;
+        // Labels of each tree, in preorder
+        std::vector<std::vector<LabelType>> _labels;
+
+      public:
+        // aOrdered: children in a different order make a different shape
+        explicit CanonicalLabeling( bool aOrdered = false ) :
+          _ordered( aOrdered ) {}
+
+        bool ordered( ) const {
+          return _ordered;
+        }
+
+        // Labels one tree, returns its number
+        std::size_t add( NodeType const& aRoot ) {
+          Local local;
+          label( aRoot, local );
+          std::vector<LabelType> translation;
+          merge( local.dictionary, translation );
+          relabel( local.labels, translation );
+          _labels.push_back( std::move( local.labels ) );
+          return _labels.size( ) - 1;
+        }
+
+        std::size_t add( NTree<NodeType> const& aTree ) {
+          return add( aTree.root( ) );
+        }
+
+        // Labels the trees of aRoots on aThreads threads, 0 for one per
+        // hardware thread. Returns the number of the first tree.
+        std::size_t addForest( std::vector<NodeType const*> const& aRoots, std::size_t aThreads = 0 ) {
+          const std::size_t first = _labels.size( );
+          std::vector<Local> locals( aRoots.size( ) );
+          ThreadTeam team( std::min<std::size_t>( aThreads ? aThreads : ThreadTeam::hardwareThreads( ),
+                                                  std::max<std::size_t>( aRoots.size( ), 1 ) ) );
+          // Trees differ in size, so they are handed out one at a time
+          std::atomic<std::size_t> next( 0 );
+          team.run( [ this, &aRoots, &locals, &next ]( std::size_t ) {
+            for ( std::size_t i; ( i = next.fetch_add( 1, std::memory_order_relaxed ) ) < aRoots.size( ); ) {
+              label( *aRoots[ i ], locals[ i ] );
+            }
+          } );
+
+          std::vector<std::vector<LabelType>> translations( locals.size( ) );
+          for ( std::size_t i = 0; i < locals.size( ); ++i ) {
+            merge( locals[ i ].dictionary, translations[ i ] );
+          }
+
+          next = 0;
+          team.run( [ this, &locals, &translations, &next ]( std::size_t ) {
+            for ( std::size_t i; ( i = next.fetch_add( 1, std::memory_order_relaxed ) ) < locals.size( ); ) {
+              relabel( locals[ i ].labels, translations[ i ] );
+            }
+          } );
+          for ( auto& local : locals ) {
+            _labels.push_back( std::move( local.labels ) );
+          }
+          return first;
+        }
+
+        std::size_t addForest( std::vector<NTree<NodeType>> const& aTrees, std::size_t aThreads = 0 ) {
+          std::vector<NodeType const*> roots;
+          roots.reserve( aTrees.size( ) );
+          for ( auto const& t : aTrees ) {
+            roots.push_back( &t.root( ) );
+          }
+          return addForest( roots, aThreads );
+        }
+
+        std::size_t trees( ) const {
+          return _labels.size( );
+        }
+
+        // Nodes of tree aTree
+        std::size_t size( std::size_t aTree ) const {
+          return _labels[ aTree ].size( );
+        }
+
+        // Label of the node with preorder index aIndex in tree aTree
+        LabelType label( std::size_t aTree, IndexType aIndex ) const {
+          return _labels[ aTree ][ aIndex ];
+        }
+
+        LabelType rootLabel( std::size_t aTree ) const {
+          return _labels[ aTree ][ 0 ];
+        }
+
+        std::vector<LabelType> const& labels( std::size_t aTree ) const {
+          return _labels[ aTree ];
+        }
+
+        bool isomorphic( std::size_t aTree, IndexType aIndex, std::size_t aOtherTree, IndexType aOtherIndex ) const {
+          return label( aTree, aIndex ) == label( aOtherTree, aOtherIndex );
+        }
+
+        // Distinct shapes seen so far
+        std::size_t shapes( ) const {
+          return _dictionary.size( );
+        }
+
+        // The canonical form of a shape: its children's labels, sorted
+        // unless the labeling is ordered
+        std::vector<LabelType> form( LabelType aLabel ) const {
+          LabelType const* children = _dictionary.children( aLabel );
+          return std::vector<LabelType>( children, children + _dictionary.arity( aLabel ) );
+        }
+
+        // Occurrences of every shape, indexed by label
+        std::vector<std::size_t> histogram( ) const {
+          std::vector<std::size_t> ret( shapes( ), 0 );
+          for ( auto const& tree : _labels ) {
+            for ( LabelType l : tree ) {
+              ++ret[ l ];
+            }
+          }
+          return ret;
+        }
+
+      private:
+        // Labels aRoot's tree against aLocal's dictionary, touches nothing
+        // shared
+        void label( NodeType const& aRoot, Local& aLocal ) const {
+          std::vector<NodeType const*> nodes;
+          std::vector<IndexType> parent;
+          std::vector<std::pair<NodeType const*, IndexType>> stack( 1, std::make_pair( &aRoot, IndexType( 0 ) ) );
+          while ( !stack.empty( ) ) {
+            NodeType const* n = stack.back( ).first;
+            const IndexType p = stack.back( ).second;
+            stack.pop_back( );
+            if ( nodes.size( ) >= std::numeric_limits<IndexType>::max( ) ) {
+              throw std::length_error( "CanonicalLabeling: tree too large" );
+            }
+            const IndexType id = static_cast< IndexType >( nodes.size( ) );
+            nodes.push_back( n );
+            parent.push_back( p );
+            auto const& children = _private::NodeUtility::children( *n );
+            for ( std::size_t i = children.size( ); i-- > 0; ) {
+              stack.push_back( std::make_pair( &children[ i ], id ) );
+            }
+          }
+
+          const std::size_t n = nodes.size( );
+          std::vector<IndexType> size( n, 1 );
+          for ( std::size_t i = n; i-- > 1; ) {
+            size[ parent[ i ] ] += size[ i ];
+          }
+
+          // Reverse preorder labels every child before its parent
+          aLocal.labels.assign( n, 0 );
+          std::vector<LabelType> children;
+          for ( std::size_t i = n; i-- > 0; ) {
+            children.clear( );
+            for ( std::size_t c = i + 1; c < i + size[ i ]; c += size[ c ] ) {
+              children.push_back( aLocal.labels[ c ] );
+            }
+            if ( !_ordered ) {
+              std::sort( children.begin( ), children.end( ) );
+            }
+            aLocal.labels[ i ] = aLocal.dictionary.intern( children.data( ), children.size( ) );
+          }
+        }
+
+        // Interns a local dictionary into the global one. Local labels are
+        // made of smaller local labels, so walking them in order finds the
+        // children already translated.
+        void merge( Dictionary const& aLocal, std::vector<LabelType>& aTranslation ) {
+          aTranslation.resize( aLocal.size( ) );
+          std::vector<LabelType> children;
+          for ( LabelType l = 0; l < aLocal.size( ); ++l ) {
+            LabelType const* local = aLocal.children( l );
+            children.resize( aLocal.arity( l ) );
+            for ( std::size_t i = 0; i < children.size( ); ++i ) {
+              children[ i ] = aTranslation[ local[ i ] ];
+            }
+            if ( !_ordered ) {
+              std::sort( children.begin( ), children.end( ) );
+            }
+            aTranslation[ l ] = _dictionary.intern( children.data( ), children.size( ) );
+          }
+        }
+
+        static void relabel( std::vector<LabelType>& aLabels, std::vector<LabelType> const& aTranslation ) {
+          for ( auto& l : aLabels ) {
+            l = aTranslation[ l ];
+          }
+        }
+      };
+
+      // Labels of every node of every tree, in one shared label space
+      template<typename NodeType>
+      CanonicalLabeling<NodeType> canonicalLabels( std::vector<NTree<NodeType>> const& aTrees, bool aOrdered = false,
+                                                   std::size_t aThreads = 0 ) {
+        CanonicalLabeling<NodeType> ret( aOrdered );
+        ret.addForest( aTrees, aThreads );
+        return ret;
+      }
+    }
+  }
+}
@@ -0,0 +1,465 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/iterator/iterator_facade.hpp>
+#include "NTree.hpp"
+
+// Chain NTree: immutable tree in which every maximal unary chain, a run of
+// nodes each having exactly one child, is stored as one segment.
+//
+//   values[ n ]          payloads of the logical nodes, in preorder
+//   chainStart[ s + 1 ]  first value of each segment, then n
+//   parent[ s ]          parent segment, npos for the root segment
+//   nextSibling[ s ]     next segment under the same parent, npos for the last
+//   depth[ s ]           depth of the segment's first node
+//
+// Segments are numbered in preorder as well, so the values of a chain are
+// contiguous and the first child segment of s, if there is one, is s + 1.
+// A chain of k nodes costs one segment instead of k Nodes with their
+// children vectors, and walking down it is an increment.
+//
+// Traversals still see every logical node: they yield ChainNode proxies,
+// which have the accessors of a Node. Nodes without data are stored with a
+// value initialized ValueType.
+namespace blib {
+  namespace container {
+    namespace tree {
+      template<typename NodeDataType>
+      class ChainNTree;
+
+      //=====================================================================
+      // Chain Node
+      // A logical node: a segment and an offset into its chain
+      template<typename TreeType>
+      class ChainNode {
+      public:
+        typedef typename std::remove_const<TreeType>::type::ValueType ValueType;
+        typedef typename std::remove_const<TreeType>::type::IndexType IndexType;
+        typedef typename std::conditional<std::is_const<TreeType>::value,
+          ValueType const&, ValueType&>::type ValueRef;
+        typedef ChainNode<TreeType> SelfType;
+
+      private:
+        TreeType* _tree;
+        IndexType _segment;
+        IndexType _offset;
+
+      public:
+        ChainNode( ) :
+          _tree( nullptr ), _segment( 0 ), _offset( 0 ) {}
+
+        ChainNode( TreeType& aTree, IndexType aSegment, IndexType aOffset ) :
+          _tree( &aTree ), _segment( aSegment ), _offset( aOffset ) {}
+
+        // Preorder index
+        IndexType index( ) const {
+          return _tree->chainStart( _segment ) + _offset;
+        }
+
+        IndexType segment( ) const {
+          return _segment;
+        }
+
+        IndexType offset( ) const {
+          return _offset;
+        }
+
+        ValueRef data( ) const {
+          return _tree->data( index( ) );
+        }
+
+        void data( ValueType const& aData ) const {
+          _tree->data( index( ) ) = aData;
+        }
+
+        std::size_t depth( ) const {
+          return _tree->segmentDepth( _segment ) + _offset;
+        }
+
+        bool isRoot( ) const {
+          return _segment == 0 && _offset == 0;
+        }
+
+        // Last node of its chain, where the chain may branch
+        bool isChainEnd( ) const {
+          return _offset + 1 == _tree->chainLength( _segment );
+        }
+
+        bool isLeaf( ) const {
+          return isChainEnd( ) && _tree->firstChildSegment( _segment ) == TreeType::npos;
+        }
+
+        std::size_t numberOfChildren( ) const {
+          std::size_t ret = 1;
+          if ( isChainEnd( ) ) {
+            ret = 0;
+            for ( IndexType c = _tree->firstChildSegment( _segment ); c != TreeType::npos; c = _tree->nextSibling( c ) ) {
+              ++ret;
+            }
+          }
+          return ret;
+        }
+
+        // The root is its own parent, like an exhausted walk upwards
+        SelfType parent( ) const {
+          if ( _offset > 0 ) {
+            return SelfType( *_tree, _segment, _offset - 1 );
+          }
+          if ( isRoot( ) ) {
+            return *this;
+          }
+          const IndexType p = _tree->parentSegment( _segment );
+          return SelfType( *_tree, p, _tree->chainLength( p ) - 1 );
+        }
+
+        // aIndex must be below numberOfChildren( )
+        SelfType operator[]( std::size_t aIndex ) const {
+          if ( !isChainEnd( ) ) {
+            return SelfType( *_tree, _segment, _offset + 1 );
+          }
+          IndexType c = _tree->firstChildSegment( _segment );
+          for ( ; aIndex > 0; --aIndex ) {
+            c = _tree->nextSibling( c );
+          }
+          return SelfType( *_tree, c, 0 );
+        }
+
+        bool operator==( SelfType const& aOther ) const {
+          return _tree == aOther._tree && _segment == aOther._segment && _offset == aOther._offset;
+        }
+
+        bool operator!=( SelfType const& aOther ) const {
+          return !( *this == aOther );
+        }
+      };
+
+      namespace _private {
+        // Preorder needs no stack: after the end of a chain comes the next
+        // segment
+        template<typename TreeType>
+        class chain_pre_order_iterator :
+          public boost::iterator_facade < chain_pre_order_iterator<TreeType>, ChainNode<TreeType>,
+          boost::forward_traversal_tag, ChainNode<TreeType> > {
+        public:
+          typedef ChainNode<TreeType> NodeType;
+          typedef typename NodeType::IndexType IndexType;
+          typedef chain_pre_order_iterator<TreeType> SelfType;
+
+        private:
+          friend class boost::iterator_core_access;
+
+          TreeType* _tree;
+          IndexType _segment;
+          IndexType _offset;
+
+        public:
+          chain_pre_order_iterator( ) :
+            _tree( nullptr ), _segment( 0 ), _offset( 0 ) {}
+
+          chain_pre_order_iterator( TreeType& aTree, IndexType aSegment ) :
+            _tree( &aTree ), _segment( aSegment ), _offset( 0 ) {}
+
+        private:
+          NodeType dereference( ) const {
+            return NodeType( *_tree, _segment, _offset );
+          }
+
+          bool equal( SelfType const& aOther ) const {
+            return _tree == aOther._tree && _segment == aOther._segment && _offset == aOther._offset;
+          }
+
+          void increment( ) {
+            if ( ++_offset == _tree->chainLength( _segment ) ) {
+              ++_segment;
+              _offset = 0;
+            }
+          }
+        };
+      } // _private
+
+      //=====================================================================
+      // Chain NTree
+      template<typename NodeDataType>
+      class ChainNTree {
+      public:
+        typedef NodeDataType ValueType;
+        typedef ValueType& ValueRef;
+        typedef ValueType const& ConstValueRef;
+        typedef std::uint32_t IndexType;
+        typedef ChainNTree<ValueType> SelfType;
+        typedef ChainNode<SelfType> NodeType;
+        typedef ChainNode<SelfType const> ConstNodeType;
+        typedef _private::chain_pre_order_iterator<SelfType> pre_order_iterator;
+        typedef _private::chain_pre_order_iterator<SelfType const> const_pre_order_iterator;
+
+        static const IndexType npos = std::numeric_limits<IndexType>::max( );
+
+      private:
+        std::vector<ValueType> _values;
+        std::vector<IndexType> _chainStart;
+        std::vector<IndexType> _parent;
+        std::vector<IndexType> _nextSibling;
+        std::vector<IndexType> _depth;
+
+      public:
+        template<typename TreeNodeType>
+        explicit ChainNTree( NTree<TreeNodeType> const& aTree ) {
+          build( aTree.root( ) );
+        }
+
+        template<typename TreeNodeType>
+        explicit ChainNTree( TreeNodeType const& aRoot ) {
+          build( aRoot );
+        }
+
+        // Logical nodes
+        std::size_t size( ) const {
+          return _values.size( );
+        }
+
+        // Stored segments, size( ) / segments( ) is the average chain length
+        std::size_t segments( ) const {
+          return _parent.size( );
+        }
+
+        NodeType root( ) {
+          return NodeType( *this, 0, 0 );
+        }
+
+        ConstNodeType root( ) const {
+          return ConstNodeType( *this, 0, 0 );
+        }
+
+        // Node at preorder index aIndex, O(log segments)
+        NodeType node( IndexType aIndex ) {
+          const IndexType s = segmentOf( aIndex );
+          return NodeType( *this, s, aIndex - _chainStart[ s ] );
+        }
+
+        ConstNodeType node( IndexType aIndex ) const {
+          const IndexType s = segmentOf( aIndex );
+          return ConstNodeType( *this, s, aIndex - _chainStart[ s ] );
+        }
+
+        ValueRef data( IndexType aIndex ) {
+          return _values[ aIndex ];
+        }
+
+        ConstValueRef data( IndexType aIndex ) const {
+          return _values[ aIndex ];
+        }
+
+        // Contiguous payloads in preorder
+        ValueType const* values( ) const {
+          return _values.data( );
+        }
+
+        IndexType chainStart( IndexType aSegment ) const {
+          return _chainStart[ aSegment ];
+        }
+
+        IndexType chainLength( IndexType aSegment ) const {
+          return _chainStart[ aSegment + 1 ] - _chainStart[ aSegment ];
+        }
+
+        IndexType parentSegment( IndexType aSegment ) const {
+          return _parent[ aSegment ];
+        }
+
+        IndexType firstChildSegment( IndexType aSegment ) const {
+          return aSegment + 1 < segments( ) && _parent[ aSegment + 1 ] == aSegment ? aSegment + 1 : npos;
+        }
+
+        IndexType nextSibling( IndexType aSegment ) const {
+          return _nextSibling[ aSegment ];
+        }
+
+        IndexType segmentDepth( IndexType aSegment ) const {
+          return _depth[ aSegment ];
+        }
+
+        pre_order_iterator pre_order_begin( ) {
+          return pre_order_iterator( *this, 0 );
+        }
+
+        pre_order_iterator pre_order_end( ) {
+          return pre_order_iterator( *this, static_cast< IndexType >( segments( ) ) );
+        }
+
+        const_pre_order_iterator pre_order_begin( ) const {
+          return const_pre_order_iterator( *this, 0 );
+        }
+
+        const_pre_order_iterator pre_order_end( ) const {
+          return const_pre_order_iterator( *this, static_cast< IndexType >( segments( ) ) );
+        }
+
+        // Range based for loops go in preorder
+        pre_order_iterator begin( ) {
+          return pre_order_begin( );
+        }
+
+        pre_order_iterator end( ) {
+          return pre_order_end( );
+        }
+
+        const_pre_order_iterator begin( ) const {
+          return pre_order_begin( );
+        }
+
+        const_pre_order_iterator end( ) const {
+          return pre_order_end( );
+        }
+
+        // Expands the chains back into an NTree
+        template<typename TreeNodeType = tree::Node<ValueType>>
+        NTree<TreeNodeType> expand( ) const {
+          TreeNodeType root;
+          root.data( _values.empty( ) ? ValueType( ) : _values[ 0 ] );
+          NTree<TreeNodeType> ret( root );
+          // The last logical node of every segment, in the new tree
+          std::vector<TreeNodeType*> tail( segments( ), nullptr );
+          for ( IndexType s = 0; s < segments( ); ++s ) {
+            TreeNodeType* n = &ret.root( );
+            if ( s > 0 ) {
+              TreeNodeType& p = *tail[ _parent[ s ] ];
+              p.addChild( _values[ _chainStart[ s ] ] );
+              n = &p[ p.numberOfChildren( ) - 1 ];
+            }
+            for ( IndexType i = _chainStart[ s ] + 1; i < _chainStart[ s + 1 ]; ++i ) {
+              n->addChild( _values[ i ] );
+              n = &( *n )[ 0 ];
+            }
+            tail[ s ] = n;
+          }
+          return ret;
+        }
+
+      private:
+        IndexType segmentOf( IndexType aIndex ) const {
+          if ( aIndex >= size( ) ) {
+            throw std::out_of_range( "ChainNTree: index out of range" );
+          }
+          return static_cast< IndexType >( std::upper_bound( _chainStart.begin( ), _chainStart.end( ), aIndex ) - _chainStart.begin( ) - 1 );
+        }
+
+        template<typename TreeNodeType>
+        void build( TreeNodeType const& aRoot ) {
+          typedef std::pair<TreeNodeType const*, IndexType> Entry;
+          // Chain heads with their parent segment
+          std::vector<Entry> stack( 1, Entry( &aRoot, npos ) );
+          // Last segment seen under each segment, to link siblings
+          std::vector<IndexType> lastChild;
+          while ( !stack.empty( ) ) {
+            const Entry e = stack.back( );
+            stack.pop_back( );
+            if ( _values.size( ) >= npos || _parent.size( ) >= npos - 1 ) {
+              throw std::length_error( "ChainNTree: tree too large" );
+            }
+            const IndexType s = static_cast< IndexType >( _parent.size( ) );
+            _chainStart.push_back( static_cast< IndexType >( _values.size( ) ) );
+            _parent.push_back( e.second );
+            _nextSibling.push_back( npos );
+            lastChild.push_back( npos );
+            if ( e.second == npos ) {
+              _depth.push_back( 0 );
+            }
+            else {
+              // The first child of a segment is the one after it, so the
+              // parent's end is known
+              _depth.push_back( _depth[ e.second ] + chainLength( e.second ) );
+              if ( lastChild[ e.second ] != npos ) {
+                _nextSibling[ lastChild[ e.second ] ] = s;
+              }
+              lastChild[ e.second ] = s;
+            }
+
+            // Follow the chain while there is exactly one child
+            TreeNodeType const* n = e.first;
+            for ( ;; ) {
+              _values.push_back( *n ? n->data( ) : ValueType( ) );
+              auto const& children = _private::NodeUtility::children( *n );
+              if ( children.size( ) != 1 ) {
+                for ( std::size_t i = children.size( ); i-- > 0; ) {
+                  stack.push_back( Entry( &children[ i ], s ) );
+                }
+                break;
+              }
+              n = &children[ 0 ];
+            }
+          }
+          _chainStart.push_back( static_cast< IndexType >( _values.size( ) ) );
+        }
+      };
+
+      template<typename NodeDataType>
+      const typename ChainNTree<NodeDataType>::IndexType ChainNTree<NodeDataType>::npos;
+
+      //=====================================================================
+      // Visitor traversals, aVisitor( ChainNode )
+      template<typename NodeDataType, typename Visitor>
+      void visitPreOrder( ChainNTree<NodeDataType>& aTree, Visitor aVisitor ) {
+        for ( auto n : aTree ) {
+          aVisitor( n );
+        }
+      }
+
+      // Children segments first, then the chain from its end back up
+      template<typename NodeDataType, typename Visitor>
+      void visitPostOrder( ChainNTree<NodeDataType>& aTree, Visitor aVisitor ) {
+        typedef ChainNTree<NodeDataType> TreeType;
+        typedef typename TreeType::IndexType IndexType;
+        // Segment and its next child segment to descend into
+        std::vector<std::pair<IndexType, IndexType>> stack( 1, std::make_pair( IndexType( 0 ), aTree.firstChildSegment( 0 ) ) );
+        while ( !stack.empty( ) ) {
+          const IndexType s = stack.back( ).first;
+          const IndexType c = stack.back( ).second;
+          if ( c != TreeType::npos ) {
+            stack.back( ).second = aTree.nextSibling( c );
+            stack.push_back( std::make_pair( c, aTree.firstChildSegment( c ) ) );
+            continue;
+          }
+          stack.pop_back( );
+          for ( IndexType o = aTree.chainLength( s ); o-- > 0; ) {
+            aVisitor( typename TreeType::NodeType( aTree, s, o ) );
+          }
+        }
+      }
+
+      template<typename NodeDataType, typename Visitor>
+      void visitLevelOrder( ChainNTree<NodeDataType>& aTree, Visitor aVisitor ) {
+        typedef ChainNTree<NodeDataType> TreeType;
+        typedef typename TreeType::IndexType IndexType;
+        typedef std::pair<IndexType, IndexType> Entry;
+        std::vector<Entry> level( 1, Entry( 0, 0 ) );
+        std::vector<Entry> next;
+        while ( !level.empty( ) ) {
+          for ( auto const& e : level ) {
+            aVisitor( typename TreeType::NodeType( aTree, e.first, e.second ) );
+            if ( e.second + 1 < aTree.chainLength( e.first ) ) {
+              next.push_back( Entry( e.first, e.second + 1 ) );
+            }
+            else {
+              for ( IndexType c = aTree.firstChildSegment( e.first ); c != TreeType::npos; c = aTree.nextSibling( c ) ) {
+                next.push_back( Entry( c, 0 ) );
+              }
+            }
+          }
+          level.swap( next );
+          next.clear( );
+        }
+      }
+    }
+  }
+}
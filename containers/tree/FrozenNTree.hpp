@@ -0,0 +1,562 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined( _WIN32 )
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Frozen NTree: a read only, pointer free image of an NTree.
+//
+// File layout (all offsets are from the start of the file, every array is
+// aligned to FrozenLayout::Alignment bytes):
+//
+//   FrozenHeader
+//   parent[ n ]       preorder index of the parent, npos for the root
+//   firstChild[ n ]   preorder index of the first child, npos for a leaf
+//   nextSibling[ n ]  preorder index of the next sibling, npos for the last
+//   subtreeEnd[ n ]   one past the last preorder index of the subtree
+//   values[ n ]       payloads, trivially copyable ValueType
+//
+// Nodes are numbered in preorder, so node 0 is the root and the subtree of
+// node i is the contiguous index interval [ i, subtreeEnd[ i ] ).
+// The image is used in place: FrozenNTree maps the file and the view only
+// points into the mapping, so many processes share the same page cache.
+namespace blib {
+  namespace container {
+    namespace tree {
+      //=====================================================================
+      // Frozen Layout
+      struct FrozenLayout {
+        typedef std::uint32_t IndexType;
+
+        static const IndexType npos = std::numeric_limits<IndexType>::max( );
+        static const std::uint32_t Version = 1;
+        static const std::uint32_t ByteOrderMark = 0x01020304;
+        static const std::uint64_t Alignment = 64;
+
+        static std::uint64_t align( std::uint64_t aOffset ) {
+          return ( aOffset + Alignment - 1 ) & ~( Alignment - 1 );
+        }
+
+        static char const* magic( ) {
+          return "BLIBFNT";
+        }
+      };
+
+      struct FrozenHeader {
+        char magic[ 8 ];
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint32_t indexSize;
+        std::uint32_t valueSize;
+        std::uint32_t valueAlign;
+        std::uint32_t reserved;
+        std::uint64_t nodeCount;
+        std::uint64_t parentOffset;
+        std::uint64_t firstChildOffset;
+        std::uint64_t nextSiblingOffset;
+        std::uint64_t subtreeEndOffset;
+        std::uint64_t valueOffset;
+        std::uint64_t fileSize;
+      };
+
+      namespace _private {
+        //=====================================================================
+        // Read only memory mapping of a whole file
+        class MappedFile {
+        private:
+          void const* _base;
+          std::size_t _size;
+#if defined( _WIN32 )
+          HANDLE _file;
+          HANDLE _mapping;
+#endif
+
+        public:
+          explicit MappedFile( std::string const& aPath ) :
+            _base( nullptr ), _size( 0 ) {
+#if defined( _WIN32 )
+            _file = INVALID_HANDLE_VALUE;
+            _mapping = nullptr;
+            _file = ::CreateFileA( aPath.c_str( ), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+            if ( _file == INVALID_HANDLE_VALUE ) {
+              throw std::runtime_error( "FrozenNTree: cannot open " + aPath );
+            }
+            LARGE_INTEGER size;
+            if ( !::GetFileSizeEx( _file, &size ) ) {
+              close( );
+              throw std::runtime_error( "FrozenNTree: cannot stat " + aPath );
+            }
+            _size = static_cast< std::size_t >( size.QuadPart );
+            if ( _size ) {
+              _mapping = ::CreateFileMappingA( _file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+              if ( _mapping ) {
+                _base = ::MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 );
+              }
+              if ( !_base ) {
+                close( );
+                throw std::runtime_error( "FrozenNTree: cannot map " + aPath );
+              }
+            }
+#else
+            int fd = ::open( aPath.c_str( ), O_RDONLY );
+            if ( fd < 0 ) {
+              throw std::runtime_error( "FrozenNTree: cannot open " + aPath );
+            }
+            struct stat st;
+            if ( ::fstat( fd, &st ) != 0 ) {
+              ::close( fd );
+              throw std::runtime_error( "FrozenNTree: cannot stat " + aPath );
+            }
+            _size = static_cast< std::size_t >( st.st_size );
+            if ( _size ) {
+              void* p = ::mmap( nullptr, _size, PROT_READ, MAP_SHARED, fd, 0 );
+              if ( p == MAP_FAILED ) {
+                ::close( fd );
+                throw std::runtime_error( "FrozenNTree: cannot map " + aPath );
+              }
+              _base = p;
+            }
+            // The mapping keeps its own reference to the file
+            ::close( fd );
+#endif
+          }
+
+          ~MappedFile( ) {
+            close( );
+          }
+
+          void const* data( ) const {
+            return _base;
+          }
+
+          std::size_t size( ) const {
+            return _size;
+          }
+
+        private:
+          MappedFile( MappedFile const& );
+          MappedFile& operator=( MappedFile const& );
+
+          void close( ) {
+#if defined( _WIN32 )
+            if ( _base ) {
+              ::UnmapViewOfFile( _base );
+            }
+            if ( _mapping ) {
+              ::CloseHandle( _mapping );
+            }
+            if ( _file != INVALID_HANDLE_VALUE ) {
+              ::CloseHandle( _file );
+            }
+            _mapping = nullptr;
+            _file = INVALID_HANDLE_VALUE;
+#else
+            if ( _base ) {
+              ::munmap( const_cast< void* >( _base ), _size );
+            }
+#endif
+            _base = nullptr;
+          }
+        };
+      } // _private
+
+      //=====================================================================
+      // Frozen NTree View
+      // Non owning, zero parse view over a frozen image in memory.
+      template<typename NodeDataType>
+      class FrozenNTreeView {
+      public:
+        typedef NodeDataType ValueType;
+        typedef ValueType const& ConstValueRef;
+        typedef FrozenLayout::IndexType IndexType;
+        typedef FrozenNTreeView<ValueType> SelfType;
+
+        static_assert( std::is_trivially_copyable<ValueType>::value,
+                       "FrozenNTreeView requires a trivially copyable ValueType" );
+
+        static const IndexType npos = FrozenLayout::npos;
+
+      private:
+        IndexType const* _parent;
+        IndexType const* _firstChild;
+        IndexType const* _nextSibling;
+        IndexType const* _subtreeEnd;
+        ValueType const* _values;
+        std::size_t _size;
+
+        template<typename T>
+        static T const* at( char const* aBase, std::uint64_t aOffset ) {
+          return reinterpret_cast< T const* >( aBase + aOffset );
+        }
+
+        // Throws unless aCount elements of T fit at aOffset within the
+        // first aFileSize bytes, aligned for T
+        template<typename T>
+        static void section( char const* aBase, std::uint64_t aFileSize, std::uint64_t aOffset,
+                             std::uint64_t aCount, char const* aName ) {
+          if ( aOffset > aFileSize || aCount > ( aFileSize - aOffset ) / sizeof( T ) ) {
+            throw std::runtime_error( std::string( "FrozenNTree: truncated " ) + aName + " section" );
+          }
+          if ( ( reinterpret_cast< std::uintptr_t >( aBase ) + aOffset ) % alignof( T ) != 0 ) {
+            throw std::runtime_error( std::string( "FrozenNTree: misaligned " ) + aName + " section" );
+          }
+        }
+
+      public:
+        FrozenNTreeView( ) :
+          _parent( nullptr ), _firstChild( nullptr ), _nextSibling( nullptr ),
+          _subtreeEnd( nullptr ), _values( nullptr ), _size( 0 ) {}
+
+        // aBase must stay valid for the lifetime of the view.
+        FrozenNTreeView( void const* aBase, std::size_t aSize ) {
+          attach( aBase, aSize );
+        }
+
+        // Checks the header and that every section lies aligned inside the
+        // image, in O(1), and throws std::runtime_error otherwise. The view
+        // is unchanged on failure. The links are not looked at, see verify( ).
+        void attach( void const* aBase, std::size_t aSize ) {
+          FrozenHeader header;
+          if ( !aBase || aSize < sizeof( header ) ) {
+            throw std::runtime_error( "FrozenNTree: image too small" );
+          }
+          std::memcpy( &header, aBase, sizeof( header ) );
+          if ( std::memcmp( header.magic, FrozenLayout::magic( ), sizeof( header.magic ) ) != 0 ) {
+            throw std::runtime_error( "FrozenNTree: bad magic" );
+          }
+          if ( header.version != FrozenLayout::Version ) {
+            throw std::runtime_error( "FrozenNTree: unsupported version" );
+          }
+          if ( header.byteOrder != FrozenLayout::ByteOrderMark ) {
+            throw std::runtime_error( "FrozenNTree: image has a different byte order" );
+          }
+          if ( header.indexSize != sizeof( IndexType ) ||
+               header.valueSize != sizeof( ValueType ) ||
+               header.valueAlign != alignof( ValueType ) ) {
+            throw std::runtime_error( "FrozenNTree: image was written for another ValueType" );
+          }
+          if ( header.fileSize > aSize ) {
+            throw std::runtime_error( "FrozenNTree: truncated image" );
+          }
+          if ( header.nodeCount >= npos ) {
+            throw std::runtime_error( "FrozenNTree: too many nodes for the index type" );
+          }
+
+          char const* base = static_cast< char const* >( aBase );
+          const std::uint64_t n = header.nodeCount;
+          section<IndexType>( base, header.fileSize, header.parentOffset, n, "parent" );
+          section<IndexType>( base, header.fileSize, header.firstChildOffset, n, "firstChild" );
+          section<IndexType>( base, header.fileSize, header.nextSiblingOffset, n, "nextSibling" );
+          section<IndexType>( base, header.fileSize, header.subtreeEndOffset, n, "subtreeEnd" );
+          section<ValueType>( base, header.fileSize, header.valueOffset, n, "values" );
+
+          SelfType view;
+          view._size = static_cast< std::size_t >( n );
+          view._parent = at<IndexType>( base, header.parentOffset );
+          view._firstChild = at<IndexType>( base, header.firstChildOffset );
+          view._nextSibling = at<IndexType>( base, header.nextSiblingOffset );
+          view._subtreeEnd = at<IndexType>( base, header.subtreeEndOffset );
+          view._values = at<ValueType>( base, header.valueOffset );
+          *this = view;
+        }
+
+        // Every link names a node, where preorder allows one: the parent
+        // comes before its node and its subtree encloses the node's, the
+        // first child comes right after its node, the next sibling where
+        // the node's subtree ends. Traversals then stay inside the image and
+        // terminate. O(n), one sequential pass; attach( ) leaves it to the
+        // caller, for images that did not come from a trusted writer.
+        void verify( ) const {
+          for ( std::size_t i = 0; i < _size; ++i ) {
+            const std::size_t end = _subtreeEnd[ i ];
+            bool ok = end > i && end <= _size && _firstChild[ i ] == ( end > i + 1 ? i + 1 : npos );
+            if ( i == 0 ) {
+              ok = ok && _parent[ i ] == npos && _nextSibling[ i ] == npos;
+            }
+            else {
+              const std::size_t parentEnd = _parent[ i ] < i ? _subtreeEnd[ _parent[ i ] ] : 0;
+              ok = ok && end <= parentEnd && _nextSibling[ i ] == ( end < parentEnd ? end : npos );
+            }
+            if ( !ok ) {
+              throw std::runtime_error( "FrozenNTree: corrupt links at node " + std::to_string( i ) );
+            }
+          }
+        }
+
+        std::size_t size( ) const {
+          return _size;
+        }
+
+        bool empty( ) const {
+          return _size == 0;
+        }
+
+        IndexType root( ) const {
+          return empty( ) ? npos : 0;
+        }
+
+        IndexType parent( IndexType aNode ) const {
+          return _parent[ aNode ];
+        }
+
+        IndexType firstChild( IndexType aNode ) const {
+          return _firstChild[ aNode ];
+        }
+
+        IndexType nextSibling( IndexType aNode ) const {
+          return _nextSibling[ aNode ];
+        }
+
+        // One past the last node of the subtree in preorder
+        IndexType subtreeEnd( IndexType aNode ) const {
+          return _subtreeEnd[ aNode ];
+        }
+
+        std::size_t subtreeSize( IndexType aNode ) const {
+          return _subtreeEnd[ aNode ] - aNode;
+        }
+
+        bool isLeaf( IndexType aNode ) const {
+          return _firstChild[ aNode ] == npos;
+        }
+
+        bool isRoot( IndexType aNode ) const {
+          return _parent[ aNode ] == npos;
+        }
+
+        std::size_t numberOfChildren( IndexType aNode ) const {
+          std::size_t ret = 0;
+          for ( IndexType c = _firstChild[ aNode ]; c != npos; c = _nextSibling[ c ] ) {
+            ++ret;
+          }
+          return ret;
+        }
+
+        ConstValueRef data( IndexType aNode ) const {
+          return _values[ aNode ];
+        }
+
+        // Contiguous payloads in preorder
+        ValueType const* values( ) const {
+          return _values;
+        }
+
+        IndexType const* parents( ) const {
+          return _parent;
+        }
+
+        IndexType const* subtreeEnds( ) const {
+          return _subtreeEnd;
+        }
+      };
+
+      template<typename NodeDataType>
+      const typename FrozenNTreeView<NodeDataType>::IndexType FrozenNTreeView<NodeDataType>::npos;
+
+      //=====================================================================
+      // Frozen NTree
+      // Owns the mapping of a frozen image file. The mapping is read only and
+      // shared, so opening the same file in many processes costs one copy.
+      template<typename NodeDataType>
+      class FrozenNTree :
+        private _private::MappedFile,
+        public FrozenNTreeView < NodeDataType > {
+      private:
+        typedef _private::MappedFile FileType;
+        typedef FrozenNTreeView<NodeDataType> ViewType;
+
+      public:
+        using ViewType::size;
+        using ViewType::data;
+
+        explicit FrozenNTree( std::string const& aPath ) :
+          FileType( aPath ),
+          ViewType( FileType::data( ), FileType::size( ) ) {}
+
+        ViewType const& view( ) const {
+          return *this;
+        }
+      };
+
+      //=====================================================================
+      // Frozen NTree Writer
+      // Flattens an NTree into the frozen layout and writes the image.
+      // Nodes without data are stored with a value initialized ValueType.
+      template<typename TreeType>
+      class FrozenNTreeWriter {
+      public:
+        typedef typename TreeType::Node Node;
+        typedef typename TreeType::ValueType ValueType;
+        typedef FrozenLayout::IndexType IndexType;
+
+        static_assert( std::is_trivially_copyable<ValueType>::value,
+                       "FrozenNTreeWriter requires a trivially copyable ValueType" );
+
+      private:
+        std::vector<IndexType> _parent;
+        std::vector<IndexType> _firstChild;
+        std::vector<IndexType> _nextSibling;
+        std::vector<IndexType> _subtreeEnd;
+        std::vector<ValueType> _values;
+
+      public:
+        explicit FrozenNTreeWriter( TreeType& aTree ) {
+          flatten( aTree.root( ) );
+        }
+
+        std::size_t size( ) const {
+          return _values.size( );
+        }
+
+        void write( std::string const& aPath ) const {
+          std::ofstream out( aPath.c_str( ), std::ios::binary | std::ios::trunc );
+          if ( !out ) {
+            throw std::runtime_error( "FrozenNTree: cannot create " + aPath );
+          }
+          write( out );
+          out.close( );
+          if ( !out ) {
+            throw std::runtime_error( "FrozenNTree: cannot write " + aPath );
+          }
+        }
+
+        void write( std::ostream& aOut ) const {
+          const std::uint64_t n = _values.size( );
+          const std::uint64_t indexBytes = n * sizeof( IndexType );
+
+          FrozenHeader header;
+          std::memset( &header, 0, sizeof( header ) );
+          std::memcpy( header.magic, FrozenLayout::magic( ), sizeof( header.magic ) );
+          header.version = FrozenLayout::Version;
+          header.byteOrder = FrozenLayout::ByteOrderMark;
+          header.indexSize = sizeof( IndexType );
+          header.valueSize = sizeof( ValueType );
+          header.valueAlign = alignof( ValueType );
+          header.nodeCount = n;
+          header.parentOffset = FrozenLayout::align( sizeof( header ) );
+          header.firstChildOffset = FrozenLayout::align( header.parentOffset + indexBytes );
+          header.nextSiblingOffset = FrozenLayout::align( header.firstChildOffset + indexBytes );
+          header.subtreeEndOffset = FrozenLayout::align( header.nextSiblingOffset + indexBytes );
+          header.valueOffset = FrozenLayout::align( header.subtreeEndOffset + indexBytes );
+          header.fileSize = header.valueOffset + n * sizeof( ValueType );
+
+          std::uint64_t pos = 0;
+          put( aOut, pos, 0, &header, sizeof( header ) );
+          put( aOut, pos, header.parentOffset, _parent.data( ), indexBytes );
+          put( aOut, pos, header.firstChildOffset, _firstChild.data( ), indexBytes );
+          put( aOut, pos, header.nextSiblingOffset, _nextSibling.data( ), indexBytes );
+          put( aOut, pos, header.subtreeEndOffset, _subtreeEnd.data( ), indexBytes );
+          put( aOut, pos, header.valueOffset, _values.data( ), n * sizeof( ValueType ) );
+        }
+
+      private:
+        static void put( std::ostream& aOut, std::uint64_t& aPos, std::uint64_t aOffset,
+                         void const* aData, std::uint64_t aBytes ) {
+          static const char zeros[ FrozenLayout::Alignment ] = {};
+          while ( aPos < aOffset ) {
+            std::uint64_t pad = aOffset - aPos;
+            if ( pad > sizeof( zeros ) ) {
+              pad = sizeof( zeros );
+            }
+            aOut.write( zeros, static_cast< std::streamsize >( pad ) );
+            aPos += pad;
+          }
+          if ( aBytes ) {
+            aOut.write( static_cast< char const* >( aData ), static_cast< std::streamsize >( aBytes ) );
+            aPos += aBytes;
+          }
+        }
+
+        void append( Node& aNode, IndexType aParent ) {
+          const IndexType none = FrozenLayout::npos;
+          if ( _values.size( ) >= none ) {
+            throw std::length_error( "FrozenNTree: too many nodes for the index type" );
+          }
+          _parent.push_back( aParent );
+          _firstChild.push_back( none );
+          _nextSibling.push_back( none );
+          _values.push_back( aNode ? aNode.data( ) : ValueType( ) );
+        }
+
+        // Iterative preorder walk, the explicit stack keeps deep chains off
+        // the call stack. Children are pushed right to left so they are
+        // numbered left to right.
+        void flatten( Node& aRoot ) {
+          typedef std::pair<Node*, IndexType> Entry;
+          const IndexType none = FrozenLayout::npos;
+          std::vector<Entry> stack;
+          std::vector<IndexType> lastChild;
+
+          stack.push_back( Entry( &aRoot, none ) );
+          while ( !stack.empty( ) ) {
+            Entry e = stack.back( );
+            stack.pop_back( );
+
+            const IndexType self = static_cast< IndexType >( _values.size( ) );
+            append( *e.first, e.second );
+            lastChild.push_back( none );
+            if ( e.second != none ) {
+              if ( lastChild[ e.second ] == none ) {
+                _firstChild[ e.second ] = self;
+              }
+              else {
+                _nextSibling[ lastChild[ e.second ] ] = self;
+              }
+              lastChild[ e.second ] = self;
+            }
+
+            for ( auto it = e.first->child_node_rtol_begin( );
+                  it != e.first->child_node_rtol_end( );
+                  ++it ) {
+              stack.push_back( Entry( &*it, self ) );
+            }
+          }
+
+          // Children always follow their parent, so one reverse sweep
+          // propagates the subtree ends upwards.
+          const std::size_t n = _values.size( );
+          _subtreeEnd.resize( n );
+          for ( std::size_t i = 0; i < n; ++i ) {
+            _subtreeEnd[ i ] = static_cast< IndexType >( i + 1 );
+          }
+          for ( std::size_t i = n; i-- > 1; ) {
+            IndexType& end = _subtreeEnd[ _parent[ i ] ];
+            if ( _subtreeEnd[ i ] > end ) {
+              end = _subtreeEnd[ i ];
+            }
+          }
+        }
+      };
+
+      // Freeze aTree into the image file aPath.
+      template<typename TreeType>
+      void freeze( TreeType& aTree, std::string const& aPath ) {
+        FrozenNTreeWriter<TreeType> writer( aTree );
+        writer.write( aPath );
+      }
+    }
+  }
+}
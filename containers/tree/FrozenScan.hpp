@@ -0,0 +1,787 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "FrozenNTree.hpp"
+
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+#define BLIB_SCAN_X86 1
+#include <immintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile each kernel for its own instruction set, MSVC lets
+// any function use any intrinsic.
+#if defined( BLIB_SCAN_X86 ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define BLIB_SCAN_TARGET( aIsa ) __attribute__( ( target( aIsa ) ) )
+#else
+#define BLIB_SCAN_TARGET( aIsa )
+#endif
+
+// Predicate scans over the contiguous preorder values of a frozen tree.
+//
+//   range( lo, hi )   lo <= v && v <= hi
+//   equal( v )
+//   anyBits( m )      ( v & m ) != 0, integral values only
+//   allBits( m )      ( v & m ) == m, integral values only
+//
+// The result is a bitmap over the node indices or the matching indices in
+// increasing order. Giving a subtree root restricts the scan to its
+// preorder interval [ root, subtreeEnd( root ) ).
+//
+// 32 and 64 bit integers, float and double are scanned 64 values at a time
+// with SSE2, AVX2 or AVX-512 kernels, picked at runtime from what the CPU
+// supports (asking for more than that gets the best one there is); other
+// value types, and 64 bit integers on SSE2, use the scalar loop. Floating
+// point comparisons are ordered, NaN never matches.
+namespace blib {
+  namespace container {
+    namespace tree {
+      enum class ScanIsa {
+        Scalar,
+        Sse2,
+        Avx2,
+        Avx512,
+        // Best one the CPU supports
+        Auto
+      };
+
+      enum class ScanKind {
+        Range,
+        Equal,
+        AnyBits,
+        AllBits
+      };
+
+      template<typename ValueType>
+      class ScanPredicate {
+      private:
+        ScanKind _kind;
+        ValueType _a;
+        ValueType _b;
+
+        ScanPredicate( ScanKind aKind, ValueType aA, ValueType aB ) :
+          _kind( aKind ), _a( aA ), _b( aB ) {}
+
+      public:
+        static ScanPredicate range( ValueType aLow, ValueType aHigh ) {
+          return ScanPredicate( ScanKind::Range, aLow, aHigh );
+        }
+
+        static ScanPredicate equal( ValueType aValue ) {
+          return ScanPredicate( ScanKind::Equal, aValue, aValue );
+        }
+
+        static ScanPredicate anyBits( ValueType aMask ) {
+          static_assert( std::is_integral<ValueType>::value, "anyBits needs an integral ValueType" );
+          return ScanPredicate( ScanKind::AnyBits, aMask, aMask );
+        }
+
+        static ScanPredicate allBits( ValueType aMask ) {
+          static_assert( std::is_integral<ValueType>::value, "allBits needs an integral ValueType" );
+          return ScanPredicate( ScanKind::AllBits, aMask, aMask );
+        }
+
+        ScanKind kind( ) const {
+          return _kind;
+        }
+
+        // Bounds of Range and Equal, the mask of the bit tests
+        ValueType low( ) const {
+          return _a;
+        }
+
+        ValueType high( ) const {
+          return _b;
+        }
+
+        bool operator()( ValueType const& aValue ) const {
+          bool ret = false;
+          switch ( _kind ) {
+          case ScanKind::Range:
+          case ScanKind::Equal:
+            // Ordered like the kernels, NaN fails both comparisons
+            ret = _a <= aValue && aValue <= _b;
+            break;
+          case ScanKind::AnyBits:
+            ret = bitsAny( aValue );
+            break;
+          case ScanKind::AllBits:
+            ret = bitsAll( aValue );
+            break;
+          }
+          return ret;
+        }
+
+      private:
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value, bool>::type bitsAny( T aValue ) const {
+          return ( aValue & _a ) != 0;
+        }
+
+        template<typename T>
+        typename std::enable_if<!std::is_integral<T>::value, bool>::type bitsAny( T ) const {
+          return false;
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value, bool>::type bitsAll( T aValue ) const {
+          return ( aValue & _a ) == _a;
+        }
+
+        template<typename T>
+        typename std::enable_if<!std::is_integral<T>::value, bool>::type bitsAll( T ) const {
+          return false;
+        }
+      };
+
+      //=====================================================================
+      // Scan Bitmap
+      // One bit per node index, words are little endian in the index.
+      class ScanBitmap {
+      public:
+        typedef FrozenLayout::IndexType IndexType;
+
+      private:
+        std::vector<std::uint64_t> _words;
+        std::size_t _size;
+
+      public:
+        explicit ScanBitmap( std::size_t aSize = 0 ) :
+          _words( ( aSize + 63 ) / 64, 0 ), _size( aSize ) {}
+
+        std::size_t size( ) const {
+          return _size;
+        }
+
+        bool test( std::size_t aIndex ) const {
+          return ( _words[ aIndex / 64 ] >> ( aIndex % 64 ) ) & 1;
+        }
+
+        std::size_t count( ) const {
+          std::size_t ret = 0;
+          for ( std::uint64_t w : _words ) {
+            ret += std::bitset<64>( w ).count( );
+          }
+          return ret;
+        }
+
+        std::vector<std::uint64_t> const& words( ) const {
+          return _words;
+        }
+
+        std::uint64_t* data( ) {
+          return _words.data( );
+        }
+
+        // Calls aFunction( index ) for every set bit, in increasing order
+        template<typename Function>
+        void forEach( Function aFunction ) const {
+          for ( std::size_t w = 0; w < _words.size( ); ++w ) {
+            std::uint64_t word = _words[ w ];
+            while ( word ) {
+              aFunction( static_cast< IndexType >( w * 64 + trailingZeros( word ) ) );
+              word &= word - 1;
+            }
+          }
+        }
+
+        std::vector<IndexType> indices( ) const {
+          std::vector<IndexType> ret;
+          ret.reserve( count( ) );
+          forEach( [ &ret ]( IndexType aIndex ) {
+            ret.push_back( aIndex );
+          } );
+          return ret;
+        }
+
+      private:
+        static unsigned trailingZeros( std::uint64_t aWord ) {
+#if defined( _MSC_VER ) && defined( _M_X64 )
+          unsigned long ret;
+          _BitScanForward64( &ret, aWord );
+          return static_cast< unsigned >( ret );
+#elif defined( __GNUC__ )
+          return static_cast< unsigned >( __builtin_ctzll( aWord ) );
+#else
+          unsigned ret = 0;
+          while ( !( aWord & 1 ) ) {
+            aWord >>= 1;
+            ++ret;
+          }
+          return ret;
+#endif
+        }
+      };
+
+      namespace _private {
+        //=====================================================================
+        // CPU Features
+        inline ScanIsa detectScanIsa( ) {
+          ScanIsa ret = ScanIsa::Scalar;
+#if defined( BLIB_SCAN_X86 ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+          __builtin_cpu_init( );
+          if ( __builtin_cpu_supports( "avx512f" ) ) {
+            ret = ScanIsa::Avx512;
+          }
+          else if ( __builtin_cpu_supports( "avx2" ) ) {
+            ret = ScanIsa::Avx2;
+          }
+          else if ( __builtin_cpu_supports( "sse2" ) ) {
+            ret = ScanIsa::Sse2;
+          }
+#elif defined( BLIB_SCAN_X86 ) && defined( _MSC_VER )
+          int info[ 4 ];
+          __cpuid( info, 1 );
+          const bool sse2 = ( info[ 3 ] & ( 1 << 26 ) ) != 0;
+          const bool osxsave = ( info[ 2 ] & ( 1 << 27 ) ) != 0;
+          const unsigned long long xcr0 = osxsave ? _xgetbv( 0 ) : 0;
+          __cpuidex( info, 7, 0 );
+          if ( ( info[ 1 ] & ( 1 << 16 ) ) && ( xcr0 & 0xE6 ) == 0xE6 ) {
+            ret = ScanIsa::Avx512;
+          }
+          else if ( ( info[ 1 ] & ( 1 << 5 ) ) && ( xcr0 & 0x6 ) == 0x6 ) {
+            ret = ScanIsa::Avx2;
+          }
+          else if ( sse2 ) {
+            ret = ScanIsa::Sse2;
+          }
+#endif
+          return ret;
+        }
+
+        inline ScanIsa bestScanIsa( ) {
+          static const ScanIsa isa = detectScanIsa( );
+          return isa;
+        }
+
+#if defined( BLIB_SCAN_X86 )
+        //=====================================================================
+        // Kernels
+        // Each one fills aBlocks whole 64 bit words of aOut from 64 * aBlocks
+        // values. Range bounds of integers come biased: unsigned values are
+        // flipped into signed order by xoring the sign bit, aBias is that bit
+        // ( 0 for signed types ) and the bounds are already xored with it.
+        class Sse2Scan {
+        public:
+          static const bool Has64BitIntegers = false;
+
+          BLIB_SCAN_TARGET( "sse2" )
+          static void range( std::int32_t const* aValues, std::size_t aBlocks,
+                             std::int32_t aLow, std::int32_t aHigh, std::int32_t aBias, std::uint64_t* aOut ) {
+            const __m128i bias = _mm_set1_epi32( aBias );
+            const __m128i low = _mm_set1_epi32( aLow );
+            const __m128i high = _mm_set1_epi32( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 4 ) {
+                const __m128i v = _mm_xor_si128( _mm_loadu_si128( reinterpret_cast< __m128i const* >( aValues + j ) ), bias );
+                const __m128i out = _mm_or_si128( _mm_cmplt_epi32( v, low ), _mm_cmpgt_epi32( v, high ) );
+                m |= static_cast< std::uint64_t >( ~_mm_movemask_ps( _mm_castsi128_ps( out ) ) & 0xF ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "sse2" )
+          static void range( float const* aValues, std::size_t aBlocks, float aLow, float aHigh, std::uint64_t* aOut ) {
+            const __m128 low = _mm_set1_ps( aLow );
+            const __m128 high = _mm_set1_ps( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 4 ) {
+                const __m128 v = _mm_loadu_ps( aValues + j );
+                const __m128 in = _mm_and_ps( _mm_cmpge_ps( v, low ), _mm_cmple_ps( v, high ) );
+                m |= static_cast< std::uint64_t >( _mm_movemask_ps( in ) ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "sse2" )
+          static void range( double const* aValues, std::size_t aBlocks, double aLow, double aHigh, std::uint64_t* aOut ) {
+            const __m128d low = _mm_set1_pd( aLow );
+            const __m128d high = _mm_set1_pd( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 2 ) {
+                const __m128d v = _mm_loadu_pd( aValues + j );
+                const __m128d in = _mm_and_pd( _mm_cmpge_pd( v, low ), _mm_cmple_pd( v, high ) );
+                m |= static_cast< std::uint64_t >( _mm_movemask_pd( in ) ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "sse2" )
+          static void bits( std::int32_t const* aValues, std::size_t aBlocks, std::int32_t aMask, bool aAll, std::uint64_t* aOut ) {
+            const __m128i mask = _mm_set1_epi32( aMask );
+            const __m128i target = aAll ? mask : _mm_setzero_si128( );
+            const int flip = aAll ? 0 : 0xF;
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 4 ) {
+                const __m128i v = _mm_and_si128( _mm_loadu_si128( reinterpret_cast< __m128i const* >( aValues + j ) ), mask );
+                const int eq = _mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( v, target ) ) );
+                m |= static_cast< std::uint64_t >( eq ^ flip ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          static void range( std::int64_t const*, std::size_t, std::int64_t, std::int64_t, std::int64_t, std::uint64_t* ) {}
+
+          static void bits( std::int64_t const*, std::size_t, std::int64_t, bool, std::uint64_t* ) {}
+        };
+
+        class Avx2Scan {
+        public:
+          static const bool Has64BitIntegers = true;
+
+          BLIB_SCAN_TARGET( "avx2" )
+          static void range( std::int32_t const* aValues, std::size_t aBlocks,
+                             std::int32_t aLow, std::int32_t aHigh, std::int32_t aBias, std::uint64_t* aOut ) {
+            const __m256i bias = _mm256_set1_epi32( aBias );
+            const __m256i low = _mm256_set1_epi32( aLow );
+            const __m256i high = _mm256_set1_epi32( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 8 ) {
+                const __m256i v = _mm256_xor_si256( _mm256_loadu_si256( reinterpret_cast< __m256i const* >( aValues + j ) ), bias );
+                const __m256i out = _mm256_or_si256( _mm256_cmpgt_epi32( low, v ), _mm256_cmpgt_epi32( v, high ) );
+                m |= static_cast< std::uint64_t >( ~_mm256_movemask_ps( _mm256_castsi256_ps( out ) ) & 0xFF ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx2" )
+          static void range( std::int64_t const* aValues, std::size_t aBlocks,
+                             std::int64_t aLow, std::int64_t aHigh, std::int64_t aBias, std::uint64_t* aOut ) {
+            const __m256i bias = _mm256_set1_epi64x( aBias );
+            const __m256i low = _mm256_set1_epi64x( aLow );
+            const __m256i high = _mm256_set1_epi64x( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 4 ) {
+                const __m256i v = _mm256_xor_si256( _mm256_loadu_si256( reinterpret_cast< __m256i const* >( aValues + j ) ), bias );
+                const __m256i out = _mm256_or_si256( _mm256_cmpgt_epi64( low, v ), _mm256_cmpgt_epi64( v, high ) );
+                m |= static_cast< std::uint64_t >( ~_mm256_movemask_pd( _mm256_castsi256_pd( out ) ) & 0xF ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx2" )
+          static void range( float const* aValues, std::size_t aBlocks, float aLow, float aHigh, std::uint64_t* aOut ) {
+            const __m256 low = _mm256_set1_ps( aLow );
+            const __m256 high = _mm256_set1_ps( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 8 ) {
+                const __m256 v = _mm256_loadu_ps( aValues + j );
+                const __m256 in = _mm256_and_ps( _mm256_cmp_ps( v, low, _CMP_GE_OQ ), _mm256_cmp_ps( v, high, _CMP_LE_OQ ) );
+                m |= static_cast< std::uint64_t >( _mm256_movemask_ps( in ) ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx2" )
+          static void range( double const* aValues, std::size_t aBlocks, double aLow, double aHigh, std::uint64_t* aOut ) {
+            const __m256d low = _mm256_set1_pd( aLow );
+            const __m256d high = _mm256_set1_pd( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 4 ) {
+                const __m256d v = _mm256_loadu_pd( aValues + j );
+                const __m256d in = _mm256_and_pd( _mm256_cmp_pd( v, low, _CMP_GE_OQ ), _mm256_cmp_pd( v, high, _CMP_LE_OQ ) );
+                m |= static_cast< std::uint64_t >( _mm256_movemask_pd( in ) ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx2" )
+          static void bits( std::int32_t const* aValues, std::size_t aBlocks, std::int32_t aMask, bool aAll, std::uint64_t* aOut ) {
+            const __m256i mask = _mm256_set1_epi32( aMask );
+            const __m256i target = aAll ? mask : _mm256_setzero_si256( );
+            const int flip = aAll ? 0 : 0xFF;
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 8 ) {
+                const __m256i v = _mm256_and_si256( _mm256_loadu_si256( reinterpret_cast< __m256i const* >( aValues + j ) ), mask );
+                const int eq = _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpeq_epi32( v, target ) ) );
+                m |= static_cast< std::uint64_t >( eq ^ flip ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx2" )
+          static void bits( std::int64_t const* aValues, std::size_t aBlocks, std::int64_t aMask, bool aAll, std::uint64_t* aOut ) {
+            const __m256i mask = _mm256_set1_epi64x( aMask );
+            const __m256i target = aAll ? mask : _mm256_setzero_si256( );
+            const int flip = aAll ? 0 : 0xF;
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 4 ) {
+                const __m256i v = _mm256_and_si256( _mm256_loadu_si256( reinterpret_cast< __m256i const* >( aValues + j ) ), mask );
+                const int eq = _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpeq_epi64( v, target ) ) );
+                m |= static_cast< std::uint64_t >( eq ^ flip ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+        };
+
+        class Avx512Scan {
+        public:
+          static const bool Has64BitIntegers = true;
+
+          BLIB_SCAN_TARGET( "avx512f" )
+          static void range( std::int32_t const* aValues, std::size_t aBlocks,
+                             std::int32_t aLow, std::int32_t aHigh, std::int32_t aBias, std::uint64_t* aOut ) {
+            const __m512i bias = _mm512_set1_epi32( aBias );
+            const __m512i low = _mm512_set1_epi32( aLow );
+            const __m512i high = _mm512_set1_epi32( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 16 ) {
+                const __m512i v = _mm512_xor_si512( _mm512_loadu_si512( aValues + j ), bias );
+                const __mmask16 in = _mm512_mask_cmple_epi32_mask( _mm512_cmpge_epi32_mask( v, low ), v, high );
+                m |= static_cast< std::uint64_t >( in ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx512f" )
+          static void range( std::int64_t const* aValues, std::size_t aBlocks,
+                             std::int64_t aLow, std::int64_t aHigh, std::int64_t aBias, std::uint64_t* aOut ) {
+            const __m512i bias = _mm512_set1_epi64( aBias );
+            const __m512i low = _mm512_set1_epi64( aLow );
+            const __m512i high = _mm512_set1_epi64( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 8 ) {
+                const __m512i v = _mm512_xor_si512( _mm512_loadu_si512( aValues + j ), bias );
+                const __mmask8 in = _mm512_mask_cmple_epi64_mask( _mm512_cmpge_epi64_mask( v, low ), v, high );
+                m |= static_cast< std::uint64_t >( in ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx512f" )
+          static void range( float const* aValues, std::size_t aBlocks, float aLow, float aHigh, std::uint64_t* aOut ) {
+            const __m512 low = _mm512_set1_ps( aLow );
+            const __m512 high = _mm512_set1_ps( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 16 ) {
+                const __m512 v = _mm512_loadu_ps( aValues + j );
+                const __mmask16 in = _mm512_mask_cmp_ps_mask( _mm512_cmp_ps_mask( v, low, _CMP_GE_OQ ), v, high, _CMP_LE_OQ );
+                m |= static_cast< std::uint64_t >( in ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx512f" )
+          static void range( double const* aValues, std::size_t aBlocks, double aLow, double aHigh, std::uint64_t* aOut ) {
+            const __m512d low = _mm512_set1_pd( aLow );
+            const __m512d high = _mm512_set1_pd( aHigh );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 8 ) {
+                const __m512d v = _mm512_loadu_pd( aValues + j );
+                const __mmask8 in = _mm512_mask_cmp_pd_mask( _mm512_cmp_pd_mask( v, low, _CMP_GE_OQ ), v, high, _CMP_LE_OQ );
+                m |= static_cast< std::uint64_t >( in ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx512f" )
+          static void bits( std::int32_t const* aValues, std::size_t aBlocks, std::int32_t aMask, bool aAll, std::uint64_t* aOut ) {
+            const __m512i mask = _mm512_set1_epi32( aMask );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 16 ) {
+                const __m512i v = _mm512_and_si512( _mm512_loadu_si512( aValues + j ), mask );
+                const __mmask16 in = aAll ? _mm512_cmpeq_epi32_mask( v, mask ) : _mm512_test_epi32_mask( v, v );
+                m |= static_cast< std::uint64_t >( in ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+
+          BLIB_SCAN_TARGET( "avx512f" )
+          static void bits( std::int64_t const* aValues, std::size_t aBlocks, std::int64_t aMask, bool aAll, std::uint64_t* aOut ) {
+            const __m512i mask = _mm512_set1_epi64( aMask );
+            for ( std::size_t b = 0; b < aBlocks; ++b ) {
+              std::uint64_t m = 0;
+              for ( unsigned j = 0; j < 64; j += 8 ) {
+                const __m512i v = _mm512_and_si512( _mm512_loadu_si512( aValues + j ), mask );
+                const __mmask8 in = aAll ? _mm512_cmpeq_epi64_mask( v, mask ) : _mm512_test_epi64_mask( v, v );
+                m |= static_cast< std::uint64_t >( in ) << j;
+              }
+              aOut[ b ] = m;
+              aValues += 64;
+            }
+          }
+        };
+#endif
+
+        //=====================================================================
+        // Scan Dispatch
+        // Lane type the kernels see for a ValueType, void when there is none
+        template<typename ValueType, typename Enable = void>
+        struct ScanLane {
+          typedef void Type;
+        };
+
+        template<typename ValueType>
+        struct ScanLane<ValueType, typename std::enable_if<std::is_integral<ValueType>::value &&
+          !std::is_same<ValueType, bool>::value && sizeof( ValueType ) == 4>::type> {
+          typedef std::int32_t Type;
+        };
+
+        template<typename ValueType>
+        struct ScanLane<ValueType, typename std::enable_if<std::is_integral<ValueType>::value &&
+          sizeof( ValueType ) == 8>::type> {
+          typedef std::int64_t Type;
+        };
+
+        template<>
+        struct ScanLane<float> {
+          typedef float Type;
+        };
+
+        template<>
+        struct ScanLane<double> {
+          typedef double Type;
+        };
+
+        template<typename ValueType>
+        class ScanEngine {
+        public:
+          typedef typename ScanLane<ValueType>::Type LaneType;
+          typedef ScanPredicate<ValueType> Predicate;
+
+          // Words [ aFirstWord, aFirstWord + aWords ) of aOut, from the values
+          // they cover. Values past aSize read as non matching.
+          static void run( ValueType const* aValues, std::size_t aSize, std::size_t aFirstWord, std::size_t aWords,
+                           Predicate const& aPredicate, ScanIsa aIsa, std::uint64_t* aOut ) {
+            const std::size_t first = aFirstWord * 64;
+            std::size_t full = std::min( aWords, ( aSize - first ) / 64 );
+            const ScanIsa best = bestScanIsa( );
+            if ( aIsa == ScanIsa::Auto || aIsa > best ) {
+              aIsa = best;
+            }
+            if ( !vector( aValues + first, full, aPredicate, aIsa, aOut + aFirstWord, LaneTag( ) ) ) {
+              full = 0;
+            }
+            for ( std::size_t w = full; w < aWords; ++w ) {
+              std::uint64_t m = 0;
+              const std::size_t base = first + w * 64;
+              const std::size_t end = std::min<std::size_t>( base + 64, aSize );
+              for ( std::size_t i = base; i < end; ++i ) {
+                m |= static_cast< std::uint64_t >( aPredicate( aValues[ i ] ) ) << ( i - base );
+              }
+              aOut[ aFirstWord + w ] = m;
+            }
+          }
+
+        private:
+          template<typename T>
+          struct Tag {};
+          typedef Tag<LaneType> LaneTag;
+
+          // Sign bit for unsigned integers, see the kernels
+          template<typename Lane>
+          static Lane bias( ) {
+            return std::is_signed<ValueType>::value ? Lane( 0 ) : std::numeric_limits<Lane>::min( );
+          }
+
+          // No kernel for this lane type or this architecture
+          template<typename Lane>
+          static bool vector( ValueType const*, std::size_t, Predicate const&, ScanIsa, std::uint64_t*, Tag<Lane> ) {
+            return false;
+          }
+
+#if defined( BLIB_SCAN_X86 )
+          template<typename Kernel, typename Lane>
+          static bool integers( ValueType const* aValues, std::size_t aBlocks, Predicate const& aPredicate, std::uint64_t* aOut ) {
+            if ( sizeof( Lane ) == 8 && !Kernel::Has64BitIntegers ) {
+              return false;
+            }
+            Lane const* lanes = reinterpret_cast< Lane const* >( aValues );
+            const Lane b = bias<Lane>( );
+            switch ( aPredicate.kind( ) ) {
+            case ScanKind::Range:
+            case ScanKind::Equal:
+              Kernel::range( lanes, aBlocks, static_cast< Lane >( aPredicate.low( ) ) ^ b,
+                             static_cast< Lane >( aPredicate.high( ) ) ^ b, b, aOut );
+              break;
+            case ScanKind::AnyBits:
+            case ScanKind::AllBits:
+              Kernel::bits( lanes, aBlocks, static_cast< Lane >( aPredicate.low( ) ),
+                            aPredicate.kind( ) == ScanKind::AllBits, aOut );
+              break;
+            }
+            return true;
+          }
+
+          template<typename Kernel, typename Lane>
+          static bool floats( ValueType const* aValues, std::size_t aBlocks, Predicate const& aPredicate, std::uint64_t* aOut ) {
+            Kernel::range( reinterpret_cast< Lane const* >( aValues ), aBlocks, aPredicate.low( ), aPredicate.high( ), aOut );
+            return true;
+          }
+
+          template<typename Lane>
+          static bool integersOn( ValueType const* aValues, std::size_t aBlocks, Predicate const& aPredicate, ScanIsa aIsa, std::uint64_t* aOut ) {
+            bool ret = false;
+            switch ( aIsa ) {
+            case ScanIsa::Avx512:
+              ret = integers<Avx512Scan, Lane>( aValues, aBlocks, aPredicate, aOut );
+              break;
+            case ScanIsa::Avx2:
+              ret = integers<Avx2Scan, Lane>( aValues, aBlocks, aPredicate, aOut );
+              break;
+            case ScanIsa::Sse2:
+              ret = integers<Sse2Scan, Lane>( aValues, aBlocks, aPredicate, aOut );
+              break;
+            default:
+              break;
+            }
+            return ret;
+          }
+
+          template<typename Lane>
+          static bool floatsOn( ValueType const* aValues, std::size_t aBlocks, Predicate const& aPredicate, ScanIsa aIsa, std::uint64_t* aOut ) {
+            bool ret = false;
+            switch ( aIsa ) {
+            case ScanIsa::Avx512:
+              ret = floats<Avx512Scan, Lane>( aValues, aBlocks, aPredicate, aOut );
+              break;
+            case ScanIsa::Avx2:
+              ret = floats<Avx2Scan, Lane>( aValues, aBlocks, aPredicate, aOut );
+              break;
+            case ScanIsa::Sse2:
+              ret = floats<Sse2Scan, Lane>( aValues, aBlocks, aPredicate, aOut );
+              break;
+            default:
+              break;
+            }
+            return ret;
+          }
+
+          static bool vector( ValueType const* aValues, std::size_t aBlocks, Predicate const& aPredicate, ScanIsa aIsa, std::uint64_t* aOut, Tag<std::int32_t> ) {
+            return integersOn<std::int32_t>( aValues, aBlocks, aPredicate, aIsa, aOut );
+          }
+
+          static bool vector( ValueType const* aValues, std::size_t aBlocks, Predicate const& aPredicate, ScanIsa aIsa, std::uint64_t* aOut, Tag<std::int64_t> ) {
+            return integersOn<std::int64_t>( aValues, aBlocks, aPredicate, aIsa, aOut );
+          }
+
+          static bool vector( ValueType const* aValues, std::size_t aBlocks, Predicate const& aPredicate, ScanIsa aIsa, std::uint64_t* aOut, Tag<float> ) {
+            return floatsOn<float>( aValues, aBlocks, aPredicate, aIsa, aOut );
+          }
+
+          static bool vector( ValueType const* aValues, std::size_t aBlocks, Predicate const& aPredicate, ScanIsa aIsa, std::uint64_t* aOut, Tag<double> ) {
+            return floatsOn<double>( aValues, aBlocks, aPredicate, aIsa, aOut );
+          }
+#endif
+        };
+      } // _private
+
+      // Instruction set the Auto scans use on this machine
+      inline ScanIsa scanIsa( ) {
+        return _private::bestScanIsa( );
+      }
+
+      // Bitmap of the nodes in [ aBegin, aEnd ) whose value satisfies aPredicate
+      template<typename ValueType>
+      ScanBitmap scanBitmap( FrozenNTreeView<ValueType> const& aView, ScanPredicate<ValueType> const& aPredicate,
+                             std::size_t aBegin, std::size_t aEnd, ScanIsa aIsa = ScanIsa::Auto ) {
+        if ( aBegin > aEnd || aEnd > aView.size( ) ) {
+          throw std::invalid_argument( "scanBitmap: interval out of range" );
+        }
+        ScanBitmap ret( aView.size( ) );
+        if ( aBegin < aEnd ) {
+          const std::size_t firstWord = aBegin / 64;
+          const std::size_t lastWord = ( aEnd - 1 ) / 64;
+          std::uint64_t* words = ret.data( );
+          _private::ScanEngine<ValueType>::run( aView.values( ), aView.size( ), firstWord, lastWord - firstWord + 1,
+                                                aPredicate, aIsa, words );
+          // The edge words also cover nodes outside the interval
+          words[ firstWord ] &= ~std::uint64_t( 0 ) << ( aBegin % 64 );
+          if ( aEnd % 64 ) {
+            words[ lastWord ] &= ~( ~std::uint64_t( 0 ) << ( aEnd % 64 ) );
+          }
+        }
+        return ret;
+      }
+
+      template<typename ValueType>
+      ScanBitmap scanBitmap( FrozenNTreeView<ValueType> const& aView, ScanPredicate<ValueType> const& aPredicate,
+                             ScanIsa aIsa = ScanIsa::Auto ) {
+        return scanBitmap( aView, aPredicate, 0, aView.size( ), aIsa );
+      }
+
+      // Restricted to the subtree of aRoot
+      template<typename ValueType>
+      ScanBitmap scanSubtreeBitmap( FrozenNTreeView<ValueType> const& aView, ScanPredicate<ValueType> const& aPredicate,
+                                    FrozenLayout::IndexType aRoot, ScanIsa aIsa = ScanIsa::Auto ) {
+        if ( aRoot >= aView.size( ) ) {
+          throw std::invalid_argument( "scanSubtreeBitmap: no such node" );
+        }
+        return scanBitmap( aView, aPredicate, aRoot, aView.subtreeEnd( aRoot ), aIsa );
+      }
+
+      template<typename ValueType>
+      std::vector<FrozenLayout::IndexType> scanIndices( FrozenNTreeView<ValueType> const& aView,
+                                                        ScanPredicate<ValueType> const& aPredicate,
+                                                        ScanIsa aIsa = ScanIsa::Auto ) {
+        return scanBitmap( aView, aPredicate, aIsa ).indices( );
+      }
+
+      template<typename ValueType>
+      std::vector<FrozenLayout::IndexType> scanSubtreeIndices( FrozenNTreeView<ValueType> const& aView,
+                                                               ScanPredicate<ValueType> const& aPredicate,
+                                                               FrozenLayout::IndexType aRoot,
+                                                               ScanIsa aIsa = ScanIsa::Auto ) {
+        return scanSubtreeBitmap( aView, aPredicate, aRoot, aIsa ).indices( );
+      }
+    }
+  }
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "NTree.hpp"
+
+// Hash consing: identical subtrees (same values, same shape) are interned
+// once and every occurrence shares the canonical node. A Node copy already
+// shares the payload and the children vector, so the result is an ordinary
+// NTree whose storage is a DAG, and all the read only traversals work
+// unchanged, visiting shared subtrees once per occurrence.
+//
+// The result is immutable: a write through one occurrence shows up in all
+// of them. A shared node has as many parents as occurrences, so parent( )
+// is null for every node below the root and whatever walks up the parent
+// handles, SubtreeView::depth( ) and contains( ) among them, does not work
+// on the result. Summaries of augmented nodes are right when the tree is
+// built and are not kept up to date by writes.
+namespace blib {
+  namespace container {
+    namespace tree {
+      struct HashConsStats {
+        // Nodes of the tree as traversed
+        std::uint64_t logicalNodes;
+        // Canonical nodes actually stored
+        std::uint64_t uniqueNodes;
+
+        HashConsStats( ) :
+          logicalNodes( 0 ), uniqueNodes( 0 ) {}
+
+        double compressionRatio( ) const {
+          return uniqueNodes ? static_cast< double >( logicalNodes ) / static_cast< double >( uniqueNodes ) : 1.0;
+        }
+      };
+
+      //=====================================================================
+      // Hash Cons Builder
+      template<typename NodeType, typename Hash = std::hash<typename NodeType::ValueType>>
+      class HashConsBuilder {
+      public:
+        typedef typename NodeType::ValueType ValueType;
+        typedef typename NodeType::ConstValueRef ConstValueRef;
+        typedef NTree<NodeType> TreeType;
+        typedef std::size_t NodeId;
+
+      private:
+        // Canonical nodes and their children ids, flattened. A deque, so
+        // that interning more nodes does not move the ones in use.
+        std::deque<NodeType> _nodes;
+        std::vector<std::size_t> _childBegin;
+        std::vector<NodeId> _childIds;
+        std::vector<std::uint64_t> _logicalSize;
+        std::unordered_multimap<std::size_t, NodeId> _table;
+        Hash _hash;
+
+      public:
+        explicit HashConsBuilder( Hash aHash = Hash( ) ) :
+          _hash( aHash ) {
+          _childBegin.push_back( 0 );
+        }
+
+        // Canonical id of the node ( aValue, aChildren ). aHasData false
+        // stands for a node without data.
+        NodeId intern( ConstValueRef aValue, std::vector<NodeId> const& aChildren, bool aHasData = true ) {
+          return intern( aHasData ? &aValue : nullptr, aChildren.data( ), aChildren.size( ) );
+        }
+
+        // Interns the whole subtree of aSource, bottom up
+        NodeId intern( NodeType& aSource ) {
+          typedef typename NodeType::child_node_ltor_iterator ChildIterator;
+          struct Frame {
+            NodeType* node;
+            ChildIterator it;
+            std::size_t firstResult;
+          };
+
+          std::vector<Frame> stack;
+          std::vector<NodeId> results;
+          stack.push_back( Frame{ &aSource, aSource.begin( ), 0 } );
+          while ( !stack.empty( ) ) {
+            Frame& top = stack.back( );
+            if ( top.it != top.node->end( ) ) {
+              NodeType& child = *top.it;
+              ++top.it;
+              stack.push_back( Frame{ &child, child.begin( ), results.size( ) } );
+              continue;
+            }
+            NodeType& n = *top.node;
+            const std::size_t first = top.firstResult;
+            const NodeId id = intern( n ? &n.data( ) : nullptr,
+                                      results.data( ) + first, results.size( ) - first );
+            results.resize( first );
+            results.push_back( id );
+            stack.pop_back( );
+          }
+          return results.back( );
+        }
+
+        NodeType const& node( NodeId aId ) const {
+          return _nodes[ aId ];
+        }
+
+        // Read only tree rooted at the canonical node
+        TreeType tree( NodeId aRoot ) const {
+          return TreeType( _nodes[ aRoot ] );
+        }
+
+        std::size_t uniqueNodes( ) const {
+          return _nodes.size( );
+        }
+
+        // Size of the subtree once expanded
+        std::uint64_t logicalNodes( NodeId aId ) const {
+          return _logicalSize[ aId ];
+        }
+
+        // Statistics of the tree rooted at aRoot, counting the canonical
+        // nodes reachable from it.
+        HashConsStats stats( NodeId aRoot ) const {
+          HashConsStats ret;
+          ret.logicalNodes = _logicalSize[ aRoot ];
+          // Ids are assigned bottom up, so every child id is below its parent
+          std::vector<bool> reachable( aRoot + 1, false );
+          reachable[ aRoot ] = true;
+          for ( NodeId id = aRoot + 1; id-- > 0; ) {
+            if ( reachable[ id ] ) {
+              ++ret.uniqueNodes;
+              for ( std::size_t c = _childBegin[ id ]; c < _childBegin[ id + 1 ]; ++c ) {
+                reachable[ _childIds[ c ] ] = true;
+              }
+            }
+          }
+          return ret;
+        }
+
+      private:
+        std::size_t hashOf( ValueType const* aValue, NodeId const* aChildren, std::size_t aCount ) const {
+          std::uint64_t h = aValue ? static_cast< std::uint64_t >( _hash( *aValue ) ) : 0x6a09e667f3bcc908ULL;
+          h ^= aCount + 0x9e3779b97f4a7c15ULL + ( h << 6 ) + ( h >> 2 );
+          for ( std::size_t i = 0; i < aCount; ++i ) {
+            h ^= aChildren[ i ] + 0x9e3779b97f4a7c15ULL + ( h << 6 ) + ( h >> 2 );
+          }
+          return static_cast< std::size_t >( h );
+        }
+
+        bool matches( NodeId aId, ValueType const* aValue, NodeId const* aChildren, std::size_t aCount ) const {
+          NodeType const& n = _nodes[ aId ];
+          if ( bool( n ) != ( aValue != nullptr ) || ( aValue && !( n.data( ) == *aValue ) ) ) {
+            return false;
+          }
+          if ( _childBegin[ aId + 1 ] - _childBegin[ aId ] != aCount ) {
+            return false;
+          }
+          for ( std::size_t i = 0; i < aCount; ++i ) {
+            if ( _childIds[ _childBegin[ aId ] + i ] != aChildren[ i ] ) {
+              return false;
+            }
+          }
+          return true;
+        }
+
+        NodeId intern( ValueType const* aValue, NodeId const* aChildren, std::size_t aCount ) {
+          const std::size_t h = hashOf( aValue, aChildren, aCount );
+          auto range = _table.equal_range( h );
+          for ( auto it = range.first; it != range.second; ++it ) {
+            if ( matches( it->second, aValue, aChildren, aCount ) ) {
+              return it->second;
+            }
+          }
+
+          // The children are placed without addChild( ), which would make
+          // the node their one parent
+          const NodeId id = _nodes.size( );
+          _nodes.push_back( NodeType( ) );
+          NodeType& n = _nodes.back( );
+          if ( aValue ) {
+            n.data( *aValue );
+          }
+          auto& children = _private::NodeUtility::children( n );
+          children.reserve( aCount );
+          std::uint64_t size = 1;
+          for ( std::size_t i = 0; i < aCount; ++i ) {
+            children.push_back( _nodes[ aChildren[ i ] ] );
+            _childIds.push_back( aChildren[ i ] );
+            size += _logicalSize[ aChildren[ i ] ];
+          }
+          _private::Augmenter<typename NodeType::AugmentPolicyType>::recompute( n );
+          _childBegin.push_back( _childIds.size( ) );
+          _logicalSize.push_back( size );
+          _table.insert( std::make_pair( h, id ) );
+          return id;
+        }
+      };
+
+      // Hash consed copy of aTree. The source is left untouched.
+      template<typename NodeType>
+      NTree<NodeType> hashCons( NTree<NodeType>& aTree, HashConsStats* aStats = nullptr ) {
+        HashConsBuilder<NodeType> builder;
+        const typename HashConsBuilder<NodeType>::NodeId root = builder.intern( aTree.root( ) );
+        if ( aStats ) {
+          *aStats = builder.stats( root );
+        }
+        return builder.tree( root );
+      }
+    }
+  }
+}
@@ -0,0 +1,418 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "NTree.hpp"
+
+// Heavy-light decomposition of an NTree whose shape no longer changes.
+//
+// Every node continues the chain of the parent's largest child, so a path
+// crosses O(log n) chains. Chains, and whole subtrees, are contiguous in the
+// decomposition order, and the node values are kept in a lazy segment tree
+// over that order:
+//
+//   pathSum( a, b ), pathAdd( a, b, x )            O(log^2 n)
+//   subtreeSum( a ), subtreeAdd( a, x )            O(log n)
+//   lca( a, b )                                    O(log n)
+//
+// Nodes are named by their preorder index, like in FrozenNTree, and id( )
+// finds the index of a node. Updates change the index only, writeBack( )
+// stores the values into the tree.
+namespace blib {
+  namespace container {
+    namespace tree {
+      namespace _private {
+        //=====================================================================
+        // Lazy Sum Tree
+        // Segment tree with range add and range sum over [ 0, n ).
+        template<typename T>
+        class LazySumTree {
+        private:
+          std::vector<T> _sum;
+          std::vector<T> _pending;
+          std::size_t _size;
+
+        public:
+          LazySumTree( ) :
+            _size( 0 ) {}
+
+          void assign( std::vector<T> const& aValues ) {
+            _size = aValues.size( );
+            _sum.assign( 4 * std::max<std::size_t>( _size, 1 ), T( ) );
+            _pending.assign( _sum.size( ), T( ) );
+            if ( _size ) {
+              build( 1, 0, _size - 1, aValues );
+            }
+          }
+
+          std::size_t size( ) const {
+            return _size;
+          }
+
+          // Inclusive bounds
+          void add( std::size_t aFirst, std::size_t aLast, T const& aDelta ) {
+            add( 1, 0, _size - 1, aFirst, aLast, aDelta );
+          }
+
+          T sum( std::size_t aFirst, std::size_t aLast ) {
+            return sum( 1, 0, _size - 1, aFirst, aLast );
+          }
+
+          // Every value with all pending adds applied, O(n)
+          void flatten( std::vector<T>& aOut ) {
+            aOut.resize( _size );
+            if ( _size ) {
+              flatten( 1, 0, _size - 1, aOut );
+            }
+          }
+
+        private:
+          void build( std::size_t aSlot, std::size_t aLeft, std::size_t aRight, std::vector<T> const& aValues ) {
+            if ( aLeft == aRight ) {
+              _sum[ aSlot ] = aValues[ aLeft ];
+              return;
+            }
+            const std::size_t mid = aLeft + ( aRight - aLeft ) / 2;
+            build( 2 * aSlot, aLeft, mid, aValues );
+            build( 2 * aSlot + 1, mid + 1, aRight, aValues );
+            _sum[ aSlot ] = _sum[ 2 * aSlot ] + _sum[ 2 * aSlot + 1 ];
+          }
+
+          void apply( std::size_t aSlot, std::size_t aCount, T const& aDelta ) {
+            _sum[ aSlot ] += aDelta * static_cast< T >( aCount );
+            _pending[ aSlot ] += aDelta;
+          }
+
+          void push( std::size_t aSlot, std::size_t aLeft, std::size_t aMid, std::size_t aRight ) {
+            if ( _pending[ aSlot ] != T( ) ) {
+              apply( 2 * aSlot, aMid - aLeft + 1, _pending[ aSlot ] );
+              apply( 2 * aSlot + 1, aRight - aMid, _pending[ aSlot ] );
+              _pending[ aSlot ] = T( );
+            }
+          }
+
+          void add( std::size_t aSlot, std::size_t aLeft, std::size_t aRight,
+                    std::size_t aFirst, std::size_t aLast, T const& aDelta ) {
+            if ( aFirst <= aLeft && aRight <= aLast ) {
+              apply( aSlot, aRight - aLeft + 1, aDelta );
+              return;
+            }
+            const std::size_t mid = aLeft + ( aRight - aLeft ) / 2;
+            push( aSlot, aLeft, mid, aRight );
+            if ( aFirst <= mid ) {
+              add( 2 * aSlot, aLeft, mid, aFirst, aLast, aDelta );
+            }
+            if ( aLast > mid ) {
+              add( 2 * aSlot + 1, mid + 1, aRight, aFirst, aLast, aDelta );
+            }
+            _sum[ aSlot ] = _sum[ 2 * aSlot ] + _sum[ 2 * aSlot + 1 ];
+          }
+
+          T sum( std::size_t aSlot, std::size_t aLeft, std::size_t aRight, std::size_t aFirst, std::size_t aLast ) {
+            if ( aFirst <= aLeft && aRight <= aLast ) {
+              return _sum[ aSlot ];
+            }
+            const std::size_t mid = aLeft + ( aRight - aLeft ) / 2;
+            push( aSlot, aLeft, mid, aRight );
+            T ret = T( );
+            if ( aFirst <= mid ) {
+              ret += sum( 2 * aSlot, aLeft, mid, aFirst, aLast );
+            }
+            if ( aLast > mid ) {
+              ret += sum( 2 * aSlot + 1, mid + 1, aRight, aFirst, aLast );
+            }
+            return ret;
+          }
+
+          void flatten( std::size_t aSlot, std::size_t aLeft, std::size_t aRight, std::vector<T>& aOut ) {
+            if ( aLeft == aRight ) {
+              aOut[ aLeft ] = _sum[ aSlot ];
+              return;
+            }
+            const std::size_t mid = aLeft + ( aRight - aLeft ) / 2;
+            push( aSlot, aLeft, mid, aRight );
+            flatten( 2 * aSlot, aLeft, mid, aOut );
+            flatten( 2 * aSlot + 1, mid + 1, aRight, aOut );
+          }
+        };
+      } // _private
+
+      //=====================================================================
+      // Heavy Light Index
+      // T must support +, += and multiplication by a count converted to T.
+      template<typename TreeType, typename T = typename TreeType::ValueType>
+      class HeavyLightIndex {
+      public:
+        typedef typename TreeType::Node Node;
+        typedef typename TreeType::NodeRef NodeRef;
+        typedef typename TreeType::ConstNodeRef ConstNodeRef;
+        typedef T ValueType;
+        typedef std::uint32_t IndexType;
+        typedef std::pair<IndexType, IndexType> Path;
+        typedef HeavyLightIndex<TreeType, T> SelfType;
+
+        // Path add, applied by pathAdd( aUpdates )
+        struct PathUpdate {
+          IndexType from;
+          IndexType to;
+          ValueType delta;
+        };
+
+        static const IndexType npos = std::numeric_limits<IndexType>::max( );
+
+      private:
+        std::vector<Node*> _nodes;
+        std::vector<IndexType> _parent;
+        std::vector<IndexType> _depth;
+        std::vector<IndexType> _size;
+        std::vector<IndexType> _head;
+        // Position in the decomposition order
+        std::vector<IndexType> _pos;
+        std::unordered_map<void const*, IndexType> _ids;
+        _private::LazySumTree<ValueType> _values;
+
+      public:
+        explicit HeavyLightIndex( TreeType& aTree ) {
+          build( aTree.root( ) );
+        }
+
+        std::size_t size( ) const {
+          return _nodes.size( );
+        }
+
+        // Preorder index of aNode, or of any copy of it
+        IndexType id( ConstNodeRef aNode ) const {
+          auto it = _ids.find( key( aNode ) );
+          if ( it == _ids.end( ) ) {
+            throw std::invalid_argument( "HeavyLightIndex: node is not in the indexed tree" );
+          }
+          return it->second;
+        }
+
+        NodeRef node( IndexType aId ) const {
+          return *_nodes[ aId ];
+        }
+
+        IndexType parent( IndexType aId ) const {
+          return _parent[ aId ];
+        }
+
+        IndexType depth( IndexType aId ) const {
+          return _depth[ aId ];
+        }
+
+        IndexType subtreeSize( IndexType aId ) const {
+          return _size[ aId ];
+        }
+
+        IndexType lca( IndexType aFrom, IndexType aTo ) const {
+          while ( _head[ aFrom ] != _head[ aTo ] ) {
+            if ( _depth[ _head[ aFrom ] ] < _depth[ _head[ aTo ] ] ) {
+              std::swap( aFrom, aTo );
+            }
+            aFrom = _parent[ _head[ aFrom ] ];
+          }
+          return _depth[ aFrom ] < _depth[ aTo ] ? aFrom : aTo;
+        }
+
+        ValueType value( IndexType aId ) {
+          return _values.sum( _pos[ aId ], _pos[ aId ] );
+        }
+
+        // Sum over the nodes of the path, both ends included
+        ValueType pathSum( IndexType aFrom, IndexType aTo ) {
+          ValueType ret = ValueType( );
+          forEachSegment( aFrom, aTo, [ this, &ret ]( IndexType aFirst, IndexType aLast ) {
+            ret += _values.sum( aFirst, aLast );
+          } );
+          return ret;
+        }
+
+        void pathAdd( IndexType aFrom, IndexType aTo, ValueType const& aDelta ) {
+          forEachSegment( aFrom, aTo, [ this, &aDelta ]( IndexType aFirst, IndexType aLast ) {
+            _values.add( aFirst, aLast, aDelta );
+          } );
+        }
+
+        ValueType subtreeSum( IndexType aId ) {
+          return _values.sum( _pos[ aId ], _pos[ aId ] + _size[ aId ] - 1 );
+        }
+
+        void subtreeAdd( IndexType aId, ValueType const& aDelta ) {
+          _values.add( _pos[ aId ], _pos[ aId ] + _size[ aId ] - 1, aDelta );
+        }
+
+        // Batches: when the batch is large against the tree, the values are
+        // flattened once into prefix sums, or the adds are collected in a
+        // difference array and applied in one rebuild, O(n + k log n)
+        // instead of O(k log^2 n).
+        std::vector<ValueType> pathSum( std::vector<Path> const& aPaths ) {
+          std::vector<ValueType> ret;
+          ret.reserve( aPaths.size( ) );
+          if ( !worthFlattening( aPaths.size( ) ) ) {
+            for ( auto const& p : aPaths ) {
+              ret.push_back( pathSum( p.first, p.second ) );
+            }
+            return ret;
+          }
+          std::vector<ValueType> prefix;
+          _values.flatten( prefix );
+          prefix.insert( prefix.begin( ), ValueType( ) );
+          for ( std::size_t i = 1; i < prefix.size( ); ++i ) {
+            prefix[ i ] += prefix[ i - 1 ];
+          }
+          for ( auto const& p : aPaths ) {
+            ValueType sum = ValueType( );
+            forEachSegment( p.first, p.second, [ &prefix, &sum ]( IndexType aFirst, IndexType aLast ) {
+              sum += prefix[ aLast + 1 ] - prefix[ aFirst ];
+            } );
+            ret.push_back( sum );
+          }
+          return ret;
+        }
+
+        void pathAdd( std::vector<PathUpdate> const& aUpdates ) {
+          if ( !worthFlattening( aUpdates.size( ) ) ) {
+            for ( auto const& u : aUpdates ) {
+              pathAdd( u.from, u.to, u.delta );
+            }
+            return;
+          }
+          std::vector<ValueType> diff( size( ) + 1, ValueType( ) );
+          for ( auto const& u : aUpdates ) {
+            forEachSegment( u.from, u.to, [ &diff, &u ]( IndexType aFirst, IndexType aLast ) {
+              diff[ aFirst ] += u.delta;
+              diff[ aLast + 1 ] -= u.delta;
+            } );
+          }
+          std::vector<ValueType> values;
+          _values.flatten( values );
+          ValueType running = ValueType( );
+          for ( std::size_t i = 0; i < values.size( ); ++i ) {
+            running += diff[ i ];
+            values[ i ] += running;
+          }
+          _values.assign( values );
+        }
+
+        // Stores every value into its node, with the tree's data( ) so that
+        // augmentations stay up to date
+        void writeBack( ) {
+          std::vector<ValueType> values;
+          _values.flatten( values );
+          for ( std::size_t i = 0; i < _nodes.size( ); ++i ) {
+            _nodes[ i ]->data( values[ _pos[ i ] ] );
+          }
+        }
+
+      private:
+        // Every copy of a node shares its children container
+        static void const* key( ConstNodeRef aNode ) {
+          return &_private::NodeUtility::children( aNode );
+        }
+
+        bool worthFlattening( std::size_t aBatch ) const {
+          std::size_t log = 1;
+          while ( ( std::size_t( 1 ) << log ) < size( ) ) {
+            ++log;
+          }
+          return aBatch * log * log >= size( );
+        }
+
+        // Calls aVisit( first, last ) for the runs of decomposition
+        // positions covering the path
+        template<typename Visit>
+        void forEachSegment( IndexType aFrom, IndexType aTo, Visit aVisit ) const {
+          while ( _head[ aFrom ] != _head[ aTo ] ) {
+            if ( _depth[ _head[ aFrom ] ] < _depth[ _head[ aTo ] ] ) {
+              std::swap( aFrom, aTo );
+            }
+            aVisit( _pos[ _head[ aFrom ] ], _pos[ aFrom ] );
+            aFrom = _parent[ _head[ aFrom ] ];
+          }
+          if ( _depth[ aFrom ] > _depth[ aTo ] ) {
+            std::swap( aFrom, aTo );
+          }
+          aVisit( _pos[ aFrom ], _pos[ aTo ] );
+        }
+
+        void build( NodeRef aRoot ) {
+          // Preorder numbering, so the children of i start at i + 1 and
+          // follow each other at subtree size intervals
+          std::vector<std::pair<Node*, IndexType>> stack( 1, std::make_pair( &aRoot, npos ) );
+          while ( !stack.empty( ) ) {
+            Node* n = stack.back( ).first;
+            const IndexType parent = stack.back( ).second;
+            stack.pop_back( );
+            const IndexType id = static_cast< IndexType >( _nodes.size( ) );
+            if ( _nodes.size( ) >= npos ) {
+              throw std::length_error( "HeavyLightIndex: tree too large" );
+            }
+            _nodes.push_back( n );
+            _parent.push_back( parent );
+            _depth.push_back( parent == npos ? 0 : _depth[ parent ] + 1 );
+            _ids[ key( *n ) ] = id;
+            auto& children = _private::NodeUtility::children( *n );
+            for ( std::size_t i = children.size( ); i-- > 0; ) {
+              stack.push_back( std::make_pair( &children[ i ], id ) );
+            }
+          }
+
+          const std::size_t n = _nodes.size( );
+          _size.assign( n, 1 );
+          for ( std::size_t i = n; i-- > 1; ) {
+            _size[ _parent[ i ] ] += _size[ i ];
+          }
+
+          // Heavy child first, so that chains and subtrees are contiguous
+          _head.assign( n, 0 );
+          _pos.assign( n, 0 );
+          std::vector<IndexType> order( 1, 0 );
+          IndexType next = 0;
+          while ( !order.empty( ) ) {
+            const IndexType u = order.back( );
+            order.pop_back( );
+            _pos[ u ] = next++;
+            IndexType heavy = npos;
+            for ( IndexType c = u + 1; c < u + _size[ u ]; c += _size[ c ] ) {
+              if ( heavy == npos || _size[ c ] > _size[ heavy ] ) {
+                heavy = c;
+              }
+            }
+            for ( IndexType c = u + 1; c < u + _size[ u ]; c += _size[ c ] ) {
+              if ( c != heavy ) {
+                _head[ c ] = c;
+                order.push_back( c );
+              }
+            }
+            if ( heavy != npos ) {
+              _head[ heavy ] = _head[ u ];
+              order.push_back( heavy );
+            }
+          }
+
+          std::vector<ValueType> values( n, ValueType( ) );
+          for ( std::size_t i = 0; i < n; ++i ) {
+            if ( *_nodes[ i ] ) {
+              values[ _pos[ i ] ] = ValueType( _nodes[ i ]->data( ) );
+            }
+          }
+          _values.assign( values );
+        }
+      };
+
+      template<typename TreeType, typename T>
+      const typename HeavyLightIndex<TreeType, T>::IndexType HeavyLightIndex<TreeType, T>::npos;
+    }
+  }
+}
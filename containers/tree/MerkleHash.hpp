@@ -0,0 +1,129 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "NTree.hpp"
+
+namespace blib {
+  namespace container {
+    namespace tree {
+      //=====================================================================
+      // Merkle Hash augmentation
+      // Every node keeps a 64 bit hash of its value and of the ordered hashes
+      // of its children: the hash of its value plus, mod 2^64, each child's
+      // hash mixed with the child's position. A write through data( value ),
+      // addChild( ) or removeChild( ) takes the old term out of each
+      // ancestor and puts the new one in, O(1) per ancestor however wide the
+      // node; inserting or removing a child other than the last also remixes
+      // its later siblings, O(fanout) at its parent. Two subtrees can then
+      // be compared by their hashes in O(1).
+      template<template<typename> class Hash = std::hash>
+      struct MerkleHash {
+        typedef std::uint64_t SummaryType;
+
+        template<typename NodeType>
+        static SummaryType leaf( NodeType const& aNode ) {
+          SummaryType ret = 0x6a09e667f3bcc908ULL;
+          if ( aNode ) {
+            Hash<typename NodeType::ValueType> hasher;
+            ret = mix( static_cast< SummaryType >( hasher( aNode.data( ) ) ) );
+          }
+          return ret;
+        }
+
+        static void combine( SummaryType& aAcc, SummaryType const& aPart ) {
+          aAcc += aPart;
+        }
+
+        static void subtract( SummaryType& aAcc, SummaryType const& aPart ) {
+          aAcc -= aPart;
+        }
+
+        // Order sensitive, so swapping two different children changes the hash
+        static SummaryType term( SummaryType const& aChild, std::size_t aPosition ) {
+          return mix( aChild + 0x9e3779b97f4a7c15ULL * ( static_cast< SummaryType >( aPosition ) + 1 ) );
+        }
+
+        // splitmix64 finalizer
+        static SummaryType mix( SummaryType aValue ) {
+          aValue ^= aValue >> 30;
+          aValue *= 0xbf58476d1ce4e5b9ULL;
+          aValue ^= aValue >> 27;
+          aValue *= 0x94d049bb133111ebULL;
+          aValue ^= aValue >> 31;
+          return aValue;
+        }
+      };
+
+      // Node that carries a Merkle hash of its subtree
+      template<typename NodeDataType, template<typename> class Hash = std::hash>
+      using MerkleNode = Node<NodeDataType, std::allocator<NodeDataType>, std::allocator, MerkleHash<Hash>>;
+
+      namespace _private {
+        // Walks both subtrees in lock step. Subtrees sharing storage are
+        // skipped and a hash mismatch fails fast.
+        template<typename NodeType>
+        bool deepEqual( NodeType const& aLeft, NodeType const& aRight ) {
+          typedef std::pair<NodeType const*, NodeType const*> Entry;
+          std::vector<Entry> stack;
+          stack.push_back( Entry( &aLeft, &aRight ) );
+          while ( !stack.empty( ) ) {
+            const Entry e = stack.back( );
+            stack.pop_back( );
+            NodeType const& l = *e.first;
+            NodeType const& r = *e.second;
+
+            if ( l.summary( ) != r.summary( ) ) {
+              return false;
+            }
+            if ( bool( l ) != bool( r ) || ( l && !( l.data( ) == r.data( ) ) ) ) {
+              return false;
+            }
+            auto const& lc = NodeUtility::children( l );
+            auto const& rc = NodeUtility::children( r );
+            if ( &lc == &rc ) {
+              continue;
+            }
+            if ( lc.size( ) != rc.size( ) ) {
+              return false;
+            }
+            for ( std::size_t i = 0; i < lc.size( ); ++i ) {
+              stack.push_back( Entry( &lc[ i ], &rc[ i ] ) );
+            }
+          }
+          return true;
+        }
+      } // _private
+
+      // Structural equality of two subtrees: same values, same shape.
+      // Different hashes answer false in O(1). Equal hashes are confirmed by
+      // a walk unless aConfirm is false, in which case a 64 bit hash
+      // collision would be reported as equal.
+      template<typename NodeType>
+      bool structurallyEqual( NodeType const& aLeft, NodeType const& aRight, bool aConfirm = true ) {
+        bool ret = false;
+        if ( aLeft.summary( ) == aRight.summary( ) ) {
+          ret = !aConfirm || _private::deepEqual( aLeft, aRight );
+        }
+        return ret;
+      }
+
+      template<typename NodeType>
+      bool structurallyEqual( NTree<NodeType> const& aLeft, NTree<NodeType> const& aRight, bool aConfirm = true ) {
+        return structurallyEqual( aLeft.root( ), aRight.root( ), aConfirm );
+      }
+
+      template<typename NodeType>
+      typename NodeType::SummaryType subtreeHash( NodeType const& aNode ) {
+        return aNode.summary( );
+      }
+    }
+  }
+}
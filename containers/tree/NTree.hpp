@@ -5,12 +5,17 @@
 * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 // Author: BrainlessLibraries
 
+#include <algorithm>
+#include <future>
 #include <memory>
 #include <vector>
 #include <queue>
 #include <stack>
+#include <stdexcept>
 #include <functional>
+#include <type_traits>
 #include <boost/iterator/iterator_facade.hpp>
+#include "NTreeStats.hpp"
 
 namespace blib {
   namespace container {
@@ -30,7 +35,9 @@ namespace blib {
 
         private:
           typedef typename Node::ChildrenContainerType ChildrenContainerType;
-          typedef typename ChildrenContainerType::iterator ItrType;
+          // Read only for a const Node
+          typedef typename std::conditional<std::is_const<Node>::value,
+            typename ChildrenContainerType::const_iterator, typename ChildrenContainerType::iterator>::type ItrType;
 
           friend class IteratorUtility;
         private:
@@ -79,7 +86,8 @@ namespace blib {
 
         private:
           typedef typename Node::ChildrenContainerType ChildrenContainerType;
-          typedef typename ChildrenContainerType::reverse_iterator ItrType;
+          typedef typename std::conditional<std::is_const<Node>::value,
+            typename ChildrenContainerType::const_reverse_iterator, typename ChildrenContainerType::reverse_iterator>::type ItrType;
 
           friend class IteratorUtility;
         private:
@@ -178,6 +186,9 @@ namespace blib {
           }
         };
 
+        template<typename AugmentPolicy>
+        class Tournament;
+
         //=====================================================================
         // Node Utility
         class NodeUtility {
@@ -186,6 +197,552 @@ namespace blib {
           static NodeType const * const getNodeInternal( NodeHandleImpl<NodeType> const& aNodeHandle ) {
             return const_cast< NodeType const * const >( aNodeHandle._handle );
           }
+
+          // Mutable parent of aNode, nullptr for a root
+          template<typename NodeType>
+          static NodeType* parentOf( NodeType const& aNode ) {
+            return const_cast< NodeType* >( getNodeInternal( aNode.parent( ) ) );
+          }
+
+          template<typename NodeType>
+          static typename NodeType::ChildrenContainerType& children( NodeType& aNode ) {
+            return aNode.children( );
+          }
+
+          template<typename NodeType>
+          static typename NodeType::ChildrenContainerType const& children( NodeType const& aNode ) {
+            return aNode.children( );
+          }
+
+          // Children container of NodeType, named through children( ) so that
+          // the access check happens here and not at the point of use
+          template<typename NodeType>
+          using ChildrenType = typename std::remove_reference<decltype( children( std::declval<NodeType&>( ) ) )>::type;
+
+          template<typename NodeType>
+          static std::shared_ptr<typename NodeType::SummaryType>& summaryPtr( NodeType& aNode ) {
+            return aNode._summary;
+          }
+
+          template<typename NodeType>
+          static std::shared_ptr<Tournament<typename NodeType::AugmentPolicyType>>& tournamentPtr( NodeType& aNode ) {
+            return aNode._tournament;
+          }
+
+          template<typename NodeType>
+          static std::shared_ptr<typename NodeType::ValueType>& dataPtr( NodeType& aNode ) {
+            return aNode._data;
+          }
+
+          template<typename NodeType>
+          static std::shared_ptr<typename NodeType::ChildrenContainerType>& childrenPtr( NodeType& aNode ) {
+            return aNode._children;
+          }
+
+          // Node over payload and children storage allocated by the caller
+          template<typename NodeType>
+          static NodeType adopt( std::shared_ptr<typename NodeType::ValueType> const& aData,
+                                 std::shared_ptr<ChildrenType<NodeType>> const& aChildren,
+                                 typename NodeType::NodeHandle const& aParent ) {
+            return NodeType( aData, aChildren, aParent );
+          }
+        };
+
+        //=====================================================================
+        // Node Augmentation
+        // A policy keeps a summary of every subtree inside the node:
+        //   typedef ... SummaryType;
+        //   template<typename NodeType>
+        //   static SummaryType leaf( NodeType const& aNode );   // the node alone
+        //   static void combine( SummaryType& aAcc, SummaryType const& aChild );
+        // Children are combined left to right into leaf( node ), combine has
+        // to be associative.
+        // A policy whose combine is commutative and invertible may also give
+        //   static void subtract( SummaryType& aAcc, SummaryType const& aPart );
+        // updates then adjust every ancestor by the difference, O(1) each.
+        // Such a policy may weigh a child by its place among its siblings,
+        //   static SummaryType term( SummaryType const& aChild, std::size_t aPosition );
+        // is then combined instead of the child's summary. Inserting or
+        // removing a child other than the last moves its later siblings, so
+        // its parent recombines its children; the ancestors above are still
+        // adjusted in O(1) each.
+        // Without subtract every ancestor an update changes recombines its
+        // children; a node with WideFanout children or more keeps their
+        // summaries in a Tournament, which makes that O(log fanout).
+        template<typename AugmentPolicy>
+        class HasSubtract {
+        private:
+          template<typename P>
+          static std::true_type test( decltype( P::subtract( std::declval<typename P::SummaryType&>( ),
+                                                             std::declval<typename P::SummaryType const&>( ) ) )* );
+
+          template<typename P>
+          static std::false_type test( ... );
+
+        public:
+          static const bool value = decltype( test<AugmentPolicy>( nullptr ) )::value;
+        };
+
+        template<typename AugmentPolicy>
+        class HasTerm {
+        private:
+          template<typename P>
+          static std::true_type test( decltype( P::term( std::declval<typename P::SummaryType const&>( ),
+                                                         std::size_t( ) ) )* );
+
+          template<typename P>
+          static std::false_type test( ... );
+
+        public:
+          static const bool value = decltype( test<AugmentPolicy>( nullptr ) )::value;
+        };
+
+        // Carried from before a mutation to after it when there is nothing
+        // to carry
+        struct NoSnapshot {};
+
+        // The summaries of the children of a node, in the bottom row of a
+        // binary tree whose every slot above holds the combination of the two
+        // below it. Slots past the last child are empty and skipped, so the
+        // policy needs no identity. A changed child costs O(log fanout).
+        template<typename AugmentPolicy>
+        class Tournament {
+        public:
+          typedef typename AugmentPolicy::SummaryType SummaryType;
+
+        private:
+          std::vector<SummaryType> _slots;
+          std::size_t _width;
+          std::size_t _size;
+
+          // Slot aSlot, whose right half starts at child aRight
+          void pull( std::size_t aSlot, std::size_t aRight ) {
+            _slots[ aSlot ] = _slots[ 2 * aSlot ];
+            if ( aRight < _size ) {
+              AugmentPolicy::combine( _slots[ aSlot ], _slots[ 2 * aSlot + 1 ] );
+            }
+          }
+
+          // The slots above child aIndex
+          void update( std::size_t aIndex ) {
+            std::size_t k = _width + aIndex;
+            for ( std::size_t span = 1; k > 1; span *= 2 ) {
+              k /= 2;
+              pull( k, ( aIndex & ~( 2 * span - 1 ) ) + span );
+            }
+          }
+
+        public:
+          // aChildren must not be empty
+          template<typename ChildrenType>
+          explicit Tournament( ChildrenType const& aChildren ) :
+            _width( 1 ), _size( aChildren.size( ) ) {
+            while ( _width < _size ) {
+              _width *= 2;
+            }
+            _slots.assign( 2 * _width, aChildren.front( ).summary( ) );
+            for ( std::size_t i = 0; i < _size; ++i ) {
+              _slots[ _width + i ] = aChildren[ i ].summary( );
+            }
+            for ( std::size_t span = 1, first = _width / 2; first > 0; span *= 2, first /= 2 ) {
+              for ( std::size_t k = first; k < 2 * first; ++k ) {
+                pull( k, ( k - first ) * 2 * span + span );
+              }
+            }
+          }
+
+          std::size_t size( ) const {
+            return _size;
+          }
+
+          // All children combined left to right
+          SummaryType const& top( ) const {
+            return _slots[ 1 ];
+          }
+
+          void set( std::size_t aIndex, SummaryType const& aSummary ) {
+            _slots[ _width + aIndex ] = aSummary;
+            update( aIndex );
+          }
+
+          // Appends a child, false when the bottom row is full
+          bool push( SummaryType const& aSummary ) {
+            bool ret = false;
+            if ( _size < _width ) {
+              ++_size;
+              set( _size - 1, aSummary );
+              ret = true;
+            }
+            return ret;
+          }
+
+          // Drops the last child, one has to remain
+          void pop( ) {
+            --_size;
+            update( _size );
+          }
+        };
+
+        template<typename AugmentPolicy, bool Invertible = HasSubtract<AugmentPolicy>::value>
+        class AugmentStorage {
+        public:
+          typedef typename AugmentPolicy::SummaryType SummaryType;
+
+        protected:
+          // Shared by all copies of a node, like the data and the children
+          std::shared_ptr<SummaryType> _summary;
+
+        public:
+          SummaryType const& summary( ) const {
+            return *_summary;
+          }
+        };
+
+        template<typename AugmentPolicy>
+        class AugmentStorage<AugmentPolicy, false> : public AugmentStorage<AugmentPolicy, true> {
+        protected:
+          // Set on nodes with WideFanout children or more. Shared by all
+          // copies of a node, like the children it is built from.
+          std::shared_ptr<Tournament<AugmentPolicy>> _tournament;
+        };
+
+        template<typename AugmentPolicy>
+        class Augmenter {
+        public:
+          typedef typename AugmentPolicy::SummaryType SummaryType;
+          typedef std::integral_constant<bool, HasSubtract<AugmentPolicy>::value> Invertible;
+          typedef std::integral_constant<bool, HasTerm<AugmentPolicy>::value> Positional;
+          // What an update needs to know about the state before the mutation
+          typedef typename std::conditional<Invertible::value, SummaryType, NoSnapshot>::type Snapshot;
+
+          // Children from which a node keeps a Tournament, for policies
+          // without subtract
+          static const std::size_t WideFanout = 16;
+
+          // The node's own contribution, taken before its data is written
+          template<typename NodeType>
+          static Snapshot leafSnapshot( NodeType const& aNode ) {
+            return leafSnapshot( aNode, Invertible( ) );
+          }
+
+          // The whole subtree, taken of a child before it is removed
+          template<typename NodeType>
+          static Snapshot summarySnapshot( NodeType const& aNode ) {
+            return summarySnapshot( aNode, Invertible( ) );
+          }
+
+          template<typename NodeType>
+          static void dataWritten( NodeType& aNode, Snapshot const& aOldLeaf ) {
+            dataWritten( aNode, aOldLeaf, Invertible( ) );
+          }
+
+          // aPosition is the index of the new child
+          template<typename NodeType>
+          static void childAdded( NodeType& aNode, std::size_t aPosition ) {
+            childAdded( aNode, aPosition, Invertible( ) );
+          }
+
+          // aPosition is the index the child had
+          template<typename NodeType>
+          static void childRemoved( NodeType& aNode, std::size_t aPosition, Snapshot const& aChild ) {
+            childRemoved( aNode, aPosition, aChild, Invertible( ) );
+          }
+
+          template<typename NodeType>
+          static void init( NodeType& aNode ) {
+            NodeUtility::summaryPtr( aNode ) = std::make_shared<SummaryType>( AugmentPolicy::leaf( aNode ) );
+          }
+
+          // aNode from its children, whose summaries are up to date; O(fanout)
+          template<typename NodeType>
+          static void recompute( NodeType& aNode ) {
+            recompute( aNode, Invertible( ) );
+          }
+
+          // A node copied into a tree gets a payload and a summary of its
+          // own. Writes go through to every copy, and the node it was
+          // copied from has no parent to carry them up the tree.
+          template<typename NodeType>
+          static void detach( NodeType& aNode ) {
+            auto& data = NodeUtility::dataPtr( aNode );
+            if ( data ) {
+              data = std::allocate_shared<typename NodeType::ValueType>( typename NodeType::DataAllocator( ), *data );
+              BLIB_NTREE_STAT( PayloadAllocations, 1 );
+              BLIB_NTREE_STAT( PayloadBytes, sizeof( typename NodeType::ValueType ) );
+            }
+            NodeUtility::summaryPtr( aNode ) = std::make_shared<SummaryType>( aNode.summary( ) );
+          }
+
+        private:
+          template<typename NodeType>
+          static Snapshot leafSnapshot( NodeType const& aNode, std::true_type ) {
+            return AugmentPolicy::leaf( aNode );
+          }
+
+          template<typename NodeType>
+          static Snapshot leafSnapshot( NodeType const&, std::false_type ) {
+            return Snapshot( );
+          }
+
+          template<typename NodeType>
+          static Snapshot summarySnapshot( NodeType const& aNode, std::true_type ) {
+            return aNode.summary( );
+          }
+
+          template<typename NodeType>
+          static Snapshot summarySnapshot( NodeType const&, std::false_type ) {
+            return Snapshot( );
+          }
+
+          static SummaryType term( SummaryType const& aChild, std::size_t aPosition, std::true_type ) {
+            return AugmentPolicy::term( aChild, aPosition );
+          }
+
+          static SummaryType const& term( SummaryType const& aChild, std::size_t, std::false_type ) {
+            return aChild;
+          }
+
+          // Index of aChild among the children of aParent, their number if
+          // it is not there any more. aChild is the node in the children
+          // vector or a copy of it, which shares its children.
+          template<typename NodeType>
+          static std::size_t position( NodeType const& aParent, NodeType const& aChild ) {
+            auto const& c = NodeUtility::children( aParent );
+            const std::less<NodeType const*> before = std::less<NodeType const*>( );
+            std::size_t ret = 0;
+            if ( !before( &aChild, c.data( ) ) && before( &aChild, c.data( ) + c.size( ) ) ) {
+              ret = static_cast< std::size_t >( &aChild - c.data( ) );
+            }
+            else {
+              while ( ret < c.size( ) && &NodeUtility::children( c[ ret ] ) != &NodeUtility::children( aChild ) ) {
+                ++ret;
+              }
+            }
+            return ret;
+          }
+
+          template<typename NodeType>
+          static void recompute( NodeType& aNode, std::true_type ) {
+            SummaryType s = AugmentPolicy::leaf( aNode );
+            auto const& c = NodeUtility::children( aNode );
+            for ( std::size_t i = 0; i < c.size( ); ++i ) {
+              AugmentPolicy::combine( s, term( c[ i ].summary( ), i, Positional( ) ) );
+            }
+            *NodeUtility::summaryPtr( aNode ) = s;
+          }
+
+          template<typename NodeType>
+          static void recompute( NodeType& aNode, std::false_type ) {
+            auto const& c = NodeUtility::children( aNode );
+            auto& tournament = NodeUtility::tournamentPtr( aNode );
+            if ( c.size( ) < WideFanout ) {
+              tournament.reset( );
+              SummaryType s = AugmentPolicy::leaf( aNode );
+              for ( auto const& child : c ) {
+                AugmentPolicy::combine( s, child.summary( ) );
+              }
+              *NodeUtility::summaryPtr( aNode ) = s;
+            }
+            else {
+              tournament = std::make_shared<Tournament<AugmentPolicy>>( c );
+              refresh( aNode );
+            }
+          }
+
+          // aNode from its own data and its Tournament, O(1)
+          template<typename NodeType>
+          static void refresh( NodeType& aNode ) {
+            SummaryType s = AugmentPolicy::leaf( aNode );
+            AugmentPolicy::combine( s, NodeUtility::tournamentPtr( aNode )->top( ) );
+            *NodeUtility::summaryPtr( aNode ) = s;
+          }
+
+          template<typename NodeType>
+          static void dataWritten( NodeType& aNode, Snapshot const& aOldLeaf, std::true_type ) {
+            const SummaryType before = aNode.summary( );
+            SummaryType& s = *NodeUtility::summaryPtr( aNode );
+            AugmentPolicy::combine( s, AugmentPolicy::leaf( aNode ) );
+            AugmentPolicy::subtract( s, aOldLeaf );
+            raise( aNode, before );
+          }
+
+          template<typename NodeType>
+          static void childAdded( NodeType& aNode, std::size_t aPosition, std::true_type ) {
+            const SummaryType before = aNode.summary( );
+            auto const& c = NodeUtility::children( aNode );
+            if ( Positional::value && aPosition + 1 != c.size( ) ) {
+              recompute( aNode );
+            }
+            else {
+              AugmentPolicy::combine( *NodeUtility::summaryPtr( aNode ), term( c[ aPosition ].summary( ), aPosition, Positional( ) ) );
+            }
+            raise( aNode, before );
+          }
+
+          template<typename NodeType>
+          static void childRemoved( NodeType& aNode, std::size_t aPosition, Snapshot const& aChild, std::true_type ) {
+            const SummaryType before = aNode.summary( );
+            if ( Positional::value && aPosition != NodeUtility::children( aNode ).size( ) ) {
+              recompute( aNode );
+            }
+            else {
+              AugmentPolicy::subtract( *NodeUtility::summaryPtr( aNode ), term( aChild, aPosition, Positional( ) ) );
+            }
+            raise( aNode, before );
+          }
+
+          // aNode's summary changed from aOld: take the old term out of each
+          // ancestor and put the new one in, O(1) per ancestor
+          template<typename NodeType>
+          static void raise( NodeType& aNode, SummaryType aOld ) {
+            NodeType const* q = &aNode;
+            for ( NodeType* p = NodeUtility::parentOf( *q ); p; q = p, p = NodeUtility::parentOf( *p ) ) {
+              std::size_t i = 0;
+              if ( Positional::value ) {
+                i = position( *p, *q );
+                if ( i == NodeUtility::children( *p ).size( ) ) {
+                  break;
+                }
+              }
+              SummaryType& s = *NodeUtility::summaryPtr( *p );
+              const SummaryType before = s;
+              AugmentPolicy::combine( s, term( q->summary( ), i, Positional( ) ) );
+              AugmentPolicy::subtract( s, term( aOld, i, Positional( ) ) );
+              aOld = before;
+            }
+          }
+
+          template<typename NodeType>
+          static void dataWritten( NodeType& aNode, Snapshot const&, std::false_type ) {
+            const SummaryType before = aNode.summary( );
+            if ( NodeUtility::tournamentPtr( aNode ) ) {
+              refresh( aNode );
+            }
+            else {
+              recompute( aNode );
+            }
+            if ( !( before == aNode.summary( ) ) ) {
+              raise( aNode );
+            }
+          }
+
+          template<typename NodeType>
+          static void childAdded( NodeType& aNode, std::size_t aPosition, std::false_type ) {
+            const SummaryType before = aNode.summary( );
+            auto const& c = NodeUtility::children( aNode );
+            auto const& tournament = NodeUtility::tournamentPtr( aNode );
+            const bool last = aPosition + 1 == c.size( );
+            if ( tournament && last && tournament->push( c[ aPosition ].summary( ) ) ) {
+              refresh( aNode );
+            }
+            else if ( !tournament && last && c.size( ) < WideFanout ) {
+              AugmentPolicy::combine( *NodeUtility::summaryPtr( aNode ), c[ aPosition ].summary( ) );
+            }
+            else {
+              recompute( aNode );
+            }
+            if ( !( before == aNode.summary( ) ) ) {
+              raise( aNode );
+            }
+          }
+
+          template<typename NodeType>
+          static void childRemoved( NodeType& aNode, std::size_t aPosition, Snapshot const&, std::false_type ) {
+            const SummaryType before = aNode.summary( );
+            auto const& tournament = NodeUtility::tournamentPtr( aNode );
+            if ( tournament && aPosition == NodeUtility::children( aNode ).size( ) && tournament->size( ) > 1 ) {
+              tournament->pop( );
+              refresh( aNode );
+            }
+            else {
+              recompute( aNode );
+            }
+            if ( !( before == aNode.summary( ) ) ) {
+              raise( aNode );
+            }
+          }
+
+          // aNode's summary changed: update it in its parent and go on up
+          // while summaries keep changing. O(log fanout) per wide ancestor,
+          // O(fanout) per narrow one.
+          template<typename NodeType>
+          static void raise( NodeType& aNode ) {
+            NodeType const* q = &aNode;
+            for ( NodeType* p = NodeUtility::parentOf( *q ); p; q = p, p = NodeUtility::parentOf( *p ) ) {
+              const SummaryType before = p->summary( );
+              auto const& tournament = NodeUtility::tournamentPtr( *p );
+              const std::size_t i = tournament ? position( *p, *q ) : 0;
+              if ( tournament && i < tournament->size( ) ) {
+                tournament->set( i, q->summary( ) );
+                refresh( *p );
+              }
+              else {
+                recompute( *p );
+              }
+              if ( before == p->summary( ) ) {
+                break;
+              }
+            }
+          }
+        };
+      } // _private
+
+      // Default policy, nodes carry no summary and the hooks compile away.
+      struct NoAugmentation {};
+
+      namespace _private {
+        template<>
+        class AugmentStorage<NoAugmentation> {};
+
+        template<>
+        class Augmenter<NoAugmentation> {
+        public:
+          template<typename NodeType>
+          static void init( NodeType& ) {}
+
+          template<typename NodeType>
+          static void recompute( NodeType& ) {}
+
+          template<typename NodeType>
+          static void detach( NodeType& ) {}
+
+          typedef NoSnapshot Snapshot;
+
+          template<typename NodeType>
+          static Snapshot leafSnapshot( NodeType const& ) {
+            return Snapshot( );
+          }
+
+          template<typename NodeType>
+          static Snapshot summarySnapshot( NodeType const& ) {
+            return Snapshot( );
+          }
+
+          template<typename NodeType>
+          static void dataWritten( NodeType&, Snapshot const& ) {}
+
+          template<typename NodeType>
+          static void childAdded( NodeType&, std::size_t ) {}
+
+          template<typename NodeType>
+          static void childRemoved( NodeType&, std::size_t, Snapshot const& ) {}
+        };
+
+        //=====================================================================
+        // Traversal Limits
+        // Bounds the pre order and level order iterators: children of a node
+        // at depth maxDepth, or of a node descend( ) rejects, are not entered.
+        // The root is at depth 0.
+        template<typename NodeType>
+        struct TraversalLimits {
+          typedef std::function<bool( NodeType const& )> Predicate;
+
+          std::size_t maxDepth;
+          Predicate descend;
+
+          bool descends( NodeType const& aNode, std::size_t aDepth ) const {
+            return aDepth < maxDepth && ( !descend || descend( aNode ) );
+          }
         };
 
         //=====================================================================
@@ -201,34 +758,60 @@ namespace blib {
           typedef typename Node::ValueType ValueType;
           typedef typename Node::ValueRef ValueRef;
           typedef typename Node::ConstValueRef ConstValueRef;
-          typedef typename Node::NodeRef NodeRef;
+          // Node const for the read only walks
+          typedef Node& NodeRef;
           typedef typename Node::ConstNodeRef ConstNodeRef;
           typedef typename Node::NodeHandle NodeHandle;
           typedef typename Node::NodeAllocator NodeAllocator;
           typedef typename Node::DataAllocator DataAllocator;
           typedef typename Node::child_node_ltor_iterator child_node_ltor_iterator;
           typedef std::reference_wrapper<Node> NodeRefWrapper;
-          typedef std::stack<NodeRefWrapper, std::vector<NodeRefWrapper>> Stack;
+          // A node and its depth
+          typedef std::pair<NodeRefWrapper, std::size_t> Entry;
+          typedef std::stack<Entry, std::vector<Entry>> Stack;
+          typedef TraversalLimits<Node> Limits;
           typedef pre_order_iterator<Node> SelfType;
 
         private:
           friend class boost::iterator_core_access;
 
           std::shared_ptr<Stack> _stack;
-          std::shared_ptr<Node> _cur;
+          // The node itself, in its parent's children, nullptr at the end
+          Node* _cur;
+          std::shared_ptr<Limits> _limits;
+          bool _skip;
 
         public:
-          pre_order_iterator( ) {}
+          pre_order_iterator( ) :
+            _cur( nullptr ), _skip( false ) {}
 
-          pre_order_iterator( NodeRef aRoot ) {
+          pre_order_iterator( NodeRef aRoot, std::shared_ptr<Limits> const& aLimits = std::shared_ptr<Limits>( ) ) :
+            _cur( &aRoot ), _limits( aLimits ), _skip( false ) {
             _stack = std::make_shared<Stack>( );
-            _cur = std::make_shared<Node>( aRoot );
-            stack( ).push( aRoot );
+            stack( ).push( Entry( aRoot, 0 ) );
+            BLIB_NTREE_STAT( IteratorAllocations, 1 );
+            BLIB_NTREE_STAT( IteratorBytes, sizeof( Stack ) );
+            BLIB_NTREE_STAT( Traversals, 1 );
+            BLIB_NTREE_STAT( NodesVisited, 1 );
           }
 
           pre_order_iterator( pre_order_iterator const& aOther ) {
             _stack = aOther._stack;
             _cur = aOther._cur;
+            _limits = aOther._limits;
+            _skip = aOther._skip;
+            BLIB_NTREE_STAT( RefcountOps, 2 );
+          }
+
+          // Do not descend into the current node, the next increment moves
+          // on to its next sibling or further up.
+          void skip_children( ) {
+            _skip = true;
+          }
+
+          // Depth of the current node, the root of the walk is at 0
+          std::size_t depth( ) const {
+            return _stack->top( ).second;
           }
 
         private:
@@ -262,31 +845,33 @@ namespace blib {
           //      else
           //      node = parentStack.pop( )
           void increment( ) {
-            if ( stack( ).empty( ) ) {
-              _cur.reset( );
+            if ( !_cur ) {
               return;
             }
 
             // _cur already points to the top, so just pop it
+            const std::size_t depth = stack( ).top( ).second;
             stack( ).pop( );
             // Right child is pushed before left child to make sure that left subtree is processed first.
-            for ( auto it = cur( ).child_node_rtol_begin( );
-                  it != cur( ).child_node_rtol_end( );
-                  ++it ) {
-              stack( ).push( *it );
+            if ( !_skip && ( !_limits || _limits->descends( cur( ), depth ) ) ) {
+              auto& children = NodeUtility::children( cur( ) );
+              for ( std::size_t i = children.size( ); i-- > 0; ) {
+                stack( ).push( Entry( children[ i ], depth + 1 ) );
+              }
             }
+            _skip = false;
 
             // If the stack is not empty then only assign 
             if ( !stack( ).empty( ) ) {
               cur( top( ) );
             }
             else {
-              _cur.reset( );
+              _cur = nullptr;
             }
           }
 
           NodeRef top( ) {
-            return stack( ).top( );
+            return stack( ).top( ).first;
           }
 
           Stack& stack( ) {
@@ -297,8 +882,9 @@ namespace blib {
             return *_cur;
           }
 
-          void cur( ConstNodeRef aNode ) const {
-            *_cur = aNode;
+          void cur( NodeRef aNode ) {
+            _cur = &aNode;
+            BLIB_NTREE_STAT( NodesVisited, 1 );
           }
         };// PreOrder Tree Iterator End
 
@@ -316,7 +902,7 @@ namespace blib {
           typedef typename Node::ValueType ValueType;
           typedef typename Node::ValueRef ValueRef;
           typedef typename Node::ConstValueRef ConstValueRef;
-          typedef typename Node::NodeRef NodeRef;
+          typedef Node& NodeRef;
           typedef typename Node::ConstNodeRef ConstNodeRef;
           typedef typename Node::NodeHandle NodeHandle;
           typedef typename Node::NodeAllocator NodeAllocator;
@@ -331,15 +917,19 @@ namespace blib {
 
           std::shared_ptr<Stack> _stack1;
           std::shared_ptr<Stack> _stack2;
-          std::shared_ptr<Node> _cur;
+          Node* _cur;
 
         public:
-          post_order_2stack_iterator( ) {}
+          post_order_2stack_iterator( ) :
+            _cur( nullptr ) {}
 
-          post_order_2stack_iterator( NodeRef aRoot ) {
+          post_order_2stack_iterator( NodeRef aRoot ) :
+            _cur( nullptr ) {
             _stack1 = std::make_shared<Stack>( );
             _stack2 = std::make_shared<Stack>( );
-            _cur = std::make_shared<Node>( aRoot );
+            BLIB_NTREE_STAT( IteratorAllocations, 2 );
+            BLIB_NTREE_STAT( IteratorBytes, 2 * sizeof( Stack ) );
+            BLIB_NTREE_STAT( Traversals, 1 );
             stack1( ).push( aRoot );
             createSecondStack( );
           }
@@ -348,6 +938,7 @@ namespace blib {
             _stack1 = aOther._stack1;
             _stack2 = aOther._stack2;
             _cur = aOther._cur;
+            BLIB_NTREE_STAT( RefcountOps, 2 );
           }
 
         private:
@@ -366,7 +957,7 @@ namespace blib {
           // Browse the second stack
           void increment( ) {
             if ( stack2( ).empty( ) ) {
-              _cur.reset( );
+              _cur = nullptr;
             }
             else {
               cur( top( ) );
@@ -385,7 +976,7 @@ namespace blib {
             while ( !stack1( ).empty( ) ) {
               NodeRef node = stack1( ).top( );
               stack1( ).pop( );
-              for ( auto& n : node ) {
+              for ( auto& n : NodeUtility::children( node ) ) {
                 stack1( ).push( n );
               }
               stack2( ).push( node );
@@ -415,8 +1006,9 @@ namespace blib {
             return *_cur;
           }
 
-          void cur( NodeRef aNode ) const {
-            *_cur = aNode;
+          void cur( NodeRef aNode ) {
+            _cur = &aNode;
+            BLIB_NTREE_STAT( NodesVisited, 1 );
           }
         };
         // PostOrder Tree Iterator 2Stacks End
@@ -431,34 +1023,57 @@ namespace blib {
           typedef typename Node::ValueType ValueType;
           typedef typename Node::ValueRef ValueRef;
           typedef typename Node::ConstValueRef ConstValueRef;
-          typedef typename Node::NodeRef NodeRef;
+          typedef Node& NodeRef;
           typedef typename Node::ConstNodeRef ConstNodeRef;
           typedef typename Node::NodeHandle NodeHandle;
           typedef typename Node::NodeAllocator NodeAllocator;
           typedef typename Node::DataAllocator DataAllocator;
           typedef typename Node::child_node_ltor_iterator child_node_ltor_iterator;
           typedef std::reference_wrapper<Node> NodeRefWrapper;
-          typedef std::queue<NodeRefWrapper> Queue;
+          // A node and its depth
+          typedef std::pair<NodeRefWrapper, std::size_t> Entry;
+          typedef std::queue<Entry> Queue;
+          typedef TraversalLimits<Node> Limits;
           typedef level_order_iterator<Node> SelfType;
 
         private:
           friend class boost::iterator_core_access;
 
           std::shared_ptr<Queue> _queue;
-          std::shared_ptr<Node> _cur;
+          Node* _cur;
+          std::shared_ptr<Limits> _limits;
+          bool _skip;
 
         public:
-          level_order_iterator( ) {}
+          level_order_iterator( ) :
+            _cur( nullptr ), _skip( false ) {}
 
-          level_order_iterator( NodeRef aRoot ) {
+          level_order_iterator( NodeRef aRoot, std::shared_ptr<Limits> const& aLimits = std::shared_ptr<Limits>( ) ) :
+            _cur( &aRoot ), _limits( aLimits ), _skip( false ) {
             _queue = std::make_shared<Queue>( );
-            _cur = std::make_shared<Node>( aRoot );
-            queue( ).push( aRoot );
+            queue( ).push( Entry( aRoot, 0 ) );
+            BLIB_NTREE_STAT( IteratorAllocations, 1 );
+            BLIB_NTREE_STAT( IteratorBytes, sizeof( Queue ) );
+            BLIB_NTREE_STAT( Traversals, 1 );
+            BLIB_NTREE_STAT( NodesVisited, 1 );
           }
 
           level_order_iterator( level_order_iterator const& aOther ) {
             _queue = aOther._queue;
             _cur = aOther._cur;
+            _limits = aOther._limits;
+            _skip = aOther._skip;
+            BLIB_NTREE_STAT( RefcountOps, 2 );
+          }
+
+          // Do not enqueue the children of the current node
+          void skip_children( ) {
+            _skip = true;
+          }
+
+          // Depth of the current node, the root of the walk is at 0
+          std::size_t depth( ) const {
+            return _queue->front( ).second;
           }
 
         private:
@@ -486,20 +1101,24 @@ namespace blib {
             }
 
             if ( queue( ).empty( ) ) {
-              _cur.reset( );
+              _cur = nullptr;
             }
             else {
-              // Pop it, _cur already contains it
+              // Pop it, _cur already points to it
+              const std::size_t depth = queue( ).front( ).second;
               queue( ).pop( );
-              for ( auto& n : cur( ) ) {
-                queue( ).push( n );
+              if ( !_skip && ( !_limits || _limits->descends( cur( ), depth ) ) ) {
+                for ( auto& n : NodeUtility::children( cur( ) ) ) {
+                  queue( ).push( Entry( n, depth + 1 ) );
+                }
               }
+              _skip = false;
               // Push only if there is something in the queue
               if ( !queue( ).empty( ) ) {
-                cur( queue( ).front( ) );
+                cur( queue( ).front( ).first );
               }
               else {
-                _cur.reset( );
+                _cur = nullptr;
               }
             }
           }
@@ -512,21 +1131,232 @@ namespace blib {
             return *_cur;
           }
 
-          void cur( ConstNodeRef aNode ) const {
-            *_cur = aNode;
+          void cur( NodeRef aNode ) {
+            _cur = &aNode;
+            BLIB_NTREE_STAT( NodesVisited, 1 );
           }
         };// LevelOrder Tree Iterator End
-      } // _private
 
-      //=====================================================================
-      // Node Handle
-      template<class NodeType>
-      class NodeHandle :
-        public _private::NodeHandleImpl < NodeType > {
-      private:
-        typedef NodeHandleImpl<NodeType> BaseType;
+        //=====================================================================
+        // D-ary Heap
+        // Max heap with Arity children per slot. Shallower than a binary heap,
+        // so a pop walks fewer levels and compares siblings that share a cache
+        // line. clear( ) keeps the storage for the next use.
+        template<typename T, typename Less = std::less<T>, std::size_t Arity = 4>
+        class DaryHeap {
+        private:
+          std::vector<T> _items;
+          Less _less;
 
-      public:
+        public:
+          bool empty( ) const {
+            return _items.empty( );
+          }
+
+          std::size_t size( ) const {
+            return _items.size( );
+          }
+
+          void reserve( std::size_t aCapacity ) {
+            _items.reserve( aCapacity );
+          }
+
+          void clear( ) {
+            _items.clear( );
+          }
+
+          T const& top( ) const {
+            return _items.front( );
+          }
+
+          void push( T const& aItem ) {
+            _items.push_back( aItem );
+            siftUp( _items.size( ) - 1 );
+          }
+
+          void pop( ) {
+            if ( _items.size( ) > 1 ) {
+              _items.front( ) = std::move( _items.back( ) );
+            }
+            _items.pop_back( );
+            if ( !_items.empty( ) ) {
+              siftDown( 0 );
+            }
+          }
+
+        private:
+          void siftUp( std::size_t aPos ) {
+            T item = std::move( _items[ aPos ] );
+            while ( aPos > 0 ) {
+              const std::size_t parent = ( aPos - 1 ) / Arity;
+              if ( !_less( _items[ parent ], item ) ) {
+                break;
+              }
+              _items[ aPos ] = std::move( _items[ parent ] );
+              aPos = parent;
+            }
+            _items[ aPos ] = std::move( item );
+          }
+
+          void siftDown( std::size_t aPos ) {
+            const std::size_t size = _items.size( );
+            T item = std::move( _items[ aPos ] );
+            for ( ;; ) {
+              const std::size_t first = aPos * Arity + 1;
+              if ( first >= size ) {
+                break;
+              }
+              const std::size_t last = std::min( first + Arity, size );
+              std::size_t best = first;
+              for ( std::size_t c = first + 1; c < last; ++c ) {
+                if ( _less( _items[ best ], _items[ c ] ) ) {
+                  best = c;
+                }
+              }
+              if ( !_less( item, _items[ best ] ) ) {
+                break;
+              }
+              _items[ aPos ] = std::move( _items[ best ] );
+              aPos = best;
+            }
+            _items[ aPos ] = std::move( item );
+          }
+        };
+
+        //=====================================================================
+        // BestFirst Tree Iterator
+        // Visits the highest scoring node of the frontier next. A node's
+        // children are scored and pushed only when the iterator moves past
+        // it, and children scoring below the bound are pruned together with
+        // their subtrees. When no child scores above its parent the nodes
+        // come out in descending score order.
+        template<typename NodeType, typename ScoreType>
+        class best_first_iterator :
+          public boost::iterator_facade < best_first_iterator<NodeType, ScoreType>, NodeType, boost::forward_traversal_tag > {
+        private:
+          typedef NodeType Node;
+          typedef Node& NodeRef;
+          typedef typename Node::ConstNodeRef ConstNodeRef;
+          typedef best_first_iterator<Node, ScoreType> SelfType;
+
+          struct Entry {
+            ScoreType score;
+            Node* node;
+
+            bool operator<( Entry const& aOther ) const {
+              return score < aOther.score;
+            }
+          };
+
+        public:
+          typedef std::function<ScoreType( ConstNodeRef )> Scorer;
+          typedef DaryHeap<Entry> Frontier;
+
+        private:
+          friend class boost::iterator_core_access;
+
+          std::shared_ptr<Frontier> _frontier;
+          std::shared_ptr<Scorer> _score;
+          ScoreType _bound;
+          bool _bounded;
+          bool _skip;
+          Node* _cur;
+          ScoreType _curScore;
+
+        public:
+          best_first_iterator( ) :
+            _bound( ), _bounded( false ), _skip( false ), _cur( nullptr ), _curScore( ) {}
+
+          // aFrontier may be shared between walks to reuse its storage, it
+          // is cleared here. Without a bound every node is admitted.
+          best_first_iterator( NodeRef aRoot, Scorer const& aScore, std::shared_ptr<Frontier> const& aFrontier,
+                               ScoreType const* aBound = nullptr ) :
+            _frontier( aFrontier ), _bound( aBound ? *aBound : ScoreType( ) ), _bounded( aBound != nullptr ),
+            _skip( false ), _cur( nullptr ), _curScore( ) {
+            if ( !_frontier ) {
+              _frontier = std::make_shared<Frontier>( );
+              BLIB_NTREE_STAT( IteratorAllocations, 1 );
+              BLIB_NTREE_STAT( IteratorBytes, sizeof( Frontier ) );
+            }
+            _frontier->clear( );
+            _score = std::make_shared<Scorer>( aScore );
+            BLIB_NTREE_STAT( IteratorAllocations, 1 );
+            BLIB_NTREE_STAT( IteratorBytes, sizeof( Scorer ) );
+            BLIB_NTREE_STAT( Traversals, 1 );
+            const ScoreType score = ( *_score )( aRoot );
+            if ( admits( score ) ) {
+              cur( &aRoot, score );
+            }
+          }
+
+          // Do not expand the current node
+          void skip_children( ) {
+            _skip = true;
+          }
+
+          ScoreType const& score( ) const {
+            return _curScore;
+          }
+
+          // Nodes scored and waiting to be visited
+          std::size_t pending( ) const {
+            return _frontier ? _frontier->size( ) : 0;
+          }
+
+        private:
+          NodeRef dereference( ) const {
+            return *_cur;
+          }
+
+          bool equal( SelfType const& aOther ) const {
+            return _cur == aOther._cur;
+          }
+
+          void increment( ) {
+            if ( !_cur ) {
+              return;
+            }
+            if ( !_skip ) {
+              for ( auto& c : NodeUtility::children( *_cur ) ) {
+                const ScoreType score = ( *_score )( c );
+                if ( admits( score ) ) {
+                  Entry e = { score, &c };
+                  _frontier->push( e );
+                }
+              }
+            }
+            _skip = false;
+            if ( _frontier->empty( ) ) {
+              _cur = nullptr;
+            }
+            else {
+              const Entry e = _frontier->top( );
+              _frontier->pop( );
+              cur( e.node, e.score );
+            }
+          }
+
+          bool admits( ScoreType const& aScore ) const {
+            return !_bounded || !( aScore < _bound );
+          }
+
+          void cur( Node* aNode, ScoreType const& aScore ) {
+            _cur = aNode;
+            _curScore = aScore;
+            BLIB_NTREE_STAT( NodesVisited, 1 );
+          }
+        };// BestFirst Tree Iterator End
+      } // _private
+
+      //=====================================================================
+      // Node Handle
+      template<class NodeType>
+      class NodeHandle :
+        public _private::NodeHandleImpl < NodeType > {
+      private:
+        typedef NodeHandleImpl<NodeType> BaseType;
+
+      public:
         NodeHandle( Node const* const aPtr = nullptr ) :
           BaseType( aPtr ) {}
 
@@ -543,26 +1373,39 @@ namespace blib {
       template<
         typename NodeDataType,
         typename DataAlloc = std::allocator<NodeDataType>,
-        template<typename>class NodeAlloc = std::allocator>
-      class Node {
+        template<typename>class NodeAlloc = std::allocator,
+        typename AugmentPolicy = NoAugmentation>
+      class Node :
+        public _private::AugmentStorage < AugmentPolicy > {
       public:
         typedef NodeDataType ValueType;
-        typedef ValueType& ValueRef;
+        // Read only when the node is augmented: a write has to go through
+        // data( value ), which updates the summaries
+        typedef typename std::conditional<std::is_same<AugmentPolicy, NoAugmentation>::value,
+          ValueType&, ValueType const&>::type ValueRef;
         typedef ValueType const& ConstValueRef;
-        typedef Node<NodeDataType, DataAlloc, NodeAlloc> NodeType;
+        typedef Node<NodeDataType, DataAlloc, NodeAlloc, AugmentPolicy> NodeType;
         typedef NodeType SelfType;
         typedef NodeType& NodeRef;
         typedef NodeType const& ConstNodeRef;
-        typedef _private::child_node_ltor_iterator<Node<NodeDataType>> child_node_ltor_iterator;
-        typedef _private::child_node_rtol_iterator<Node<NodeDataType>> child_node_rtol_iterator;
+        typedef _private::child_node_ltor_iterator<SelfType> child_node_ltor_iterator;
+        typedef _private::child_node_rtol_iterator<SelfType> child_node_rtol_iterator;
+        typedef _private::child_node_ltor_iterator<SelfType const> const_child_node_ltor_iterator;
+        typedef _private::child_node_rtol_iterator<SelfType const> const_child_node_rtol_iterator;
         typedef NodeHandle<SelfType> NodeHandle;
         typedef NodeAlloc<SelfType> NodeAllocator;
         typedef DataAlloc DataAllocator;
+        typedef AugmentPolicy AugmentPolicyType;
 
       private:
         friend class child_node_ltor_iterator;
         friend class child_node_rtol_iterator;
+        friend class _private::child_node_ltor_iterator<SelfType const>;
+        friend class _private::child_node_rtol_iterator<SelfType const>;
+        friend class _private::NodeUtility;
         typedef std::vector<NodeType, NodeAllocator> ChildrenContainerType;
+        typedef _private::AugmentStorage<AugmentPolicy> AugmentBase;
+        typedef _private::Augmenter<AugmentPolicy> Augmenter;
 
       private:
         std::shared_ptr<ValueType> _data;
@@ -572,9 +1415,26 @@ namespace blib {
       private:
         void allocateChildren( ) {
           _children = std::make_shared<ChildrenContainerType>( );
+          BLIB_NTREE_STAT( ChildrenAllocations, 1 );
+          BLIB_NTREE_STAT( ChildrenBytes, sizeof( ChildrenContainerType ) );
+        }
+
+        void allocateData( ConstValueRef aData ) {
+          _data = std::allocate_shared<ValueType>( DataAllocator( ), aData );
+          BLIB_NTREE_STAT( PayloadAllocations, 1 );
+          BLIB_NTREE_STAT( PayloadBytes, sizeof( ValueType ) );
+        }
+
+        void grown( std::size_t aOldCapacity ) {
+          if ( aOldCapacity != children( ).capacity( ) ) {
+            BLIB_NTREE_STAT( ChildrenReallocations, 1 );
+            BLIB_NTREE_STAT( ChildrenReallocationBytes, children( ).capacity( ) * sizeof( NodeType ) );
+          }
         }
 
         NodeRef assign( ConstNodeRef aOther ) {
+          BLIB_NTREE_STAT( RefcountOps, std::is_empty<AugmentBase>::value ? 2 : 3 );
+          AugmentBase::operator=( aOther );
           _parent = aOther._parent;
           _data = aOther._data;
           _children = aOther._children;
@@ -584,10 +1444,35 @@ namespace blib {
         ChildrenContainerType& children( ) {
           return *_children;
         }
+
+        ChildrenContainerType const& children( ) const {
+          return *_children;
+        }
+
+        Node( std::shared_ptr<ValueType> const& aData, std::shared_ptr<ChildrenContainerType> const& aChildren,
+              NodeHandle const& aParent ) :
+          _data( aData ), _parent( aParent ), _children( aChildren ) {
+          Augmenter::init( *this );
+        }
+
+        // Point the children from aFirst onwards, and their own children, at
+        // their current addresses. Needed whenever the children vector
+        // reallocates or shifts, so that parent handles stay valid.
+        void adoptChildren( std::size_t aFirst ) {
+          ChildrenContainerType& c = children( );
+          for ( std::size_t i = aFirst; i < c.size( ); ++i ) {
+            c[ i ].parent( handle( ) );
+            for ( auto& g : c[ i ].children( ) ) {
+              g.parent( c[ i ].handle( ) );
+            }
+          }
+        }
+
       public:
         Node( NodeHandle const& aParent = NodeHandle( ) ) :
           _parent( aParent ) {
           allocateChildren( );
+          Augmenter::init( *this );
         }
 
         Node( ConstNodeRef aOther ) {
@@ -597,14 +1482,15 @@ namespace blib {
         Node( ConstValueRef aData, NodeHandle const& aParent ) :
           _parent( aParent ) {
           allocateChildren( );
-          _data = std::allocate_shared<ValueType>( DataAllocator( ), aData );
+          allocateData( aData );
+          Augmenter::init( *this );
         }
 
         ~Node( ) {
           //clear( );
         }
 
-        NodeHandle& parent( ) const {
+        NodeHandle const& parent( ) const {
           return _parent;
         }
 
@@ -625,12 +1511,35 @@ namespace blib {
           return *_data;;
         }
 
+        // Copy on write: the node gets a payload of its own and copies taken
+        // before keep the old value. An augmented node writes through the
+        // shared payload instead, so that its copies, which share its
+        // summary, agree with that summary.
         void data( ConstValueRef aData ) {
-          _data = std::allocate_shared<ValueType>( DataAllocator( ), aData );
+          const typename Augmenter::Snapshot before = Augmenter::leafSnapshot( *this );
+          if ( _data && !std::is_empty<AugmentBase>::value ) {
+            *_data = aData;
+          }
+          else {
+            allocateData( aData );
+          }
+          Augmenter::dataWritten( *this, before );
+        }
+
+        // Drops the payload, the node then has no data. Copies of the node
+        // keep theirs.
+        void clearData( ) {
+          const typename Augmenter::Snapshot before = Augmenter::leafSnapshot( *this );
+          _data.reset( );
+          Augmenter::dataWritten( *this, before );
         }
 
         // Access the children by index.
-        ValueRef operator[]( const std::size_t aIndex ) {
+        NodeRef operator[]( const std::size_t aIndex ) {
+          return children( ).at( aIndex );
+        }
+
+        ConstNodeRef operator[]( const std::size_t aIndex ) const {
           return children( ).at( aIndex );
         }
 
@@ -652,20 +1561,46 @@ namespace blib {
           return ret;
         }
 
+        // A copy of aNode, which in an augmented tree no longer shares its
+        // payload with aNode, see Augmenter::detach.
         void addChild( ConstNodeRef aNode ) {
+          const std::size_t capacity = children( ).capacity( );
           children( ).push_back( aNode );
-          children( ).back( ).parent( handle( ) );
+          grown( capacity );
+          adoptChildren( capacity == children( ).capacity( ) ? children( ).size( ) - 1 : 0 );
+          Augmenter::detach( children( ).back( ) );
+          Augmenter::childAdded( *this, children( ).size( ) - 1 );
         }
 
         void addChild( ConstValueRef aValue ) {
           const NodeType n( aValue, handle( ) );
+          const std::size_t capacity = children( ).capacity( );
           children( ).push_back( n );
+          grown( capacity );
+          if ( capacity != children( ).capacity( ) ) {
+            adoptChildren( 0 );
+          }
+          Augmenter::childAdded( *this, children( ).size( ) - 1 );
+        }
+
+        // Insert a copy of aNode before aPos, end( ) appends.
+        void insertChild( child_node_ltor_iterator const& aPos, ConstNodeRef aNode ) {
+          const std::size_t capacity = children( ).capacity( );
+          auto pos = children( ).insert( _private::IteratorUtility::itr( aPos ), aNode );
+          grown( capacity );
+          adoptChildren( capacity == children( ).capacity( ) ? static_cast< std::size_t >( pos - children( ).begin( ) ) : 0 );
+          Augmenter::detach( *pos );
+          Augmenter::childAdded( *this, static_cast< std::size_t >( pos - children( ).begin( ) ) );
         }
 
         // The iterator pos must be valid and dereferenceable. 
         // Thus the end() iterator (which is valid, but is not dereferencable) cannot be used as a value for pos.
         void removeChild( child_node_ltor_iterator const& aItr ) {
-          children( ).erase( _private::IteratorUtility::itr( aItr ) );
+          const typename Augmenter::Snapshot removed = Augmenter::summarySnapshot( *_private::IteratorUtility::itr( aItr ) );
+          auto pos = children( ).erase( _private::IteratorUtility::itr( aItr ) );
+          const std::size_t index = static_cast< std::size_t >( pos - children( ).begin( ) );
+          adoptChildren( index );
+          Augmenter::childRemoved( *this, index, removed );
         }
 
         std::size_t size( ) const {
@@ -689,6 +1624,7 @@ namespace blib {
         void clear( ) {
           children( ).clear( );
           _parent = nullptr;
+          Augmenter::recompute( *this );
         }
 
         bool operator==( ConstNodeRef aOther ) const {
@@ -743,9 +1679,677 @@ namespace blib {
           child_node_rtol_iterator it( children( ).rend( ), children( ).rend( ) );
           return it;
         }
+
+        // The children of a const node, by reference like the others
+        const_child_node_ltor_iterator begin( ) const {
+          return cbegin( );
+        }
+
+        const_child_node_ltor_iterator end( ) const {
+          return cend( );
+        }
+
+        const_child_node_ltor_iterator cbegin( ) const {
+          const_child_node_ltor_iterator it( children( ).cbegin( ), children( ).cend( ) );
+          return it;
+        }
+
+        const_child_node_ltor_iterator cend( ) const {
+          const_child_node_ltor_iterator it( children( ).cend( ), children( ).cend( ) );
+          return it;
+        }
+
+        const_child_node_ltor_iterator child_node_ltor_begin( ) const {
+          return cbegin( );
+        }
+
+        const_child_node_ltor_iterator child_node_ltor_end( ) const {
+          return cend( );
+        }
+
+        const_child_node_rtol_iterator child_node_rtol_begin( ) const {
+          const_child_node_rtol_iterator it( children( ).crbegin( ), children( ).crend( ) );
+          return it;
+        }
+
+        const_child_node_rtol_iterator child_node_rtol_end( ) const {
+          const_child_node_rtol_iterator it( children( ).crend( ), children( ).crend( ) );
+          return it;
+        }
       };
       // Tree Node End
 
+      // Order in which NTree::compact lays out the nodes.
+      enum class LayoutOrder {
+        PreOrder,
+        LevelOrder,
+        // Cache oblivious: the top half of the levels first, then every
+        // bottom subtree, each laid out the same way recursively
+        VanEmdeBoas
+      };
+
+      namespace _private {
+        //=====================================================================
+        // Monotonic Arena
+        // Bump allocation out of fixed size blocks, deallocation is a no op
+        // and the blocks go away with the last allocator referring to them.
+        // Every control block made by allocate_shared keeps a copy of the
+        // allocator, so the arena lives exactly as long as what it holds.
+        class MonotonicArena {
+        private:
+          static const std::size_t BlockSize = 64 * 1024;
+
+          std::vector<std::unique_ptr<char[]>> _blocks;
+          void* _cur;
+          std::size_t _left;
+
+        public:
+          MonotonicArena( ) :
+            _cur( nullptr ), _left( 0 ) {}
+
+          void* allocate( std::size_t aBytes, std::size_t aAlign ) {
+            if ( !std::align( aAlign, aBytes, _cur, _left ) ) {
+              const std::size_t block = BlockSize;
+              const std::size_t size = std::max( block, aBytes + aAlign );
+              _blocks.push_back( std::unique_ptr<char[]>( new char[ size ] ) );
+              _cur = _blocks.back( ).get( );
+              _left = size;
+              std::align( aAlign, aBytes, _cur, _left );
+            }
+            void* ret = _cur;
+            _cur = static_cast< char* >( _cur ) + aBytes;
+            _left -= aBytes;
+            return ret;
+          }
+        };
+
+        template<typename T>
+        class ArenaAllocator {
+        public:
+          typedef T value_type;
+
+          // Public for the converting constructor of the other rebinds
+          std::shared_ptr<MonotonicArena> _arena;
+
+          explicit ArenaAllocator( std::shared_ptr<MonotonicArena> const& aArena ) :
+            _arena( aArena ) {}
+
+          template<typename U>
+          ArenaAllocator( ArenaAllocator<U> const& aOther ) :
+            _arena( aOther._arena ) {}
+
+          T* allocate( std::size_t aCount ) {
+            return static_cast< T* >( _arena->allocate( aCount * sizeof( T ), alignof( T ) ) );
+          }
+
+          void deallocate( T*, std::size_t ) {}
+
+          template<typename U>
+          bool operator==( ArenaAllocator<U> const& aOther ) const {
+            return _arena == aOther._arena;
+          }
+
+          template<typename U>
+          bool operator!=( ArenaAllocator<U> const& aOther ) const {
+            return _arena != aOther._arena;
+          }
+        };
+
+        //=====================================================================
+        // Compactor
+        // Rebuilds a tree with its storage allocated in layout order. The
+        // children vector and payload of each node, control blocks included,
+        // come one after the other out of a monotonic arena. The vectors'
+        // element buffers, where the child nodes themselves live, cannot:
+        // they come from the NodeAlloc the node type was declared with. They
+        // are reserved to their exact size in layout order, which keeps them
+        // in that order as far as that allocator does. Summaries keep their
+        // allocation.
+        template<typename NodeType>
+        class Compactor {
+        public:
+          typedef typename NodeType::ValueType ValueType;
+          typedef NodeUtility::ChildrenType<NodeType> ChildrenContainerType;
+          typedef std::size_t Id;
+
+        private:
+          // Level order numbering of the source, children ids are contiguous
+          std::vector<NodeType*> _nodes;
+          std::vector<Id> _firstChild;
+          std::vector<std::size_t> _height;
+          std::vector<Id> _order;
+
+        public:
+          static void compact( NodeType& aRoot, LayoutOrder aOrder ) {
+            Compactor c;
+            c.number( aRoot );
+            c.layout( aOrder );
+            c.rebuild( aRoot );
+          }
+
+        private:
+          std::size_t childCount( Id aId ) const {
+            return NodeUtility::children( *_nodes[ aId ] ).size( );
+          }
+
+          void number( NodeType& aRoot ) {
+            _nodes.push_back( &aRoot );
+            for ( Id i = 0; i < _nodes.size( ); ++i ) {
+              _firstChild.push_back( _nodes.size( ) );
+              for ( auto& c : NodeUtility::children( *_nodes[ i ] ) ) {
+                _nodes.push_back( &c );
+              }
+            }
+          }
+
+          void layout( LayoutOrder aOrder ) {
+            const std::size_t n = _nodes.size( );
+            _order.reserve( n );
+            if ( aOrder == LayoutOrder::LevelOrder ) {
+              for ( Id i = 0; i < n; ++i ) {
+                _order.push_back( i );
+              }
+            }
+            else if ( aOrder == LayoutOrder::PreOrder ) {
+              std::vector<Id> stack( 1, 0 );
+              while ( !stack.empty( ) ) {
+                const Id id = stack.back( );
+                stack.pop_back( );
+                _order.push_back( id );
+                for ( std::size_t c = childCount( id ); c-- > 0; ) {
+                  stack.push_back( _firstChild[ id ] + c );
+                }
+              }
+            }
+            else {
+              // Levels below each node, children always have larger ids
+              _height.assign( n, 1 );
+              for ( Id i = n; i-- > 0; ) {
+                for ( std::size_t c = 0; c < childCount( i ); ++c ) {
+                  const std::size_t h = _height[ _firstChild[ i ] + c ] + 1;
+                  if ( h > _height[ i ] ) {
+                    _height[ i ] = h;
+                  }
+                }
+              }
+              vanEmdeBoas( 0, _height[ 0 ] );
+            }
+          }
+
+          // Lays out the part of the subtree at aRoot that is less than
+          // aLevels deep.
+          void vanEmdeBoas( Id aRoot, std::size_t aLevels ) {
+            if ( aLevels <= 1 ) {
+              _order.push_back( aRoot );
+              return;
+            }
+            const std::size_t top = aLevels / 2;
+            vanEmdeBoas( aRoot, top );
+
+            std::vector<Id> bottoms;
+            std::vector<std::pair<Id, std::size_t>> stack( 1, std::make_pair( aRoot, std::size_t( 0 ) ) );
+            while ( !stack.empty( ) ) {
+              const std::pair<Id, std::size_t> e = stack.back( );
+              stack.pop_back( );
+              if ( e.second == top ) {
+                bottoms.push_back( e.first );
+                continue;
+              }
+              for ( std::size_t c = childCount( e.first ); c-- > 0; ) {
+                stack.push_back( std::make_pair( _firstChild[ e.first ] + c, e.second + 1 ) );
+              }
+            }
+            for ( Id b : bottoms ) {
+              vanEmdeBoas( b, std::min( aLevels - top, _height[ b ] ) );
+            }
+          }
+
+          void rebuild( NodeType& aRoot ) {
+            const std::size_t n = _nodes.size( );
+            std::vector<Id> rank( n );
+            for ( std::size_t pos = 0; pos < n; ++pos ) {
+              rank[ _order[ pos ] ] = pos;
+            }
+
+            const ArenaAllocator<char> alloc( std::make_shared<MonotonicArena>( ) );
+            std::vector<std::shared_ptr<ChildrenContainerType>> children( n );
+            std::vector<std::shared_ptr<ValueType>> values( n );
+            for ( std::size_t pos = 0; pos < n; ++pos ) {
+              NodeType const& source = *_nodes[ _order[ pos ] ];
+              children[ pos ] = std::allocate_shared<ChildrenContainerType>( alloc );
+              children[ pos ]->reserve( childCount( _order[ pos ] ) );
+              if ( source ) {
+                values[ pos ] = std::allocate_shared<ValueType>( alloc, source.data( ) );
+              }
+            }
+
+            // New nodes start as shallow copies of the old ones, which keeps
+            // the summaries, and are then pointed at the new storage.
+            std::vector<NodeType*> placed( n, nullptr );
+            placed[ 0 ] = &aRoot;
+            for ( std::size_t pos = 0; pos < n; ++pos ) {
+              const Id id = _order[ pos ];
+              for ( std::size_t c = 0; c < childCount( id ); ++c ) {
+                const Id child = _firstChild[ id ] + c;
+                children[ pos ]->push_back( *_nodes[ child ] );
+                NodeType& node = children[ pos ]->back( );
+                NodeUtility::dataPtr( node ) = values[ rank[ child ] ];
+                NodeUtility::childrenPtr( node ) = children[ rank[ child ] ];
+                placed[ child ] = &node;
+              }
+            }
+
+            // The root goes last, its old children are released here
+            NodeUtility::dataPtr( aRoot ) = values[ rank[ 0 ] ];
+            NodeUtility::childrenPtr( aRoot ) = children[ rank[ 0 ] ];
+            for ( std::size_t pos = 0; pos < n; ++pos ) {
+              NodeType const* owner = placed[ _order[ pos ] ];
+              for ( auto& c : *children[ pos ] ) {
+                c.parent( owner->handle( ) );
+              }
+            }
+          }
+        };
+
+        //=====================================================================
+        // Cloner
+        // Deep copies a tree into nodes of TargetType, payloads going through
+        // aConvert. The top levels are copied first, until there are about
+        // four subtrees per thread below them; each group of subtrees is then
+        // copied by its own task into its own monotonic arena. Children
+        // vectors are reserved to their exact size before they are filled, so
+        // placed nodes never move and parent handles are set once.
+        // The arena holds the payloads and the children vectors with their
+        // control blocks, not the vectors' element buffers: those come from
+        // the NodeAlloc the node type was declared with.
+        template<typename SourceType, typename TargetType, typename Convert>
+        class Cloner {
+        public:
+          typedef typename TargetType::ValueType TargetValue;
+          typedef NodeUtility::ChildrenType<TargetType> TargetChildren;
+          typedef Augmenter<typename TargetType::AugmentPolicyType> TargetAugmenter;
+          typedef ArenaAllocator<char> Allocator;
+          typedef std::pair<SourceType const*, TargetType*> Pair;
+
+          // Copies into aTarget in place, the root of the tree that receives
+          // the copy, so that its children name it as their parent
+          static void clone( SourceType const& aRoot, TargetType& aTarget, Convert& aConvert, std::size_t aThreads ) {
+            const Allocator top( std::make_shared<MonotonicArena>( ) );
+            aTarget = make( aRoot, top, aConvert, typename TargetType::NodeHandle( ) );
+            TargetType& root = aTarget;
+            if ( aThreads <= 1 ) {
+              copySubtree( Pair( &aRoot, &root ), top, aConvert );
+              return;
+            }
+
+            std::vector<Pair> frontier( 1, Pair( &aRoot, &root ) );
+            std::vector<TargetType*> expanded;
+            bool copied = false;
+            while ( !copied && frontier.size( ) < 4 * aThreads ) {
+              std::vector<Pair> next;
+              for ( auto const& p : frontier ) {
+                expand( p, top, aConvert, next );
+                expanded.push_back( p.second );
+              }
+              // Nothing left below the top levels
+              copied = next.empty( );
+              frontier.swap( next );
+            }
+
+            if ( !copied ) {
+              std::vector<std::vector<Pair>> groups( aThreads );
+              for ( std::size_t i = 0; i < frontier.size( ); ++i ) {
+                groups[ i % aThreads ].push_back( frontier[ i ] );
+              }
+              std::vector<std::future<void>> tasks;
+              for ( auto const& g : groups ) {
+                std::vector<Pair> const* group = &g;
+                tasks.push_back( std::async( std::launch::async, [ group, &aConvert ]( ) {
+                  const Allocator arena( std::make_shared<MonotonicArena>( ) );
+                  for ( auto const& p : *group ) {
+                    copySubtree( p, arena, aConvert );
+                  }
+                } ) );
+              }
+              // Let every task finish before an exception unwinds the groups
+              for ( auto& t : tasks ) {
+                t.wait( );
+              }
+              for ( auto& t : tasks ) {
+                t.get( );
+              }
+            }
+            // Parents after their children
+            for ( std::size_t i = expanded.size( ); i-- > 0; ) {
+              TargetAugmenter::recompute( *expanded[ i ] );
+            }
+          }
+
+        private:
+          static TargetType make( SourceType const& aSource, Allocator const& aAlloc, Convert& aConvert,
+                                  typename TargetType::NodeHandle const& aParent ) {
+            std::shared_ptr<TargetValue> data;
+            if ( aSource ) {
+              data = std::allocate_shared<TargetValue>( aAlloc, aConvert( aSource.data( ) ) );
+            }
+            std::shared_ptr<TargetChildren> children = std::allocate_shared<TargetChildren>( aAlloc );
+            children->reserve( NodeUtility::children( aSource ).size( ) );
+            return NodeUtility::adopt<TargetType>( data, children, aParent );
+          }
+
+          // Copies the children of aPair.first under aPair.second and
+          // appends the new pairs to aOut
+          static void expand( Pair const& aPair, Allocator const& aAlloc, Convert& aConvert, std::vector<Pair>& aOut ) {
+            auto const& source = NodeUtility::children( *aPair.first );
+            auto& target = NodeUtility::children( *aPair.second );
+            for ( auto const& c : source ) {
+              target.push_back( make( c, aAlloc, aConvert, aPair.second->handle( ) ) );
+            }
+            for ( std::size_t i = 0; i < source.size( ); ++i ) {
+              aOut.push_back( Pair( &source[ i ], &target[ i ] ) );
+            }
+          }
+
+          static void copySubtree( Pair const& aPair, Allocator const& aAlloc, Convert& aConvert ) {
+            std::vector<Pair> stack( 1, aPair );
+            std::vector<TargetType*> placed;
+            while ( !stack.empty( ) ) {
+              const Pair p = stack.back( );
+              stack.pop_back( );
+              placed.push_back( p.second );
+              expand( p, aAlloc, aConvert, stack );
+            }
+            for ( std::size_t i = placed.size( ); i-- > 0; ) {
+              TargetAugmenter::recompute( *placed[ i ] );
+            }
+          }
+        };
+      } // _private
+
+
+      template<typename NodeType>
+      class NTree;
+
+      //=====================================================================
+      // Subtree View
+      // Non owning view of the subtree below a node of an existing tree.
+      // Nothing is copied and no reference count is touched to make one, so
+      // it is the way to hand a subtree to a function. The node is the root
+      // of the view whatever its place in its tree; it must outlive the view
+      // and stay where it is, which rules out adding or removing siblings of
+      // it or of its ancestors meanwhile. A view of a const Node is read
+      // only, and so are its iterators.
+      template<typename NodeType>
+      class SubtreeView {
+      public:
+        typedef NodeType Node;
+        typedef typename Node::ValueType ValueType;
+        typedef Node& NodeRef;
+        typedef Node const& ConstNodeRef;
+        typedef _private::pre_order_iterator<Node> pre_order_iterator;
+        typedef _private::post_order_2stack_iterator<Node> post_order_iterator;
+        typedef _private::level_order_iterator<Node> level_order_iterator;
+        template<typename ScoreType>
+        using best_first_iterator = _private::best_first_iterator<Node, ScoreType>;
+        template<typename ScoreType>
+        using BestFirstFrontier = typename best_first_iterator<ScoreType>::Frontier;
+        // Result of a scoring functor applied to a node
+        template<typename Scorer>
+        using ScoreOf = typename std::decay<decltype( std::declval<Scorer&>( )( std::declval<ConstNodeRef>( ) ) )>::type;
+        typedef SubtreeView<Node> SelfType;
+        // Decides whether a traversal descends into a node's children
+        typedef typename _private::TraversalLimits<Node>::Predicate DescendPredicate;
+
+      private:
+        Node* _root;
+
+      public:
+        explicit SubtreeView( NodeRef aRoot ) :
+          _root( &aRoot ) {}
+
+        NodeRef root( ) const {
+          return *_root;
+        }
+
+        // Copies of a node share its children, so they are all the root
+        bool isRoot( ConstNodeRef aNode ) const {
+          return key( aNode ) == key( *_root );
+        }
+
+        // O(depth of aNode), up through the parent handles
+        bool contains( ConstNodeRef aNode ) const {
+          return distance( aNode ) != npos( );
+        }
+
+        // Depth of aNode below the root of the view, which is at 0
+        std::size_t depth( ConstNodeRef aNode ) const {
+          const std::size_t ret = distance( aNode );
+          if ( ret == npos( ) ) {
+            throw std::invalid_argument( "SubtreeView: node outside the view" );
+          }
+          return ret;
+        }
+
+        // View of a node below the root
+        SelfType subtree( NodeRef aNode ) const {
+          return SelfType( aNode );
+        }
+
+        std::size_t size( ) const {
+          std::size_t ret = 0;
+          visit( [ &ret ]( NodeRef ) { ++ret; } );
+          return ret;
+        }
+
+        // Depth of the deepest node, 0 for a lone root like depth( )
+        std::size_t height( ) const {
+          std::size_t ret = 0;
+          std::vector<std::pair<Node*, std::size_t>> stack( 1, std::make_pair( _root, std::size_t( 0 ) ) );
+          while ( !stack.empty( ) ) {
+            Node* n = stack.back( ).first;
+            const std::size_t level = stack.back( ).second;
+            stack.pop_back( );
+            ret = std::max( ret, level );
+            for ( auto& c : _private::NodeUtility::children( *n ) ) {
+              stack.push_back( std::make_pair( &c, level + 1 ) );
+            }
+          }
+          return ret;
+        }
+
+        std::size_t leaves( ) const {
+          return count_if( []( ConstNodeRef aNode ) { return aNode.isLeaf( ); } );
+        }
+
+        // aVisitor( node ) on every node in pre order, through the nodes
+        // themselves rather than copies
+        template<typename Visitor>
+        void visit( Visitor aVisitor ) const {
+          std::vector<Node*> stack( 1, _root );
+          while ( !stack.empty( ) ) {
+            Node* n = stack.back( );
+            stack.pop_back( );
+            aVisitor( *n );
+            auto& children = _private::NodeUtility::children( *n );
+            for ( std::size_t i = children.size( ); i-- > 0; ) {
+              stack.push_back( &children[ i ] );
+            }
+          }
+        }
+
+        // First node in pre order aPredicate accepts, nullptr if none
+        template<typename Predicate>
+        Node* find_if( Predicate aPredicate ) const {
+          std::vector<Node*> stack( 1, _root );
+          while ( !stack.empty( ) ) {
+            Node* n = stack.back( );
+            stack.pop_back( );
+            if ( aPredicate( static_cast< ConstNodeRef >( *n ) ) ) {
+              return n;
+            }
+            auto& children = _private::NodeUtility::children( *n );
+            for ( std::size_t i = children.size( ); i-- > 0; ) {
+              stack.push_back( &children[ i ] );
+            }
+          }
+          return nullptr;
+        }
+
+        template<typename Predicate>
+        std::size_t count_if( Predicate aPredicate ) const {
+          std::size_t ret = 0;
+          visit( [ &ret, &aPredicate ]( NodeRef aNode ) {
+            if ( aPredicate( static_cast< ConstNodeRef >( aNode ) ) ) {
+              ++ret;
+            }
+          } );
+          return ret;
+        }
+
+        // Independent copy of the subtree as a tree of its own
+        NTree<typename std::remove_const<Node>::type> deep_clone( std::size_t aThreads = 1 ) const {
+          typedef typename std::remove_const<Node>::type Target;
+          auto copy = []( typename Node::ConstValueRef aValue ) -> typename Node::ConstValueRef {
+            return aValue;
+          };
+          NTree<Target> ret;
+          _private::Cloner<Target, Target, decltype( copy )>::clone( *_root, ret.root( ), copy, aThreads );
+          return ret;
+        }
+
+        pre_order_iterator pre_order_begin( ) const {
+          pre_order_iterator ret( *_root );
+          return ret;
+        }
+
+        // Stops below aMaxDepth ( the root is at 0 ) and below every node
+        // aDescend returns false for; those nodes are still visited.
+        pre_order_iterator pre_order_begin( std::size_t aMaxDepth, DescendPredicate aDescend = DescendPredicate( ) ) const {
+          pre_order_iterator ret( *_root, limits( aMaxDepth, aDescend ) );
+          return ret;
+        }
+
+        pre_order_iterator pre_order_end( ) const {
+          pre_order_iterator ret;
+          return ret;
+        }
+
+        post_order_iterator post_order_begin( ) const {
+          post_order_iterator ret( *_root );
+          return ret;
+        }
+
+        post_order_iterator post_order_end( ) const {
+          post_order_iterator ret;
+          return ret;
+        }
+
+        level_order_iterator level_order_begin( ) const {
+          level_order_iterator ret( *_root );
+          return ret;
+        }
+
+        level_order_iterator level_order_begin( std::size_t aMaxDepth, DescendPredicate aDescend = DescendPredicate( ) ) const {
+          level_order_iterator ret( *_root, limits( aMaxDepth, aDescend ) );
+          return ret;
+        }
+
+        level_order_iterator level_order_end( ) const {
+          level_order_iterator ret;
+          return ret;
+        }
+
+        // Range based for loops go in pre order
+        pre_order_iterator begin( ) const {
+          return pre_order_begin( );
+        }
+
+        pre_order_iterator end( ) const {
+          return pre_order_end( );
+        }
+
+        // Highest aScore( node ) first, see best_first_iterator.
+        template<typename Scorer>
+        best_first_iterator<ScoreOf<Scorer>> best_first_begin( Scorer aScore ) const {
+          best_first_iterator<ScoreOf<Scorer>> ret( *_root, aScore, nullptr );
+          return ret;
+        }
+
+        // Nodes scoring below aBound are not visited, nor is anything under
+        // them. Pass the same aFrontier to successive searches to reuse its
+        // storage.
+        template<typename Scorer>
+        best_first_iterator<ScoreOf<Scorer>> best_first_begin( Scorer aScore, ScoreOf<Scorer> const& aBound,
+                                                               std::shared_ptr<BestFirstFrontier<ScoreOf<Scorer>>> const& aFrontier = nullptr ) const {
+          best_first_iterator<ScoreOf<Scorer>> ret( *_root, aScore, aFrontier, &aBound );
+          return ret;
+        }
+
+        template<typename ScoreType>
+        best_first_iterator<ScoreType> best_first_end( ) const {
+          best_first_iterator<ScoreType> ret;
+          return ret;
+        }
+
+        // The aCount best scoring nodes, best first. Exact when no child
+        // scores above its parent: the search then stops at the aCount-th
+        // node and never scores anything below it.
+        template<typename Scorer>
+        std::vector<std::reference_wrapper<Node>> topK( std::size_t aCount, Scorer aScore ) const {
+          return topK( best_first_begin( aScore ), aCount );
+        }
+
+        template<typename Scorer>
+        std::vector<std::reference_wrapper<Node>> topK( std::size_t aCount, Scorer aScore, ScoreOf<Scorer> const& aBound,
+                                                        std::shared_ptr<BestFirstFrontier<ScoreOf<Scorer>>> const& aFrontier = nullptr ) const {
+          return topK( best_first_begin( aScore, aBound, aFrontier ), aCount );
+        }
+
+      private:
+        static void const* key( ConstNodeRef aNode ) {
+          return &_private::NodeUtility::children( aNode );
+        }
+
+        static std::size_t npos( ) {
+          return static_cast< std::size_t >( -1 );
+        }
+
+        // Steps from aNode up to the root, npos( ) if it is not above
+        std::size_t distance( ConstNodeRef aNode ) const {
+          std::size_t ret = 0;
+          for ( Node const* n = &aNode; n; n = _private::NodeUtility::parentOf( *n ) ) {
+            if ( isRoot( *n ) ) {
+              return ret;
+            }
+            ++ret;
+          }
+          return npos( );
+        }
+
+        template<typename ScoreType>
+        static std::vector<std::reference_wrapper<Node>> topK( best_first_iterator<ScoreType> aIt, std::size_t aCount ) {
+          std::vector<std::reference_wrapper<Node>> ret;
+          ret.reserve( aCount );
+          const best_first_iterator<ScoreType> end;
+          for ( ; aCount > 0 && aIt != end; ++aIt ) {
+            ret.push_back( *aIt );
+            // Stop before the increment expands the last result
+            if ( ret.size( ) == aCount ) {
+              break;
+            }
+          }
+          return ret;
+        }
+
+        static std::shared_ptr<_private::TraversalLimits<Node>> limits( std::size_t aMaxDepth, DescendPredicate const& aDescend ) {
+          std::shared_ptr<_private::TraversalLimits<Node>> ret = std::make_shared<_private::TraversalLimits<Node>>( );
+          ret->maxDepth = aMaxDepth;
+          ret->descend = aDescend;
+          BLIB_NTREE_STAT( IteratorAllocations, 1 );
+          BLIB_NTREE_STAT( IteratorBytes, sizeof( _private::TraversalLimits<Node> ) );
+          return ret;
+        }
+      };
 
       //=====================================================================
       // NTree Definition
@@ -767,12 +2371,36 @@ namespace blib {
         typedef _private::pre_order_iterator<Node> pre_order_iterator;
         typedef _private::post_order_2stack_iterator<Node> post_order_iterator;
         typedef _private::level_order_iterator<Node> level_order_iterator;
+        typedef _private::pre_order_iterator<Node const> const_pre_order_iterator;
+        typedef _private::post_order_2stack_iterator<Node const> const_post_order_iterator;
+        typedef _private::level_order_iterator<Node const> const_level_order_iterator;
+        template<typename ScoreType>
+        using best_first_iterator = _private::best_first_iterator<Node, ScoreType>;
+        template<typename ScoreType>
+        using BestFirstFrontier = typename best_first_iterator<ScoreType>::Frontier;
+        // Result of a scoring functor applied to a node
+        template<typename Scorer>
+        using ScoreOf = typename std::decay<decltype( std::declval<Scorer&>( )( std::declval<ConstNodeRef>( ) ) )>::type;
         typedef NTree<Node> SelfType;
         typedef std::shared_ptr<Node> NodeSharedPtr;
+        // Decides whether a traversal descends into a node's children
+        typedef typename _private::TraversalLimits<Node>::Predicate DescendPredicate;
+
+        static const std::size_t UnboundedDepth = static_cast< std::size_t >( -1 );
 
       private:
         Node _root;
 
+        // Points the root's children that name aOld as their parent at the
+        // root, leaves the others alone
+        void adopt( ConstNodeRef aOld ) {
+          for ( auto& c : _root ) {
+            if ( c.parent( ) == aOld.handle( ) ) {
+              c.parent( _root.handle( ) );
+            }
+          }
+        }
+
       public:
         NTree( ) {}
 
@@ -780,6 +2408,20 @@ namespace blib {
           root( aNode );
         }
 
+        // Shallow like the nodes and like assignment: every node is shared
+        // with aOther, whose root stays the parent of its children
+        NTree( SelfType const& aOther ) :
+          _root( aOther._root ) {}
+
+        // The children that named aOther's root as their parent name this
+        // one instead, which keeps a tree returned by value navigable.
+        // aOther is left with an empty root of its own and shares nothing.
+        NTree( SelfType&& aOther ) noexcept :
+          _root( aOther._root ) {
+          adopt( aOther._root );
+          aOther._root = Node( );
+        }
+
         ~NTree( ) {
           //clear( );
         }
@@ -788,8 +2430,13 @@ namespace blib {
           _root.data( aVal );
         }
 
+        // Shares aNode's children, which go on naming aNode as their parent.
+        // Summaries are updated up through aNode, which shares its summary
+        // with the root, so in an augmented tree aNode must outlive the tree
+        // or the tree is built in place under root( ).
         void root( ConstNodeRef aNode ) {
           _root = aNode;
+          _root.parent( NodeHandle( ) );
         }
 
         NodeRef root( ) {
@@ -828,23 +2475,89 @@ namespace blib {
           return *this;
         }
 
+        SelfType& operator=( SelfType&& aOther ) noexcept {
+          if ( this != &aOther ) {
+            _root = aOther._root;
+            adopt( aOther._root );
+            aOther._root = Node( );
+          }
+          return *this;
+        }
+
         bool operator==( SelfType const& aOther ) const {
           return aOther._root == _root;
         }
 
-        pre_order_iterator pre_order_begin( ) {
-          pre_order_iterator ret( _root );
+        // Reallocates the payloads and the children vectors in aOrder, to
+        // restore locality after a lot of insertions and removals. They come
+        // one after the other out of a monotonic arena; the child nodes
+        // themselves go to fresh NodeAlloc buffers, also allocated in aOrder,
+        // see Compactor. The tree is unchanged as seen through its interface
+        // and parent handles are fixed up; node copies taken before the call
+        // keep the old storage. Storage of nodes removed later stays
+        // allocated until the whole tree is released or compacted again.
+        void compact( LayoutOrder aOrder = LayoutOrder::PreOrder ) {
+          _private::Compactor<Node>::compact( _root, aOrder );
+        }
+
+        // Independent copy, nothing is shared with this tree. Summaries are
+        // recomputed. With aThreads > 1 the subtrees below the top levels
+        // are copied in parallel, each thread into its own arena.
+        SelfType deep_clone( std::size_t aThreads = 1 ) const {
+          auto copy = []( ConstValueRef aValue ) -> ConstValueRef {
+            return aValue;
+          };
+          SelfType ret;
+          _private::Cloner<Node, Node, decltype( copy )>::clone( _root, ret._root, copy, aThreads );
+          return ret;
+        }
+
+        // Tree of the same shape whose payloads are aConvert( value ), nodes
+        // without data stay without. aConvert is called from several
+        // threads at once when aThreads > 1.
+        template<typename B, typename Convert>
+        NTree<tree::Node<B>> map( Convert aConvert, std::size_t aThreads = 1 ) const {
+          typedef tree::Node<B> Target;
+          NTree<Target> ret;
+          _private::Cloner<Node, Target, Convert>::clone( _root, ret.root( ), aConvert, aThreads );
           return ret;
         }
 
+        // Process wide instrumentation counters, see NTreeStats.hpp.
+        // All zero unless built with BLIB_NTREE_STATS.
+        static NTreeStats stats( ) {
+          return _private::StatsRegistry::snapshot( );
+        }
+
+        static void resetStats( ) {
+          _private::StatsRegistry::reset( );
+        }
+
+        // The whole tree as a subtree
+        SubtreeView<Node> view( ) {
+          return SubtreeView<Node>( _root );
+        }
+
+        SubtreeView<Node const> view( ) const {
+          return SubtreeView<Node const>( _root );
+        }
+
+        // Traversals of the whole tree, see SubtreeView
+        pre_order_iterator pre_order_begin( ) {
+          return view( ).pre_order_begin( );
+        }
+
+        pre_order_iterator pre_order_begin( std::size_t aMaxDepth, DescendPredicate aDescend = DescendPredicate( ) ) {
+          return view( ).pre_order_begin( aMaxDepth, aDescend );
+        }
+
         pre_order_iterator pre_order_end( ) {
           pre_order_iterator ret;
           return ret;
         }
 
         post_order_iterator post_order_begin( ) {
-          post_order_iterator ret( _root );
-          return ret;
+          return view( ).post_order_begin( );
         }
 
         post_order_iterator post_order_end( ) {
@@ -853,15 +2566,84 @@ namespace blib {
         }
 
         level_order_iterator level_order_begin( ) {
-          level_order_iterator ret( _root );
-          return ret;
+          return view( ).level_order_begin( );
+        }
+
+        level_order_iterator level_order_begin( std::size_t aMaxDepth, DescendPredicate aDescend = DescendPredicate( ) ) {
+          return view( ).level_order_begin( aMaxDepth, aDescend );
         }
 
         level_order_iterator level_order_end( ) {
           level_order_iterator ret;
           return ret;
         }
+
+        const_pre_order_iterator pre_order_begin( ) const {
+          return view( ).pre_order_begin( );
+        }
+
+        const_pre_order_iterator pre_order_begin( std::size_t aMaxDepth, DescendPredicate aDescend = DescendPredicate( ) ) const {
+          return view( ).pre_order_begin( aMaxDepth, aDescend );
+        }
+
+        const_pre_order_iterator pre_order_end( ) const {
+          const_pre_order_iterator ret;
+          return ret;
+        }
+
+        const_post_order_iterator post_order_begin( ) const {
+          return view( ).post_order_begin( );
+        }
+
+        const_post_order_iterator post_order_end( ) const {
+          const_post_order_iterator ret;
+          return ret;
+        }
+
+        const_level_order_iterator level_order_begin( ) const {
+          return view( ).level_order_begin( );
+        }
+
+        const_level_order_iterator level_order_begin( std::size_t aMaxDepth, DescendPredicate aDescend = DescendPredicate( ) ) const {
+          return view( ).level_order_begin( aMaxDepth, aDescend );
+        }
+
+        const_level_order_iterator level_order_end( ) const {
+          const_level_order_iterator ret;
+          return ret;
+        }
+
+        template<typename Scorer>
+        best_first_iterator<ScoreOf<Scorer>> best_first_begin( Scorer aScore ) {
+          return view( ).best_first_begin( aScore );
+        }
+
+        template<typename Scorer>
+        best_first_iterator<ScoreOf<Scorer>> best_first_begin( Scorer aScore, ScoreOf<Scorer> const& aBound,
+                                                               std::shared_ptr<BestFirstFrontier<ScoreOf<Scorer>>> const& aFrontier = nullptr ) {
+          return view( ).best_first_begin( aScore, aBound, aFrontier );
+        }
+
+        template<typename ScoreType>
+        best_first_iterator<ScoreType> best_first_end( ) {
+          best_first_iterator<ScoreType> ret;
+          return ret;
+        }
+
+        template<typename Scorer>
+        std::vector<std::reference_wrapper<Node>> topK( std::size_t aCount, Scorer aScore ) {
+          return view( ).topK( aCount, aScore );
+        }
+
+        template<typename Scorer>
+        std::vector<std::reference_wrapper<Node>> topK( std::size_t aCount, Scorer aScore, ScoreOf<Scorer> const& aBound,
+                                                        std::shared_ptr<BestFirstFrontier<ScoreOf<Scorer>>> const& aFrontier = nullptr ) {
+          return view( ).topK( aCount, aScore, aBound, aFrontier );
+        }
       };
+
+      template<typename Node>
+      const std::size_t NTree<Node>::UnboundedDepth;
       //=====================================================================
       // NTree End
     }
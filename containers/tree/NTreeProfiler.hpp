@@ -0,0 +1,240 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <cstdint>
+#include <future>
+#include <map>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "NTree.hpp"
+#include "FrozenNTree.hpp"
+
+// Memory footprint and shape profile of an NTree, gathered in one linear
+// pass. The byte figures are what the nodes ask for; allocator headers and
+// rounding come on top and are not visible from here.
+namespace blib {
+  namespace container {
+    namespace tree {
+      struct TreeProfile {
+        std::uint64_t nodeCount;
+        std::uint64_t leafCount;
+        std::uint64_t nodesWithData;
+        // Deepest level, the root is level 0
+        std::uint64_t height;
+        // Number of children -> number of nodes
+        std::map<std::size_t, std::uint64_t> fanoutHistogram;
+        std::vector<std::uint64_t> levelWidths;
+
+        // sizeof( Node ) * children, used and reserved in the child vectors
+        std::uint64_t childBytesUsed;
+        std::uint64_t childBytesReserved;
+        // Children vector headers, one per node
+        std::uint64_t childHeaderBytes;
+        std::uint64_t payloadBytes;
+        // shared_ptr control blocks of payloads, child vectors and summaries
+        std::uint64_t controlBlockBytes;
+        std::uint64_t controlBlocks;
+
+        // Per node sizes, filled in by profile( )
+        std::uint64_t valueSize;
+        std::uint64_t nodeSize;
+
+        TreeProfile( ) :
+          nodeCount( 0 ), leafCount( 0 ), nodesWithData( 0 ), height( 0 ),
+          childBytesUsed( 0 ), childBytesReserved( 0 ), childHeaderBytes( 0 ),
+          payloadBytes( 0 ), controlBlockBytes( 0 ), controlBlocks( 0 ),
+          valueSize( 0 ), nodeSize( 0 ) {}
+
+        std::uint64_t totalBytes( ) const {
+          // The root Node lives in the NTree, every other one in a child vector
+          return nodeSize + childBytesReserved + childHeaderBytes + payloadBytes + controlBlockBytes;
+        }
+
+        double bytesPerNode( ) const {
+          return nodeCount ? static_cast< double >( totalBytes( ) ) / static_cast< double >( nodeCount ) : 0.0;
+        }
+
+        // Slack in the child vectors, what a shrink or compaction returns
+        std::uint64_t reservedSlack( ) const {
+          return childBytesReserved - childBytesUsed;
+        }
+
+        double averageFanout( ) const {
+          const std::uint64_t internal = nodeCount - leafCount;
+          return internal ? static_cast< double >( nodeCount - 1 ) / static_cast< double >( internal ) : 0.0;
+        }
+
+        // Size of the FrozenNTree image for the same tree
+        std::uint64_t frozenBytes( ) const {
+          return sizeof( FrozenHeader ) + nodeCount * ( 4 * sizeof( FrozenLayout::IndexType ) + valueSize );
+        }
+
+        // Approximate size of the SuccinctNTree for the same tree: 2n bits
+        // plus the rank, select and rmM directories
+        std::uint64_t succinctBytes( ) const {
+          return ( 2 * nodeCount * 5 / 4 + 7 ) / 8 + nodeCount * valueSize;
+        }
+
+        void merge( TreeProfile const& aOther ) {
+          nodeCount += aOther.nodeCount;
+          leafCount += aOther.leafCount;
+          nodesWithData += aOther.nodesWithData;
+          if ( aOther.height > height ) {
+            height = aOther.height;
+          }
+          for ( auto const& f : aOther.fanoutHistogram ) {
+            fanoutHistogram[ f.first ] += f.second;
+          }
+          if ( aOther.levelWidths.size( ) > levelWidths.size( ) ) {
+            levelWidths.resize( aOther.levelWidths.size( ), 0 );
+          }
+          for ( std::size_t i = 0; i < aOther.levelWidths.size( ); ++i ) {
+            levelWidths[ i ] += aOther.levelWidths[ i ];
+          }
+          childBytesUsed += aOther.childBytesUsed;
+          childBytesReserved += aOther.childBytesReserved;
+          childHeaderBytes += aOther.childHeaderBytes;
+          payloadBytes += aOther.payloadBytes;
+          controlBlockBytes += aOther.controlBlockBytes;
+          controlBlocks += aOther.controlBlocks;
+        }
+
+        void print( std::ostream& aOut ) const {
+          aOut << "nodes           " << nodeCount << "\n"
+            << "leaves          " << leafCount << "\n"
+            << "height          " << height << "\n"
+            << "average fanout  " << averageFanout( ) << "\n"
+            << "bytes           " << totalBytes( ) << " (" << bytesPerNode( ) << " per node)\n"
+            << "  payload       " << payloadBytes << "\n"
+            << "  child vectors " << childBytesUsed << " used, " << childBytesReserved << " reserved\n"
+            << "  headers       " << childHeaderBytes << "\n"
+            << "  control       " << controlBlockBytes << " in " << controlBlocks << " blocks\n"
+            << "frozen image    " << frozenBytes( ) << "\n"
+            << "succinct        " << succinctBytes( ) << "\n"
+            << "fanout histogram\n";
+          for ( auto const& f : fanoutHistogram ) {
+            aOut << "  " << f.first << "\t" << f.second << "\n";
+          }
+          aOut << "level widths\n";
+          for ( std::size_t i = 0; i < levelWidths.size( ); ++i ) {
+            aOut << "  " << i << "\t" << levelWidths[ i ] << "\n";
+          }
+        }
+      };
+
+      namespace _private {
+        template<typename NodeType>
+        class TreeProfiler {
+        public:
+          typedef typename NodeType::ValueType ValueType;
+          typedef std::pair<NodeType const*, std::size_t> Entry;
+
+          // libstdc++ and MSVC both keep a vtable pointer and two counters
+          static const std::uint64_t ControlBlockSize = sizeof( void* ) + 2 * sizeof( int );
+          static const bool Augmented = !std::is_empty<AugmentStorage<typename NodeType::AugmentPolicyType>>::value;
+
+          static void visit( NodeType const& aNode, std::size_t aDepth, TreeProfile& aProfile ) {
+            auto const& children = NodeUtility::children( aNode );
+            ++aProfile.nodeCount;
+            if ( aDepth >= aProfile.levelWidths.size( ) ) {
+              aProfile.levelWidths.resize( aDepth + 1, 0 );
+            }
+            ++aProfile.levelWidths[ aDepth ];
+            if ( aDepth > aProfile.height ) {
+              aProfile.height = aDepth;
+            }
+            ++aProfile.fanoutHistogram[ children.size( ) ];
+            if ( children.empty( ) ) {
+              ++aProfile.leafCount;
+            }
+            aProfile.childBytesUsed += children.size( ) * sizeof( NodeType );
+            aProfile.childBytesReserved += children.capacity( ) * sizeof( NodeType );
+            aProfile.childHeaderBytes += sizeof( children );
+            std::uint64_t blocks = 1;
+            if ( aNode ) {
+              ++aProfile.nodesWithData;
+              aProfile.payloadBytes += sizeof( ValueType );
+              ++blocks;
+            }
+            if ( Augmented ) {
+              ++blocks;
+            }
+            aProfile.controlBlocks += blocks;
+            aProfile.controlBlockBytes += blocks * ControlBlockSize;
+          }
+
+          // Depth first over the subtrees in aRoots
+          static TreeProfile walk( std::vector<Entry> aRoots ) {
+            TreeProfile ret;
+            std::vector<Entry>& stack = aRoots;
+            while ( !stack.empty( ) ) {
+              const Entry e = stack.back( );
+              stack.pop_back( );
+              visit( *e.first, e.second, ret );
+              for ( auto const& c : NodeUtility::children( *e.first ) ) {
+                stack.push_back( Entry( &c, e.second + 1 ) );
+              }
+            }
+            return ret;
+          }
+        };
+      } // _private
+
+      // Profile of the subtree at aRoot. With aThreads > 1 the top levels are
+      // expanded until there are enough subtrees, which are then profiled
+      // in parallel and merged.
+      template<typename NodeType>
+      TreeProfile profile( NodeType const& aRoot, unsigned aThreads = 1 ) {
+        typedef _private::TreeProfiler<NodeType> Profiler;
+        typedef typename Profiler::Entry Entry;
+
+        TreeProfile ret;
+        std::vector<Entry> frontier( 1, Entry( &aRoot, 0 ) );
+        if ( aThreads > 1 ) {
+          while ( !frontier.empty( ) && frontier.size( ) < 4 * aThreads ) {
+            std::vector<Entry> next;
+            for ( auto const& e : frontier ) {
+              Profiler::visit( *e.first, e.second, ret );
+              for ( auto const& c : _private::NodeUtility::children( *e.first ) ) {
+                next.push_back( Entry( &c, e.second + 1 ) );
+              }
+            }
+            frontier.swap( next );
+          }
+        }
+
+        if ( aThreads > 1 && !frontier.empty( ) ) {
+          std::vector<std::vector<Entry>> groups( aThreads );
+          for ( std::size_t i = 0; i < frontier.size( ); ++i ) {
+            groups[ i % aThreads ].push_back( frontier[ i ] );
+          }
+          std::vector<std::future<TreeProfile>> parts;
+          for ( auto& g : groups ) {
+            parts.push_back( std::async( std::launch::async, &Profiler::walk, std::move( g ) ) );
+          }
+          for ( auto& p : parts ) {
+            ret.merge( p.get( ) );
+          }
+        }
+        else {
+          ret.merge( Profiler::walk( frontier ) );
+        }
+
+        ret.valueSize = sizeof( typename NodeType::ValueType );
+        ret.nodeSize = sizeof( NodeType );
+        return ret;
+      }
+
+      template<typename NodeType>
+      TreeProfile profile( NTree<NodeType> const& aTree, unsigned aThreads = 1 ) {
+        return profile( aTree.root( ), aThreads );
+      }
+    }
+  }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <atomic>
+#include <cstdint>
+
+// NTree instrumentation.
+// Define BLIB_NTREE_STATS before including NTree.hpp to count the hidden
+// allocations and the traversal work. Without it BLIB_NTREE_STAT expands
+// to nothing and NTree::stats( ) returns an all zero snapshot.
+// The counters are process wide and relaxed atomics, so they are safe to
+// bump from several threads but only meant for profiling builds.
+#if defined( BLIB_NTREE_STATS )
+#define BLIB_NTREE_STAT( aCounter, aAmount ) \
+  ::blib::container::tree::_private::StatsRegistry::add( \
+    ::blib::container::tree::StatCounter::aCounter, static_cast< std::uint64_t >( aAmount ) )
+#else
+#define BLIB_NTREE_STAT( aCounter, aAmount ) ( (void)0 )
+#endif
+
+namespace blib {
+  namespace container {
+    namespace tree {
+      enum class StatCounter {
+        PayloadAllocations,
+        PayloadBytes,
+        ChildrenAllocations,
+        ChildrenBytes,
+        ChildrenReallocations,
+        ChildrenReallocationBytes,
+        IteratorAllocations,
+        IteratorBytes,
+        Traversals,
+        NodesVisited,
+        RefcountOps,
+        Count
+      };
+
+      struct NTreeStats {
+        bool enabled;
+        // Node payloads, allocate_shared in Node
+        std::uint64_t payloadAllocations;
+        std::uint64_t payloadBytes;
+        // Children vector headers, one per node
+        std::uint64_t childrenAllocations;
+        std::uint64_t childrenBytes;
+        // Children vector growth, bytes of the new buffers
+        std::uint64_t childrenReallocations;
+        std::uint64_t childrenReallocationBytes;
+        // Stack and queue state of the tree iterators
+        std::uint64_t iteratorAllocations;
+        std::uint64_t iteratorBytes;
+        // Traversals started and nodes they visited
+        std::uint64_t traversals;
+        std::uint64_t nodesVisited;
+        // shared_ptr copies made by Node and iterator copies
+        std::uint64_t refcountOps;
+
+        double nodesPerTraversal( ) const {
+          return traversals ? static_cast< double >( nodesVisited ) / static_cast< double >( traversals ) : 0.0;
+        }
+      };
+
+      namespace _private {
+        class StatsRegistry {
+        private:
+          static std::atomic<std::uint64_t>* counters( ) {
+            static std::atomic<std::uint64_t> c[ static_cast< int >( StatCounter::Count ) ];
+            return c;
+          }
+
+          static std::uint64_t get( StatCounter aCounter ) {
+            return counters( )[ static_cast< int >( aCounter ) ].load( std::memory_order_relaxed );
+          }
+
+        public:
+          static void add( StatCounter aCounter, std::uint64_t aAmount ) {
+            counters( )[ static_cast< int >( aCounter ) ].fetch_add( aAmount, std::memory_order_relaxed );
+          }
+
+          static void reset( ) {
+            for ( int i = 0; i < static_cast< int >( StatCounter::Count ); ++i ) {
+              counters( )[ i ].store( 0, std::memory_order_relaxed );
+            }
+          }
+
+          static NTreeStats snapshot( ) {
+            NTreeStats ret = NTreeStats( );
+#if defined( BLIB_NTREE_STATS )
+            ret.enabled = true;
+            ret.payloadAllocations = get( StatCounter::PayloadAllocations );
+            ret.payloadBytes = get( StatCounter::PayloadBytes );
+            ret.childrenAllocations = get( StatCounter::ChildrenAllocations );
+            ret.childrenBytes = get( StatCounter::ChildrenBytes );
+            ret.childrenReallocations = get( StatCounter::ChildrenReallocations );
+            ret.childrenReallocationBytes = get( StatCounter::ChildrenReallocationBytes );
+            ret.iteratorAllocations = get( StatCounter::IteratorAllocations );
+            ret.iteratorBytes = get( StatCounter::IteratorBytes );
+            ret.traversals = get( StatCounter::Traversals );
+            ret.nodesVisited = get( StatCounter::NodesVisited );
+            ret.refcountOps = get( StatCounter::RefcountOps );
+#endif
+            return ret;
+          }
+        };
+      } // _private
+    }
+  }
+}
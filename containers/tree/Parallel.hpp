@@ -0,0 +1,156 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace blib {
+  namespace container {
+    namespace tree {
+      //=====================================================================
+      // Thread Team
+      // A fixed set of threads that run one job at a time, fork join style:
+      // run( job ) calls job( 0 .. size( ) - 1 ), one call per thread with
+      // the calling thread taking index 0, and returns once every call has
+      // returned. Between two runs the workers sleep, so a level by level
+      // algorithm pays one wake up per level instead of a thread start.
+      // The first exception thrown by a call is rethrown by run( ).
+      class ThreadTeam {
+      public:
+        typedef std::function<void( std::size_t )> Job;
+
+      private:
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::condition_variable _done;
+        Job const* _job;
+        std::size_t _generation;
+        std::size_t _pending;
+        std::exception_ptr _error;
+        bool _stop;
+
+      public:
+        // 0 asks for one thread per hardware thread
+        explicit ThreadTeam( std::size_t aThreads = 0 ) :
+          _job( nullptr ), _generation( 0 ), _pending( 0 ), _stop( false ) {
+          if ( aThreads == 0 ) {
+            aThreads = hardwareThreads( );
+          }
+          _threads.reserve( aThreads - 1 );
+          for ( std::size_t i = 1; i < aThreads; ++i ) {
+            _threads.push_back( std::thread( &ThreadTeam::work, this, i ) );
+          }
+        }
+
+        ~ThreadTeam( ) {
+          {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _stop = true;
+          }
+          _wake.notify_all( );
+          for ( auto& t : _threads ) {
+            t.join( );
+          }
+        }
+
+        static std::size_t hardwareThreads( ) {
+          const std::size_t ret = std::thread::hardware_concurrency( );
+          return ret ? ret : 1;
+        }
+
+        std::size_t size( ) const {
+          return _threads.size( ) + 1;
+        }
+
+        void run( Job const& aJob ) {
+          if ( _threads.empty( ) ) {
+            aJob( 0 );
+            return;
+          }
+          {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _job = &aJob;
+            _pending = _threads.size( );
+            _error = nullptr;
+            ++_generation;
+          }
+          _wake.notify_all( );
+          std::exception_ptr error;
+          try {
+            aJob( 0 );
+          }
+          catch ( ... ) {
+            error = std::current_exception( );
+          }
+          std::unique_lock<std::mutex> lock( _mutex );
+          _done.wait( lock, [ this ] { return _pending == 0; } );
+          _job = nullptr;
+          if ( !error ) {
+            error = _error;
+          }
+          if ( error ) {
+            std::rethrow_exception( error );
+          }
+        }
+
+        // Splits [ 0, aCount ) into size( ) contiguous slices and calls
+        // aBody( thread, first, last ) on each non empty one
+        template<typename Body>
+        void forEachSlice( std::size_t aCount, Body aBody ) {
+          const std::size_t threads = size( );
+          run( [ aCount, threads, &aBody ]( std::size_t aThread ) {
+            const std::size_t first = aCount * aThread / threads;
+            const std::size_t last = aCount * ( aThread + 1 ) / threads;
+            if ( first < last ) {
+              aBody( aThread, first, last );
+            }
+          } );
+        }
+
+      private:
+        ThreadTeam( ThreadTeam const& );
+        ThreadTeam& operator=( ThreadTeam const& );
+
+        void work( std::size_t aIndex ) {
+          std::size_t seen = 0;
+          for ( ;; ) {
+            Job const* job;
+            {
+              std::unique_lock<std::mutex> lock( _mutex );
+              _wake.wait( lock, [ this, seen ] { return _stop || _generation != seen; } );
+              if ( _stop ) {
+                return;
+              }
+              seen = _generation;
+              job = _job;
+            }
+            std::exception_ptr error;
+            try {
+              ( *job )( aIndex );
+            }
+            catch ( ... ) {
+              error = std::current_exception( );
+            }
+            std::lock_guard<std::mutex> lock( _mutex );
+            if ( error && !_error ) {
+              _error = error;
+            }
+            if ( --_pending == 0 ) {
+              _done.notify_one( );
+            }
+          }
+        }
+      };
+    }
+  }
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include "NTree.hpp"
+#include "Parallel.hpp"
+
+// Level synchronous breadth first search over a ThreadTeam.
+//
+// Each level is a contiguous run of the order( ) array. Its nodes are split
+// between the threads, and every thread collects the children it finds in
+// a buffer of its own. A prefix sum over the buffer sizes then gives each
+// thread the place where it copies its children to form the next level.
+// There are no locks or atomics on the node path.
+//
+// Deterministic runs give each thread a fixed, contiguous slice of the
+// level, so every level comes out in the serial level order. Otherwise
+// threads take chunks of the level from a shared counter, which balances
+// uneven fanout better; the levels are then the right sets of nodes but in
+// varying order. Levels smaller than two grains are expanded serially.
+//
+// The visitor is called as aVisitor( node, depth ) from many threads at
+// once and must not change the shape of the tree.
+namespace blib {
+  namespace container {
+    namespace tree {
+      //=====================================================================
+      // Parallel Bfs
+      template<typename NodeType>
+      class ParallelBfs {
+      public:
+        typedef NodeType Node;
+        typedef ParallelBfs<Node> SelfType;
+
+        static const std::size_t DefaultGrain = 1024;
+
+      private:
+        ThreadTeam _team;
+        std::size_t _grain;
+        // Per thread children buffers, kept between levels and runs
+        std::vector<std::vector<Node*>> _local;
+        std::vector<Node*> _order;
+        std::vector<std::size_t> _levels;
+
+      public:
+        // 0 threads means one per hardware thread
+        explicit ParallelBfs( std::size_t aThreads = 0, std::size_t aGrain = DefaultGrain ) :
+          _team( aThreads ), _grain( std::max<std::size_t>( aGrain, 1 ) ), _local( _team.size( ) ) {}
+
+        std::size_t threads( ) const {
+          return _team.size( );
+        }
+
+        template<typename Visitor>
+        std::size_t run( Node& aRoot, Visitor aVisitor, bool aDeterministic = false ) {
+          _order.assign( 1, &aRoot );
+          _levels.assign( 1, 0 );
+          // A visitor that threw may have left children behind
+          for ( auto& buffer : _local ) {
+            buffer.clear( );
+          }
+          std::size_t depth = 0;
+          while ( _levels.back( ) < _order.size( ) ) {
+            const std::size_t first = _levels.back( );
+            const std::size_t last = _order.size( );
+            _levels.push_back( last );
+            if ( threads( ) == 1 || last - first < 2 * _grain ) {
+              expandSerial( first, last, depth, aVisitor );
+            }
+            else {
+              expandParallel( first, last, depth, aVisitor, aDeterministic );
+            }
+            ++depth;
+          }
+          return _order.size( );
+        }
+
+        template<typename Visitor>
+        std::size_t run( NTree<Node>& aTree, Visitor aVisitor, bool aDeterministic = false ) {
+          return run( aTree.root( ), aVisitor, aDeterministic );
+        }
+
+        // Every node of the last run, level after level
+        std::vector<Node*> const& order( ) const {
+          return _order;
+        }
+
+        // Level d of the last run is order( )[ levelBounds( )[ d ],
+        // levelBounds( )[ d + 1 ] )
+        std::vector<std::size_t> const& levelBounds( ) const {
+          return _levels;
+        }
+
+        // Depth of the deepest level of the last run, 0 for a lone root
+        std::size_t height( ) const {
+          return _levels.size( ) < 2 ? 0 : _levels.size( ) - 2;
+        }
+
+      private:
+        template<typename Visitor>
+        void expandSerial( std::size_t aFirst, std::size_t aLast, std::size_t aDepth, Visitor& aVisitor ) {
+          for ( std::size_t i = aFirst; i < aLast; ++i ) {
+            Node* n = _order[ i ];
+            aVisitor( *n, aDepth );
+            for ( auto& c : _private::NodeUtility::children( *n ) ) {
+              _order.push_back( &c );
+            }
+          }
+        }
+
+        template<typename Visitor>
+        void expandParallel( std::size_t aFirst, std::size_t aLast, std::size_t aDepth, Visitor& aVisitor, bool aDeterministic ) {
+          Node* const* level = _order.data( );
+          auto expand = [ this, level, aDepth, &aVisitor ]( std::size_t aThread, std::size_t aBegin, std::size_t aEnd ) {
+            std::vector<Node*>& out = _local[ aThread ];
+            for ( std::size_t i = aBegin; i < aEnd; ++i ) {
+              Node* n = level[ i ];
+              aVisitor( *n, aDepth );
+              for ( auto& c : _private::NodeUtility::children( *n ) ) {
+                out.push_back( &c );
+              }
+            }
+          };
+
+          if ( aDeterministic ) {
+            _team.forEachSlice( aLast - aFirst, [ aFirst, &expand ]( std::size_t aThread, std::size_t aBegin, std::size_t aEnd ) {
+              expand( aThread, aFirst + aBegin, aFirst + aEnd );
+            } );
+          }
+          else {
+            std::atomic<std::size_t> next( aFirst );
+            const std::size_t grain = _grain;
+            _team.run( [ &next, aLast, grain, &expand ]( std::size_t aThread ) {
+              for ( ;; ) {
+                const std::size_t begin = next.fetch_add( grain, std::memory_order_relaxed );
+                if ( begin >= aLast ) {
+                  break;
+                }
+                expand( aThread, begin, std::min( begin + grain, aLast ) );
+              }
+            } );
+          }
+
+          // Exclusive prefix sum of the buffer sizes gives every thread its
+          // place in the next level
+          std::vector<std::size_t> offset( _local.size( ) + 1, aLast );
+          for ( std::size_t t = 0; t < _local.size( ); ++t ) {
+            offset[ t + 1 ] = offset[ t ] + _local[ t ].size( );
+          }
+          _order.resize( offset.back( ) );
+          Node** next = _order.data( );
+          _team.run( [ this, next, &offset ]( std::size_t aThread ) {
+            std::vector<Node*>& buffer = _local[ aThread ];
+            std::copy( buffer.begin( ), buffer.end( ), next + offset[ aThread ] );
+            buffer.clear( );
+          } );
+        }
+      };
+
+      template<typename NodeType>
+      const std::size_t ParallelBfs<NodeType>::DefaultGrain;
+
+      // One shot parallel level order visit, returns the number of nodes
+      template<typename NodeType, typename Visitor>
+      std::size_t parallelLevelOrder( NTree<NodeType>& aTree, Visitor aVisitor,
+                                      std::size_t aThreads = 0, bool aDeterministic = false ) {
+        ParallelBfs<NodeType> bfs( aThreads );
+        return bfs.run( aTree, aVisitor, aDeterministic );
+      }
+    }
+  }
+}
@@ -0,0 +1,793 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "NTree.hpp"
+
+// Path queries: a small XPath like language over the values of a tree.
+//
+//   /a          the root, if its value is a
+//   /a/b        children of the root with value b
+//   /a//b       descendants of the root with value b
+//   //*         every node
+//   //*[>3]     every node with a value above 3; predicates are =, !=, <,
+//               <=, > and >= against a value
+//   /a/*[2]     the second child of the root; positions count from 1
+//               among the children of one parent that passed the test and
+//               the predicates before the position
+//
+// A step is / or // followed by a value or *, then any number of predicates
+// in brackets. Values are read with operator>>, or taken as they are for
+// std::string; quote them ("a/b") to use / [ or ] in them. Queries can also
+// be put together with child( ), descendant( ), where( ) and at( ), which
+// needs no operator>>. Nodes without data match only *, and no predicate.
+//
+// A QueryIndex is a preorder snapshot of a tree: the values in a contiguous
+// array, the subtree of every node as an interval of it, the nodes sorted by
+// value and, for nodes with many children, their children sorted by value.
+// select( ) evaluates a query one step at a time over sorted sets of nodes
+// and picks a plan per step:
+//
+//   KeyedChild     / with a value: binary search of the sorted children,
+//                  or a look at each child of narrow nodes
+//   ChildScan      / with *: every child
+//   IntervalIndex  // with a value: the nodes with that value, cut to the
+//                  subtree intervals of the context nodes
+//   PrunedDfs      // with *, and a rare value later in the query: a walk of
+//                  the subtrees that skips those without that value
+//   SubtreeScan    // with *: a scan of the subtree intervals
+//
+// selectAll( ) evaluates many queries together in one preorder pass. Each
+// node carries, per query, the steps it is a context for, and subtrees that
+// no query can match in are skipped.
+//
+// ValueType needs operator== and an operator< that agrees with it. The
+// index does not follow changes to the tree, rebuild it after them.
+namespace blib {
+  namespace container {
+    namespace tree {
+      enum class QueryAxis {
+        Child,
+        Descendant
+      };
+
+      enum class QueryOp {
+        Equal,
+        NotEqual,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        // Rank among the siblings that got this far
+        Position
+      };
+
+      enum class QueryPlan {
+        ChildScan,
+        KeyedChild,
+        IntervalIndex,
+        SubtreeScan,
+        PrunedDfs
+      };
+
+      template<typename ValueType>
+      struct QueryPredicate {
+        QueryOp op;
+        ValueType value;
+        std::size_t position;
+
+        bool test( ValueType const& aValue ) const {
+          bool ret = false;
+          switch ( op ) {
+          case QueryOp::Equal:
+            ret = aValue == value;
+            break;
+          case QueryOp::NotEqual:
+            ret = !( aValue == value );
+            break;
+          case QueryOp::Less:
+            ret = aValue < value;
+            break;
+          case QueryOp::LessEqual:
+            ret = !( value < aValue );
+            break;
+          case QueryOp::Greater:
+            ret = value < aValue;
+            break;
+          case QueryOp::GreaterEqual:
+            ret = !( aValue < value );
+            break;
+          case QueryOp::Position:
+            break;
+          }
+          return ret;
+        }
+      };
+
+      template<typename ValueType>
+      struct QueryStep {
+        QueryAxis axis;
+        // The value the node must have, none for *
+        bool keyed;
+        ValueType key;
+        std::vector<QueryPredicate<ValueType>> predicates;
+
+        bool hasPosition( ) const {
+          for ( auto const& p : predicates ) {
+            if ( p.op == QueryOp::Position ) {
+              return true;
+            }
+          }
+          return false;
+        }
+      };
+
+      namespace _private {
+        template<typename ValueType>
+        struct QueryLiteral {
+          static bool parse( std::string const& aText, ValueType& aValue ) {
+            std::istringstream in( aText );
+            in >> aValue;
+            return !in.fail( ) && ( in >> std::ws ).eof( );
+          }
+        };
+
+        template<>
+        struct QueryLiteral<std::string> {
+          static bool parse( std::string const& aText, std::string& aValue ) {
+            aValue = aText;
+            return true;
+          }
+        };
+      } // _private
+
+      //=====================================================================
+      // Path Query
+      template<typename NodeDataType>
+      class PathQuery {
+      public:
+        typedef NodeDataType ValueType;
+        typedef QueryStep<ValueType> Step;
+        typedef QueryPredicate<ValueType> Predicate;
+        typedef PathQuery<ValueType> SelfType;
+
+        // A step and the one past the last are bits of a 64 bit mask
+        static const std::size_t MaxSteps = 63;
+
+      private:
+        std::vector<Step> _steps;
+
+      public:
+        PathQuery( ) {}
+
+        explicit PathQuery( std::string const& aText ) {
+          parse( aText );
+        }
+
+        std::vector<Step> const& steps( ) const {
+          return _steps;
+        }
+
+        std::size_t size( ) const {
+          return _steps.size( );
+        }
+
+        bool empty( ) const {
+          return _steps.empty( );
+        }
+
+        SelfType& child( ) {
+          return add( QueryAxis::Child, nullptr );
+        }
+
+        SelfType& child( ValueType const& aKey ) {
+          return add( QueryAxis::Child, &aKey );
+        }
+
+        SelfType& descendant( ) {
+          return add( QueryAxis::Descendant, nullptr );
+        }
+
+        SelfType& descendant( ValueType const& aKey ) {
+          return add( QueryAxis::Descendant, &aKey );
+        }
+
+        // Predicate on the value of the last step's nodes
+        SelfType& where( QueryOp aOp, ValueType const& aValue ) {
+          if ( aOp == QueryOp::Position ) {
+            throw std::invalid_argument( "PathQuery: use at( ) for positions" );
+          }
+          last( ).predicates.push_back( Predicate{ aOp, aValue, 0 } );
+          return *this;
+        }
+
+        // aPosition counts from 1
+        SelfType& at( std::size_t aPosition ) {
+          if ( aPosition == 0 ) {
+            throw std::invalid_argument( "PathQuery: positions count from 1" );
+          }
+          last( ).predicates.push_back( Predicate{ QueryOp::Position, ValueType( ), aPosition } );
+          return *this;
+        }
+
+      private:
+        SelfType& add( QueryAxis aAxis, ValueType const* aKey ) {
+          if ( _steps.size( ) == MaxSteps ) {
+            throw std::invalid_argument( "PathQuery: too many steps" );
+          }
+          Step s;
+          s.axis = aAxis;
+          s.keyed = aKey != nullptr;
+          s.key = aKey ? *aKey : ValueType( );
+          _steps.push_back( s );
+          return *this;
+        }
+
+        Step& last( ) {
+          if ( _steps.empty( ) ) {
+            throw std::invalid_argument( "PathQuery: predicate before the first step" );
+          }
+          return _steps.back( );
+        }
+
+        static void fail( std::string const& aWhat, std::size_t aAt ) {
+          std::ostringstream message;
+          message << "PathQuery: " << aWhat << " at " << aAt;
+          throw std::invalid_argument( message.str( ) );
+        }
+
+        static void skipSpace( std::string const& aText, std::size_t& aAt ) {
+          while ( aAt < aText.size( ) && std::isspace( static_cast< unsigned char >( aText[ aAt ] ) ) ) {
+            ++aAt;
+          }
+        }
+
+        // A quoted string, or everything up to / [ or ] without the
+        // surrounding spaces
+        static std::string literal( std::string const& aText, std::size_t& aAt ) {
+          skipSpace( aText, aAt );
+          std::string ret;
+          if ( aAt < aText.size( ) && aText[ aAt ] == '"' ) {
+            const std::size_t close = aText.find( '"', aAt + 1 );
+            if ( close == std::string::npos ) {
+              fail( "unterminated quote", aAt );
+            }
+            ret = aText.substr( aAt + 1, close - aAt - 1 );
+            aAt = close + 1;
+          }
+          else {
+            const std::size_t end = std::min( aText.find_first_of( "/[]", aAt ), aText.size( ) );
+            ret = aText.substr( aAt, end - aAt );
+            ret.erase( ret.find_last_not_of( " \t\r\n" ) + 1 );
+            if ( ret.empty( ) ) {
+              fail( "expected a value", aAt );
+            }
+            aAt = end;
+          }
+          skipSpace( aText, aAt );
+          return ret;
+        }
+
+        static ValueType value( std::string const& aText, std::size_t& aAt ) {
+          const std::size_t start = aAt;
+          ValueType ret = ValueType( );
+          if ( !_private::QueryLiteral<ValueType>::parse( literal( aText, aAt ), ret ) ) {
+            fail( "bad value", start );
+          }
+          return ret;
+        }
+
+        void predicate( std::string const& aText, std::size_t& aAt ) {
+          static const std::pair<char const*, QueryOp> ops[] = {
+            { "!=", QueryOp::NotEqual }, { "<=", QueryOp::LessEqual }, { ">=", QueryOp::GreaterEqual },
+            { "=", QueryOp::Equal }, { "<", QueryOp::Less }, { ">", QueryOp::Greater }
+          };
+          skipSpace( aText, aAt );
+          for ( auto const& op : ops ) {
+            if ( aText.compare( aAt, std::strlen( op.first ), op.first ) == 0 ) {
+              aAt += std::strlen( op.first );
+              where( op.second, value( aText, aAt ) );
+              return;
+            }
+          }
+          const std::size_t start = aAt;
+          std::size_t position = 0;
+          while ( aAt < aText.size( ) && std::isdigit( static_cast< unsigned char >( aText[ aAt ] ) ) ) {
+            position = position * 10 + static_cast< std::size_t >( aText[ aAt++ ] - '0' );
+          }
+          if ( aAt == start || position == 0 ) {
+            fail( "expected a predicate", start );
+          }
+          at( position );
+          skipSpace( aText, aAt );
+        }
+
+        void parse( std::string const& aText ) {
+          std::size_t pos = 0;
+          skipSpace( aText, pos );
+          if ( pos == aText.size( ) ) {
+            fail( "empty query", pos );
+          }
+          while ( pos < aText.size( ) ) {
+            if ( aText[ pos ] != '/' ) {
+              fail( "expected /", pos );
+            }
+            ++pos;
+            const QueryAxis axis = pos < aText.size( ) && aText[ pos ] == '/' ? QueryAxis::Descendant : QueryAxis::Child;
+            if ( axis == QueryAxis::Descendant ) {
+              ++pos;
+            }
+            skipSpace( aText, pos );
+            if ( pos < aText.size( ) && aText[ pos ] == '*' ) {
+              add( axis, nullptr );
+              ++pos;
+              skipSpace( aText, pos );
+            }
+            else {
+              const ValueType key = value( aText, pos );
+              add( axis, &key );
+            }
+            while ( pos < aText.size( ) && aText[ pos ] == '[' ) {
+              ++pos;
+              predicate( aText, pos );
+              if ( pos >= aText.size( ) || aText[ pos ] != ']' ) {
+                fail( "expected ]", pos );
+              }
+              ++pos;
+              skipSpace( aText, pos );
+            }
+          }
+        }
+      };
+
+      template<typename NodeDataType>
+      const std::size_t PathQuery<NodeDataType>::MaxSteps;
+
+      //=====================================================================
+      // Query Index
+      template<typename TreeType>
+      class QueryIndex {
+      public:
+        typedef typename TreeType::Node Node;
+        typedef typename TreeType::NodeRef NodeRef;
+        typedef typename Node::ValueType ValueType;
+        typedef PathQuery<ValueType> Query;
+        typedef typename Query::Step Step;
+        typedef std::uint32_t IndexType;
+        typedef QueryIndex<TreeType> SelfType;
+
+        static const IndexType npos = std::numeric_limits<IndexType>::max( );
+        // Nodes with at least this many children get them sorted by value
+        static const std::size_t KeyedFanout = 16;
+        // A value is rare enough to prune with when at most one node in
+        // this many has it
+        static const std::size_t PruneSelectivity = 8;
+
+      private:
+        typedef std::pair<IndexType const*, IndexType const*> Range;
+
+        std::vector<Node*> _nodes;
+        std::vector<ValueType> _values;
+        std::vector<char> _hasData;
+        std::vector<IndexType> _parent;
+        // Subtree of i is [ i, _end[ i ] )
+        std::vector<IndexType> _end;
+        // Nodes with data by ( value, index )
+        std::vector<IndexType> _byValue;
+        // Children of wide nodes by ( value, index )
+        std::vector<IndexType> _keyed;
+        std::unordered_map<IndexType, std::pair<std::size_t, std::size_t>> _keyedRange;
+
+      public:
+        explicit QueryIndex( TreeType& aTree ) {
+          build( aTree.root( ) );
+        }
+
+        std::size_t size( ) const {
+          return _nodes.size( );
+        }
+
+        NodeRef node( IndexType aIndex ) const {
+          return *_nodes[ aIndex ];
+        }
+
+        IndexType parent( IndexType aIndex ) const {
+          return _parent[ aIndex ];
+        }
+
+        IndexType subtreeEnd( IndexType aIndex ) const {
+          return _end[ aIndex ];
+        }
+
+        // Plan select( ) uses for each step of aQuery
+        std::vector<QueryPlan> plan( Query const& aQuery ) const {
+          std::vector<QueryPlan> ret;
+          for ( std::size_t k = 0; k < aQuery.size( ); ++k ) {
+            ret.push_back( planOf( aQuery, k, nullptr ) );
+          }
+          return ret;
+        }
+
+        // Preorder indices of the matching nodes, in preorder
+        std::vector<IndexType> select( Query const& aQuery ) const {
+          std::vector<IndexType> ret;
+          if ( !aQuery.empty( ) && !_nodes.empty( ) ) {
+            // npos stands for the parent of the root
+            ret.assign( 1, npos );
+            for ( std::size_t k = 0; k < aQuery.size( ) && !ret.empty( ); ++k ) {
+              ret = step( aQuery, k, ret );
+            }
+          }
+          return ret;
+        }
+
+        std::vector<IndexType> select( std::string const& aQuery ) const {
+          return select( Query( aQuery ) );
+        }
+
+        // Results of every query, from one preorder pass
+        std::vector<std::vector<IndexType>> selectAll( std::vector<Query> const& aQueries ) const {
+          typedef std::uint64_t Mask;
+          // Steps a node is a context for, and the // steps open above it
+          struct Frame {
+            IndexType end;
+            std::vector<Mask> active;
+            std::vector<Mask> open;
+            std::vector<std::uint32_t> ranks;
+          };
+
+          const std::size_t count = aQueries.size( );
+          std::vector<std::vector<IndexType>> ret( count );
+          std::vector<Mask> childSteps( count, 0 );
+          std::vector<Mask> descendantSteps( count, 0 );
+          // Rank counters of a step's predicates start at slot[ q ][ k ]
+          std::vector<std::vector<std::size_t>> slot( count );
+          std::size_t slots = 0;
+          for ( std::size_t q = 0; q < count; ++q ) {
+            auto const& steps = aQueries[ q ].steps( );
+            for ( std::size_t k = 0; k < steps.size( ); ++k ) {
+              ( steps[ k ].axis == QueryAxis::Child ? childSteps : descendantSteps )[ q ] |= Mask( 1 ) << k;
+              slot[ q ].push_back( slots );
+              slots += steps[ k ].predicates.size( );
+            }
+          }
+
+          std::vector<Frame> frames( 1 );
+          frames[ 0 ].end = static_cast< IndexType >( size( ) );
+          frames[ 0 ].active.assign( count, 0 );
+          frames[ 0 ].open.assign( count, 0 );
+          frames[ 0 ].ranks.assign( slots, 0 );
+          for ( std::size_t q = 0; q < count; ++q ) {
+            if ( !aQueries[ q ].empty( ) ) {
+              frames[ 0 ].active[ q ] = 1;
+              frames[ 0 ].open[ q ] = descendantSteps[ q ] & 1;
+            }
+          }
+
+          std::size_t top = 0;
+          for ( IndexType i = 0; i < size( ); ) {
+            while ( frames[ top ].end <= i ) {
+              --top;
+            }
+            if ( frames.size( ) < top + 2 ) {
+              frames.resize( top + 2 );
+            }
+            Frame& parent = frames[ top ];
+            Frame& child = frames[ top + 1 ];
+            child.active.resize( count );
+            child.open.resize( count );
+            bool live = false;
+            for ( std::size_t q = 0; q < count; ++q ) {
+              auto const& steps = aQueries[ q ].steps( );
+              const Mask applicable = ( parent.active[ q ] & childSteps[ q ] ) | parent.open[ q ];
+              Mask matched = 0;
+              for ( std::size_t k = 0; k < steps.size( ); ++k ) {
+                if ( ( applicable >> k & 1 ) && keyMatches( steps[ k ], i ) ) {
+                  std::uint32_t* ranks = parent.ranks.data( ) + slot[ q ][ k ];
+                  if ( accept( steps[ k ], i, [ ranks ]( std::size_t p ) -> std::uint32_t& { return ranks[ p ]; } ) ) {
+                    matched |= Mask( 1 ) << ( k + 1 );
+                  }
+                }
+              }
+              const Mask done = Mask( 1 ) << steps.size( );
+              if ( matched & done ) {
+                ret[ q ].push_back( i );
+              }
+              child.active[ q ] = matched & ~done;
+              child.open[ q ] = parent.open[ q ] | ( child.active[ q ] & descendantSteps[ q ] );
+              live = live || child.active[ q ] || child.open[ q ];
+            }
+            if ( live && _end[ i ] > i + 1 ) {
+              child.end = _end[ i ];
+              child.ranks.assign( slots, 0 );
+              ++top;
+              ++i;
+            }
+            else {
+              // Nothing can match below i
+              i = _end[ i ];
+            }
+          }
+          return ret;
+        }
+
+      private:
+        void build( Node& aRoot ) {
+          std::vector<std::pair<Node*, IndexType>> stack( 1, std::make_pair( &aRoot, npos ) );
+          while ( !stack.empty( ) ) {
+            Node* n = stack.back( ).first;
+            const IndexType parent = stack.back( ).second;
+            stack.pop_back( );
+            if ( _nodes.size( ) >= npos ) {
+              throw std::length_error( "QueryIndex: tree too large" );
+            }
+            const IndexType id = static_cast< IndexType >( _nodes.size( ) );
+            _nodes.push_back( n );
+            _hasData.push_back( bool( *n ) );
+            _values.push_back( *n ? n->data( ) : ValueType( ) );
+            _parent.push_back( parent );
+            auto& children = _private::NodeUtility::children( *n );
+            for ( std::size_t i = children.size( ); i-- > 0; ) {
+              stack.push_back( std::make_pair( &children[ i ], id ) );
+            }
+          }
+
+          const std::size_t n = _nodes.size( );
+          _end.resize( n );
+          for ( std::size_t i = 0; i < n; ++i ) {
+            _end[ i ] = static_cast< IndexType >( i + 1 );
+          }
+          std::vector<IndexType> fanout( n, 0 );
+          for ( std::size_t i = n; i-- > 1; ) {
+            _end[ _parent[ i ] ] = std::max( _end[ _parent[ i ] ], _end[ i ] );
+            ++fanout[ _parent[ i ] ];
+          }
+
+          auto byValue = [ this ]( IndexType aLeft, IndexType aRight ) {
+            return _values[ aLeft ] < _values[ aRight ] || ( !( _values[ aRight ] < _values[ aLeft ] ) && aLeft < aRight );
+          };
+          for ( IndexType i = 0; i < n; ++i ) {
+            if ( _hasData[ i ] ) {
+              _byValue.push_back( i );
+            }
+          }
+          std::sort( _byValue.begin( ), _byValue.end( ), byValue );
+
+          for ( IndexType i = 0; i < n; ++i ) {
+            if ( fanout[ i ] >= KeyedFanout ) {
+              const std::size_t first = _keyed.size( );
+              for ( IndexType c = i + 1; c < _end[ i ]; c = _end[ c ] ) {
+                if ( _hasData[ c ] ) {
+                  _keyed.push_back( c );
+                }
+              }
+              std::sort( _keyed.begin( ) + first, _keyed.end( ), byValue );
+              _keyedRange[ i ] = std::make_pair( first, _keyed.size( ) );
+            }
+          }
+        }
+
+        // Nodes in [ aFirst, aLast ) with value aKey, in preorder
+        Range withValue( IndexType const* aFirst, IndexType const* aLast, ValueType const& aKey ) const {
+          auto lower = std::lower_bound( aFirst, aLast, aKey, [ this ]( IndexType aIndex, ValueType const& aValue ) {
+            return _values[ aIndex ] < aValue;
+          } );
+          auto upper = std::upper_bound( lower, aLast, aKey, [ this ]( ValueType const& aValue, IndexType aIndex ) {
+            return aValue < _values[ aIndex ];
+          } );
+          return Range( lower, upper );
+        }
+
+        Range withValue( ValueType const& aKey ) const {
+          return withValue( _byValue.data( ), _byValue.data( ) + _byValue.size( ), aKey );
+        }
+
+        // Whether aRange holds a node in [ aFirst, aLast )
+        static bool occurs( Range const& aRange, IndexType aFirst, IndexType aLast ) {
+          IndexType const* it = std::lower_bound( aRange.first, aRange.second, aFirst );
+          return it != aRange.second && *it < aLast;
+        }
+
+        // aPrune receives the nodes a PrunedDfs step needs below a match
+        QueryPlan planOf( Query const& aQuery, std::size_t aStep, Range* aPrune ) const {
+          Step const& s = aQuery.steps( )[ aStep ];
+          if ( s.axis == QueryAxis::Child ) {
+            return s.keyed ? QueryPlan::KeyedChild : QueryPlan::ChildScan;
+          }
+          if ( s.keyed ) {
+            return QueryPlan::IntervalIndex;
+          }
+          // Every later match lies below a match of this step, so a subtree
+          // without a later step's value has none. Positions would count the
+          // skipped siblings.
+          if ( !s.hasPosition( ) ) {
+            Range rarest( nullptr, nullptr );
+            std::size_t best = size( ) / PruneSelectivity + 1;
+            for ( std::size_t k = aStep + 1; k < aQuery.size( ); ++k ) {
+              Step const& later = aQuery.steps( )[ k ];
+              if ( later.keyed ) {
+                const Range r = withValue( later.key );
+                if ( static_cast< std::size_t >( r.second - r.first ) < best ) {
+                  best = static_cast< std::size_t >( r.second - r.first );
+                  rarest = r;
+                }
+              }
+            }
+            if ( rarest.first ) {
+              if ( aPrune ) {
+                *aPrune = rarest;
+              }
+              return QueryPlan::PrunedDfs;
+            }
+          }
+          return QueryPlan::SubtreeScan;
+        }
+
+        bool keyMatches( Step const& aStep, IndexType aIndex ) const {
+          return !aStep.keyed || ( _hasData[ aIndex ] && _values[ aIndex ] == aStep.key );
+        }
+
+        // Predicates in order, aRank( p ) is the counter of position p among
+        // aIndex's siblings
+        template<typename Rank>
+        bool accept( Step const& aStep, IndexType aIndex, Rank aRank ) const {
+          for ( std::size_t p = 0; p < aStep.predicates.size( ); ++p ) {
+            auto const& predicate = aStep.predicates[ p ];
+            if ( predicate.op == QueryOp::Position ) {
+              if ( ++aRank( p ) != predicate.position ) {
+                return false;
+              }
+            }
+            else if ( !_hasData[ aIndex ] || !predicate.test( _values[ aIndex ] ) ) {
+              return false;
+            }
+          }
+          return true;
+        }
+
+        template<typename Body>
+        void forEachChild( IndexType aNode, Body& aBody ) const {
+          if ( aNode == npos ) {
+            aBody( 0 );
+            return;
+          }
+          for ( IndexType c = aNode + 1; c < _end[ aNode ]; c = _end[ c ] ) {
+            aBody( c );
+          }
+        }
+
+        // Calls aBody( first, last ) on the strict subtrees of the sorted
+        // contexts, each node once
+        template<typename Body>
+        void forEachInterval( std::vector<IndexType> const& aContext, Body& aBody ) const {
+          IndexType covered = 0;
+          for ( IndexType c : aContext ) {
+            if ( c == npos ) {
+              aBody( IndexType( 0 ), static_cast< IndexType >( size( ) ) );
+              return;
+            }
+            if ( c >= covered ) {
+              aBody( c + 1, _end[ c ] );
+              covered = _end[ c ];
+            }
+          }
+        }
+
+        std::vector<IndexType> step( Query const& aQuery, std::size_t aStep, std::vector<IndexType> const& aContext ) const {
+          Step const& s = aQuery.steps( )[ aStep ];
+          Range prune( nullptr, nullptr );
+          const QueryPlan plan = planOf( aQuery, aStep, &prune );
+          // Position counters per predicate, by parent
+          std::vector<std::unordered_map<IndexType, std::uint32_t>> ranks( s.hasPosition( ) ? s.predicates.size( ) : 0 );
+          std::vector<IndexType> ret;
+          auto matched = [ this, &s, &ranks, &ret ]( IndexType aIndex ) {
+            const IndexType parent = _parent[ aIndex ];
+            if ( accept( s, aIndex, [ &ranks, parent ]( std::size_t p ) -> std::uint32_t& { return ranks[ p ][ parent ]; } ) ) {
+              ret.push_back( aIndex );
+            }
+          };
+          auto candidate = [ this, &s, &matched ]( IndexType aIndex ) {
+            if ( keyMatches( s, aIndex ) ) {
+              matched( aIndex );
+            }
+          };
+
+          switch ( plan ) {
+          case QueryPlan::ChildScan:
+            for ( IndexType c : aContext ) {
+              forEachChild( c, candidate );
+            }
+            break;
+          case QueryPlan::KeyedChild:
+            for ( IndexType c : aContext ) {
+              auto it = c == npos ? _keyedRange.end( ) : _keyedRange.find( c );
+              if ( it == _keyedRange.end( ) ) {
+                forEachChild( c, candidate );
+              }
+              else {
+                const Range r = withValue( _keyed.data( ) + it->second.first, _keyed.data( ) + it->second.second, s.key );
+                std::for_each( r.first, r.second, matched );
+              }
+            }
+            break;
+          case QueryPlan::IntervalIndex: {
+            const Range all = withValue( s.key );
+            auto scan = [ &all, &matched ]( IndexType aFirst, IndexType aLast ) {
+              for ( IndexType const* it = std::lower_bound( all.first, all.second, aFirst ); it != all.second && *it < aLast; ++it ) {
+                matched( *it );
+              }
+            };
+            forEachInterval( aContext, scan );
+            break;
+          }
+          case QueryPlan::PrunedDfs: {
+            auto walk = [ this, &prune, &candidate ]( IndexType aFirst, IndexType aLast ) {
+              for ( IndexType i = aFirst; i < aLast; ) {
+                if ( occurs( prune, i + 1, _end[ i ] ) ) {
+                  candidate( i );
+                  ++i;
+                }
+                else {
+                  i = _end[ i ];
+                }
+              }
+            };
+            forEachInterval( aContext, walk );
+            break;
+          }
+          case QueryPlan::SubtreeScan: {
+            auto scan = [ &candidate ]( IndexType aFirst, IndexType aLast ) {
+              for ( IndexType i = aFirst; i < aLast; ++i ) {
+                candidate( i );
+              }
+            };
+            forEachInterval( aContext, scan );
+            break;
+          }
+          }
+
+          // Children of nested contexts come out of preorder
+          if ( !std::is_sorted( ret.begin( ), ret.end( ) ) ) {
+            std::sort( ret.begin( ), ret.end( ) );
+          }
+          return ret;
+        }
+      };
+
+      template<typename TreeType>
+      const typename QueryIndex<TreeType>::IndexType QueryIndex<TreeType>::npos;
+
+      template<typename TreeType>
+      const std::size_t QueryIndex<TreeType>::KeyedFanout;
+
+      template<typename TreeType>
+      const std::size_t QueryIndex<TreeType>::PruneSelectivity;
+
+      // One shot query, the nodes in preorder
+      template<typename TreeType>
+      std::vector<std::reference_wrapper<typename TreeType::Node>> select( TreeType& aTree, std::string const& aQuery ) {
+        QueryIndex<TreeType> index( aTree );
+        std::vector<std::reference_wrapper<typename TreeType::Node>> ret;
+        for ( auto i : index.select( aQuery ) ) {
+          ret.push_back( std::ref( index.node( i ) ) );
+        }
+        return ret;
+      }
+    }
+  }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "NTree.hpp"
+
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+#include <xmmintrin.h>
+#endif
+
+// Visitor based pre order and level order traversals that prefetch ahead.
+// Reaching the children of a node is a chain of three dependent loads: the
+// node itself, its children vector header and payload, then the children
+// buffer. Prefetches are staged along that chain: the entry aDistance
+// steps ahead has its node prefetched, the one 2/3 of the way has its
+// header and payload prefetched, and the one 1/3 of the way its buffer,
+// each stage reading only what the previous one brought in. A distance of
+// 0 turns prefetching off.
+//
+// The visitor is called as aVisitor( node ) and must not add or remove
+// children while the traversal runs.
+namespace blib {
+  namespace container {
+    namespace tree {
+      const std::size_t DefaultPrefetchDistance = 8;
+
+      namespace _private {
+        inline void prefetch( void const* aAddress ) {
+#if defined( __GNUC__ ) || defined( __clang__ )
+          __builtin_prefetch( aAddress );
+#elif defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+          _mm_prefetch( static_cast< char const* >( aAddress ), _MM_HINT_T0 );
+#else
+          (void)aAddress;
+#endif
+        }
+
+        template<typename NodeType>
+        class PrefetchTraversal {
+        private:
+          // Stage by stage, each one reads what the previous one fetched
+          static void prefetchNode( NodeType* aNode ) {
+            prefetch( aNode );
+          }
+
+          static void prefetchHeader( NodeType* aNode ) {
+            prefetch( NodeUtility::childrenPtr( *aNode ).get( ) );
+            prefetch( NodeUtility::dataPtr( *aNode ).get( ) );
+          }
+
+          static void prefetchBuffer( NodeType* aNode ) {
+            prefetch( NodeUtility::children( *aNode ).data( ) );
+          }
+
+          // aUpcoming( k ) is the entry visited k steps from now, or nullptr
+          template<typename Upcoming>
+          static void prefetchAhead( std::size_t aDistance, Upcoming const& aUpcoming ) {
+            NodeType* n = aUpcoming( aDistance );
+            if ( n ) {
+              prefetchNode( n );
+            }
+            n = aUpcoming( aDistance * 2 / 3 );
+            if ( n ) {
+              prefetchHeader( n );
+            }
+            n = aUpcoming( aDistance / 3 );
+            if ( n ) {
+              prefetchBuffer( n );
+            }
+          }
+
+        public:
+          template<typename Visitor>
+          static void preOrder( NodeType& aRoot, Visitor& aVisitor, std::size_t aDistance ) {
+            std::vector<NodeType*> stack( 1, &aRoot );
+            auto upcoming = [ &stack ]( std::size_t aAhead ) -> NodeType* {
+              return aAhead < stack.size( ) ? stack[ stack.size( ) - 1 - aAhead ] : nullptr;
+            };
+            while ( !stack.empty( ) ) {
+              NodeType& n = *stack.back( );
+              stack.pop_back( );
+              auto& children = NodeUtility::children( n );
+              for ( std::size_t i = children.size( ); i-- > 0; ) {
+                stack.push_back( &children[ i ] );
+              }
+              if ( aDistance ) {
+                prefetchAhead( aDistance, upcoming );
+              }
+              aVisitor( n );
+            }
+          }
+
+          template<typename Visitor>
+          static void levelOrder( NodeType& aRoot, Visitor& aVisitor, std::size_t aDistance ) {
+            std::vector<NodeType*> level( 1, &aRoot );
+            std::vector<NodeType*> next;
+            std::size_t i = 0;
+            auto upcoming = [ &level, &i ]( std::size_t aAhead ) -> NodeType* {
+              return i + aAhead < level.size( ) ? level[ i + aAhead ] : nullptr;
+            };
+            while ( !level.empty( ) ) {
+              for ( i = 0; i < level.size( ); ++i ) {
+                if ( aDistance ) {
+                  prefetchAhead( aDistance, upcoming );
+                }
+                NodeType& n = *level[ i ];
+                for ( auto& c : NodeUtility::children( n ) ) {
+                  next.push_back( &c );
+                }
+                aVisitor( n );
+              }
+              level.swap( next );
+              next.clear( );
+            }
+          }
+        };
+      } // _private
+
+      template<typename NodeType, typename Visitor>
+      void visitPreOrder( NodeType& aRoot, Visitor aVisitor, std::size_t aDistance = DefaultPrefetchDistance ) {
+        _private::PrefetchTraversal<NodeType>::preOrder( aRoot, aVisitor, aDistance );
+      }
+
+      template<typename NodeType, typename Visitor>
+      void visitPreOrder( NTree<NodeType>& aTree, Visitor aVisitor, std::size_t aDistance = DefaultPrefetchDistance ) {
+        visitPreOrder( aTree.root( ), aVisitor, aDistance );
+      }
+
+      template<typename NodeType, typename Visitor>
+      void visitLevelOrder( NodeType& aRoot, Visitor aVisitor, std::size_t aDistance = DefaultPrefetchDistance ) {
+        _private::PrefetchTraversal<NodeType>::levelOrder( aRoot, aVisitor, aDistance );
+      }
+
+      template<typename NodeType, typename Visitor>
+      void visitLevelOrder( NTree<NodeType>& aTree, Visitor aVisitor, std::size_t aDistance = DefaultPrefetchDistance ) {
+        visitLevelOrder( aTree.root( ), aVisitor, aDistance );
+      }
+    }
+  }
+}
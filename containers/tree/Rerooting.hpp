@@ -0,0 +1,246 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "NTree.hpp"
+#include "Parallel.hpp"
+
+// Rerooting: a tree DP evaluated for every node as if that node were the
+// root, in two O(n) passes instead of n separate walks.
+//
+// The operators, as members of an Ops object:
+//   typedef ... ValueType;
+//   ValueType identity( ) const;
+//   ValueType combine( ValueType const& aLeft, ValueType const& aRight ) const;
+//   // what the side rooted at aFrom contributes to its neighbour aTo
+//   ValueType lift( ValueType const& aSide, NodeType const& aFrom, NodeType const& aTo ) const;
+//   // removes one contribution from a combination that contains it
+//   ValueType exclude( ValueType const& aAll, ValueType const& aPart ) const;
+//   // the value of a node from the combined contributions of its neighbours
+//   ValueType finalize( ValueType const& aCombined, NodeType const& aNode ) const;
+// combine must be associative and commutative. When it has no inverse, as
+// max has not, ValueType can carry enough to take one contribution out,
+// for example the two largest values.
+//
+// Sum of distances to all nodes, with ValueType = ( nodes, distance sum ):
+//   combine   ( a.n + b.n, a.s + b.s )
+//   lift      ( x.n, x.s + x.n )
+//   exclude   ( a.n - b.n, a.s - b.s )
+//   finalize  ( x.n + 1, x.s )
+//
+// The up pass goes from the deepest level to the root, the down pass back;
+// the nodes of a level are independent, so wide levels are split between
+// threads and narrow ones run on the calling thread. Nodes are named by
+// their preorder index and the results are one contiguous array in that
+// order.
+namespace blib {
+  namespace container {
+    namespace tree {
+      //=====================================================================
+      // Rerooting
+      template<typename TreeType, typename Ops>
+      class Rerooting {
+      public:
+        typedef typename TreeType::Node Node;
+        typedef typename TreeType::NodeRef NodeRef;
+        typedef typename Ops::ValueType ValueType;
+        typedef std::uint32_t IndexType;
+        typedef Rerooting<TreeType, Ops> SelfType;
+
+        static const IndexType npos = std::numeric_limits<IndexType>::max( );
+        // Levels smaller than this are not worth waking the threads for
+        static const std::size_t ParallelLevel = 4096;
+
+      private:
+        Ops _ops;
+        std::vector<Node*> _nodes;
+        std::vector<IndexType> _parent;
+        std::vector<IndexType> _size;
+        // Preorder indexes grouped by depth, level d is
+        // _byLevel[ _levelStart[ d ] .. _levelStart[ d + 1 ] )
+        std::vector<IndexType> _byLevel;
+        std::vector<std::size_t> _levelStart;
+        // Children combined, the original root's view
+        std::vector<ValueType> _below;
+        // Subtree of each node, rooted at the original root
+        std::vector<ValueType> _subtree;
+        // All neighbours combined, then the final value
+        std::vector<ValueType> _result;
+
+      public:
+        // aThreads > 1 splits wide levels between that many threads
+        explicit Rerooting( TreeType& aTree, Ops const& aOps = Ops( ), std::size_t aThreads = 1 ) :
+          _ops( aOps ) {
+          number( aTree.root( ) );
+          std::unique_ptr<ThreadTeam> team;
+          if ( aThreads > 1 ) {
+            team.reset( new ThreadTeam( aThreads ) );
+          }
+          up( team.get( ) );
+          down( team.get( ) );
+        }
+
+        std::size_t size( ) const {
+          return _nodes.size( );
+        }
+
+        NodeRef node( IndexType aId ) const {
+          return *_nodes[ aId ];
+        }
+
+        IndexType parent( IndexType aId ) const {
+          return _parent[ aId ];
+        }
+
+        // Value of aId with the whole tree rooted at aId
+        ValueType const& result( IndexType aId ) const {
+          return _result[ aId ];
+        }
+
+        std::vector<ValueType> const& results( ) const {
+          return _result;
+        }
+
+        // Value of the subtree of aId in the tree's own rooting
+        ValueType const& subtree( IndexType aId ) const {
+          return _subtree[ aId ];
+        }
+
+        // Preorder index of the node with the best result, by aBetter
+        template<typename Better>
+        IndexType best( Better aBetter ) const {
+          IndexType ret = 0;
+          for ( IndexType i = 1; i < _result.size( ); ++i ) {
+            if ( aBetter( _result[ i ], _result[ ret ] ) ) {
+              ret = i;
+            }
+          }
+          return ret;
+        }
+
+      private:
+        void number( NodeRef aRoot ) {
+          std::vector<IndexType> depth;
+          std::vector<std::pair<Node*, IndexType>> stack( 1, std::make_pair( &aRoot, npos ) );
+          while ( !stack.empty( ) ) {
+            Node* n = stack.back( ).first;
+            const IndexType parent = stack.back( ).second;
+            stack.pop_back( );
+            if ( _nodes.size( ) >= npos ) {
+              throw std::length_error( "Rerooting: tree too large" );
+            }
+            const IndexType id = static_cast< IndexType >( _nodes.size( ) );
+            _nodes.push_back( n );
+            _parent.push_back( parent );
+            depth.push_back( parent == npos ? 0 : depth[ parent ] + 1 );
+            auto& children = _private::NodeUtility::children( *n );
+            for ( std::size_t i = children.size( ); i-- > 0; ) {
+              stack.push_back( std::make_pair( &children[ i ], id ) );
+            }
+          }
+
+          const std::size_t n = _nodes.size( );
+          _size.assign( n, 1 );
+          for ( std::size_t i = n; i-- > 1; ) {
+            _size[ _parent[ i ] ] += _size[ i ];
+          }
+
+          // Counting sort by depth
+          _levelStart.assign( 2, 0 );
+          for ( std::size_t i = 0; i < n; ++i ) {
+            if ( depth[ i ] + 2 > _levelStart.size( ) ) {
+              _levelStart.resize( depth[ i ] + 2, 0 );
+            }
+            ++_levelStart[ depth[ i ] + 1 ];
+          }
+          for ( std::size_t d = 1; d < _levelStart.size( ); ++d ) {
+            _levelStart[ d ] += _levelStart[ d - 1 ];
+          }
+          std::vector<std::size_t> fill( _levelStart.begin( ), _levelStart.end( ) - 1 );
+          _byLevel.resize( n );
+          for ( std::size_t i = 0; i < n; ++i ) {
+            _byLevel[ fill[ depth[ i ] ]++ ] = static_cast< IndexType >( i );
+          }
+
+          _below.assign( n, _ops.identity( ) );
+          _subtree.assign( n, _ops.identity( ) );
+          _result.assign( n, _ops.identity( ) );
+        }
+
+        // Calls aBody( id ) for every node of level aDepth
+        template<typename Body>
+        void forLevel( ThreadTeam* aTeam, std::size_t aDepth, Body const& aBody ) {
+          IndexType const* level = _byLevel.data( ) + _levelStart[ aDepth ];
+          const std::size_t count = _levelStart[ aDepth + 1 ] - _levelStart[ aDepth ];
+          if ( !aTeam || count < ParallelLevel ) {
+            for ( std::size_t i = 0; i < count; ++i ) {
+              aBody( level[ i ] );
+            }
+            return;
+          }
+          aTeam->forEachSlice( count, [ level, &aBody ]( std::size_t, std::size_t aFirst, std::size_t aLast ) {
+            for ( std::size_t i = aFirst; i < aLast; ++i ) {
+              aBody( level[ i ] );
+            }
+          } );
+        }
+
+        void up( ThreadTeam* aTeam ) {
+          for ( std::size_t d = _levelStart.size( ) - 1; d-- > 0; ) {
+            forLevel( aTeam, d, [ this ]( IndexType aId ) {
+              ValueType below = _ops.identity( );
+              for ( IndexType c = aId + 1; c < aId + _size[ aId ]; c += _size[ c ] ) {
+                below = _ops.combine( below, _ops.lift( _subtree[ c ], *_nodes[ c ], *_nodes[ aId ] ) );
+              }
+              _subtree[ aId ] = _ops.finalize( below, *_nodes[ aId ] );
+              _below[ aId ] = std::move( below );
+            } );
+          }
+        }
+
+        // _result[ id ] holds every neighbour of id combined when id's
+        // level is reached; it is finalized there and its children get
+        // their parent side.
+        void down( ThreadTeam* aTeam ) {
+          if ( _nodes.empty( ) ) {
+            return;
+          }
+          _result[ 0 ] = _below[ 0 ];
+          for ( std::size_t d = 0; d + 1 < _levelStart.size( ); ++d ) {
+            forLevel( aTeam, d, [ this ]( IndexType aId ) {
+              Node const& node = *_nodes[ aId ];
+              for ( IndexType c = aId + 1; c < aId + _size[ aId ]; c += _size[ c ] ) {
+                const ValueType rest = _ops.exclude( _result[ aId ], _ops.lift( _subtree[ c ], *_nodes[ c ], node ) );
+                _result[ c ] = _ops.combine( _below[ c ], _ops.lift( _ops.finalize( rest, node ), node, *_nodes[ c ] ) );
+              }
+              _result[ aId ] = _ops.finalize( _result[ aId ], node );
+            } );
+          }
+        }
+      };
+
+      template<typename TreeType, typename Ops>
+      const typename Rerooting<TreeType, Ops>::IndexType Rerooting<TreeType, Ops>::npos;
+
+      template<typename TreeType, typename Ops>
+      const std::size_t Rerooting<TreeType, Ops>::ParallelLevel;
+
+      // Result of every node, in preorder
+      template<typename TreeType, typename Ops>
+      std::vector<typename Ops::ValueType> reroot( TreeType& aTree, Ops const& aOps, std::size_t aThreads = 1 ) {
+        Rerooting<TreeType, Ops> dp( aTree, aOps, aThreads );
+        return dp.results( );
+      }
+    }
+  }
+}
@@ -0,0 +1,447 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <boost/iterator/iterator_facade.hpp>
+
+// Static NTree: a complete tree of fixed fanout and depth stored as one
+// array in level order, with no pointers. Node i has its children at
+// [ i * Fanout + 1, i * Fanout + Fanout ] and its parent at
+// ( i - 1 ) / Fanout, the same arithmetic as a binary heap.
+//
+// Depth is the number of levels, a lone root has Depth 1. Every level
+// offset, width and the node count are constant expressions.
+//
+// The iterators only hold the tree and an index: the next node in any of
+// the three orders follows from the index alone. They dereference to a
+// StaticNode proxy, which has the accessors of a Node.
+namespace blib {
+  namespace container {
+    namespace tree {
+      template<typename NodeDataType, std::size_t FanoutValue, std::size_t DepthValue>
+      class StaticNTree;
+
+      namespace _private {
+        //=====================================================================
+        // Static Layout
+        template<std::size_t FanoutValue, std::size_t DepthValue>
+        struct StaticLayout {
+          static_assert( FanoutValue >= 1, "StaticNTree needs a fanout of at least 1" );
+          static_assert( DepthValue >= 1, "StaticNTree needs at least one level" );
+
+          static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max( );
+
+          static constexpr std::size_t power( std::size_t aExponent ) {
+            return aExponent == 0 ? 1 : FanoutValue * power( aExponent - 1 );
+          }
+
+          // Index of the first node of aLevel, levelOffset( Depth ) is the size
+          static constexpr std::size_t levelOffset( std::size_t aLevel ) {
+            return aLevel == 0 ? 0 : levelOffset( aLevel - 1 ) + power( aLevel - 1 );
+          }
+
+          static constexpr std::size_t levelWidth( std::size_t aLevel ) {
+            return power( aLevel );
+          }
+
+          static constexpr std::size_t size( ) {
+            return levelOffset( DepthValue );
+          }
+
+          static constexpr std::size_t depth( std::size_t aNode, std::size_t aLevel = 0 ) {
+            return aNode < levelOffset( aLevel + 1 ) ? aLevel : depth( aNode, aLevel + 1 );
+          }
+
+          static constexpr bool isLeaf( std::size_t aNode ) {
+            return aNode >= levelOffset( DepthValue - 1 );
+          }
+
+          static constexpr std::size_t parent( std::size_t aNode ) {
+            return aNode == 0 ? npos : ( aNode - 1 ) / FanoutValue;
+          }
+
+          static constexpr std::size_t child( std::size_t aNode, std::size_t aIndex ) {
+            return isLeaf( aNode ) ? npos : aNode * FanoutValue + 1 + aIndex;
+          }
+
+          static constexpr std::size_t firstChild( std::size_t aNode ) {
+            return child( aNode, 0 );
+          }
+
+          static constexpr std::size_t numberOfChildren( std::size_t aNode ) {
+            return isLeaf( aNode ) ? 0 : FanoutValue;
+          }
+
+          // Position among the siblings
+          static constexpr std::size_t childIndex( std::size_t aNode ) {
+            return aNode == 0 ? 0 : ( aNode - 1 ) % FanoutValue;
+          }
+
+          static constexpr bool isLastChild( std::size_t aNode ) {
+            return aNode == 0 || childIndex( aNode ) == FanoutValue - 1;
+          }
+
+          static constexpr std::size_t nextSibling( std::size_t aNode ) {
+            return isLastChild( aNode ) ? npos : aNode + 1;
+          }
+
+          static constexpr std::size_t subtreeSize( std::size_t aNode ) {
+            return levelOffset( DepthValue - depth( aNode ) );
+          }
+
+          static constexpr std::size_t leftmostLeaf( std::size_t aNode ) {
+            return isLeaf( aNode ) ? aNode : leftmostLeaf( firstChild( aNode ) );
+          }
+
+          // Climbs to the first ancestor or self that has a next sibling and
+          // returns that sibling, npos once past the root
+          static constexpr std::size_t nextAfterSubtree( std::size_t aNode ) {
+            return aNode == 0 ? npos :
+              ( isLastChild( aNode ) ? nextAfterSubtree( parent( aNode ) ) : aNode + 1 );
+          }
+        };
+
+        template<std::size_t F, std::size_t D>
+        constexpr std::size_t StaticLayout<F, D>::npos;
+
+        // Successor functions of the three orders
+        template<typename Layout>
+        struct StaticPreOrder {
+          static std::size_t first( ) {
+            return 0;
+          }
+
+          static std::size_t next( std::size_t aNode ) {
+            return Layout::isLeaf( aNode ) ? Layout::nextAfterSubtree( aNode ) : Layout::firstChild( aNode );
+          }
+        };
+
+        template<typename Layout>
+        struct StaticPostOrder {
+          static std::size_t first( ) {
+            return Layout::leftmostLeaf( 0 );
+          }
+
+          static std::size_t next( std::size_t aNode ) {
+            return aNode == 0 ? Layout::npos :
+              ( Layout::isLastChild( aNode ) ? Layout::parent( aNode ) : Layout::leftmostLeaf( aNode + 1 ) );
+          }
+        };
+
+        template<typename Layout>
+        struct StaticLevelOrder {
+          static std::size_t first( ) {
+            return 0;
+          }
+
+          static std::size_t next( std::size_t aNode ) {
+            return aNode + 1 < Layout::size( ) ? aNode + 1 : Layout::npos;
+          }
+        };
+
+        template<typename TreeType, typename Order>
+        class static_order_iterator;
+      } // _private
+
+      //=====================================================================
+      // Static Node
+      // Proxy for one node, TreeType may be const.
+      template<typename TreeType>
+      class StaticNode {
+      public:
+        typedef typename std::remove_const<TreeType>::type::ValueType ValueType;
+        typedef typename std::conditional<std::is_const<TreeType>::value,
+          ValueType const&, ValueType&>::type ValueRef;
+        typedef typename std::remove_const<TreeType>::type::Layout Layout;
+        typedef StaticNode<TreeType> SelfType;
+
+      private:
+        TreeType* _tree;
+        std::size_t _index;
+
+      public:
+        StaticNode( ) :
+          _tree( nullptr ), _index( Layout::npos ) {}
+
+        StaticNode( TreeType& aTree, std::size_t aIndex ) :
+          _tree( &aTree ), _index( aIndex ) {}
+
+        std::size_t index( ) const {
+          return _index;
+        }
+
+        ValueRef data( ) const {
+          return _tree->data( _index );
+        }
+
+        void data( ValueType const& aData ) const {
+          _tree->data( _index ) = aData;
+        }
+
+        std::size_t depth( ) const {
+          return Layout::depth( _index );
+        }
+
+        bool isRoot( ) const {
+          return _index == 0;
+        }
+
+        bool isLeaf( ) const {
+          return Layout::isLeaf( _index );
+        }
+
+        std::size_t numberOfChildren( ) const {
+          return Layout::numberOfChildren( _index );
+        }
+
+        std::size_t subtreeSize( ) const {
+          return Layout::subtreeSize( _index );
+        }
+
+        // The root is its own parent, like an exhausted walk upwards
+        SelfType parent( ) const {
+          return SelfType( *_tree, isRoot( ) ? 0 : Layout::parent( _index ) );
+        }
+
+        // aIndex must be below numberOfChildren( )
+        SelfType operator[]( std::size_t aIndex ) const {
+          return SelfType( *_tree, Layout::child( _index, aIndex ) );
+        }
+
+        bool operator==( SelfType const& aOther ) const {
+          return _tree == aOther._tree && _index == aOther._index;
+        }
+
+        bool operator!=( SelfType const& aOther ) const {
+          return !( *this == aOther );
+        }
+      };
+
+      namespace _private {
+        template<typename TreeType, typename Order>
+        class static_order_iterator :
+          public boost::iterator_facade < static_order_iterator<TreeType, Order>, StaticNode<TreeType>,
+          boost::forward_traversal_tag, StaticNode<TreeType> > {
+        public:
+          typedef typename std::remove_const<TreeType>::type::Layout Layout;
+          typedef StaticNode<TreeType> NodeType;
+          typedef static_order_iterator<TreeType, Order> SelfType;
+
+        private:
+          friend class boost::iterator_core_access;
+
+          TreeType* _tree;
+          std::size_t _index;
+
+        public:
+          static_order_iterator( ) :
+            _tree( nullptr ), _index( Layout::npos ) {}
+
+          static_order_iterator( TreeType& aTree, std::size_t aIndex ) :
+            _tree( &aTree ), _index( aIndex ) {}
+
+        private:
+          bool equal( SelfType const& aOther ) const {
+            return aOther._index == _index;
+          }
+
+          NodeType dereference( ) const {
+            return NodeType( *_tree, _index );
+          }
+
+          void increment( ) {
+            _index = Order::next( _index );
+          }
+        };
+      } // _private
+
+      //=====================================================================
+      // Static NTree
+      template<typename NodeDataType, std::size_t FanoutValue, std::size_t DepthValue>
+      class StaticNTree {
+      public:
+        typedef NodeDataType ValueType;
+        typedef ValueType& ValueRef;
+        typedef ValueType const& ConstValueRef;
+        typedef StaticNTree<NodeDataType, FanoutValue, DepthValue> SelfType;
+        typedef _private::StaticLayout<FanoutValue, DepthValue> Layout;
+        typedef StaticNode<SelfType> Node;
+        typedef StaticNode<SelfType const> ConstNode;
+        typedef _private::static_order_iterator<SelfType, _private::StaticPreOrder<Layout>> pre_order_iterator;
+        typedef _private::static_order_iterator<SelfType, _private::StaticPostOrder<Layout>> post_order_iterator;
+        typedef _private::static_order_iterator<SelfType, _private::StaticLevelOrder<Layout>> level_order_iterator;
+        typedef _private::static_order_iterator<SelfType const, _private::StaticPreOrder<Layout>> const_pre_order_iterator;
+        typedef _private::static_order_iterator<SelfType const, _private::StaticPostOrder<Layout>> const_post_order_iterator;
+        typedef _private::static_order_iterator<SelfType const, _private::StaticLevelOrder<Layout>> const_level_order_iterator;
+
+        static constexpr std::size_t Fanout = FanoutValue;
+        static constexpr std::size_t Depth = DepthValue;
+        static constexpr std::size_t Size = Layout::size( );
+        static constexpr std::size_t npos = Layout::npos;
+
+      private:
+        std::array<ValueType, Size> _values;
+
+      public:
+        StaticNTree( ) :
+          _values( ) {}
+
+        explicit StaticNTree( ConstValueRef aFill ) {
+          _values.fill( aFill );
+        }
+
+        static constexpr std::size_t size( ) {
+          return Size;
+        }
+
+        static constexpr std::size_t levelOffset( std::size_t aLevel ) {
+          return Layout::levelOffset( aLevel );
+        }
+
+        static constexpr std::size_t levelWidth( std::size_t aLevel ) {
+          return Layout::levelWidth( aLevel );
+        }
+
+        static constexpr std::size_t parent( std::size_t aNode ) {
+          return Layout::parent( aNode );
+        }
+
+        static constexpr std::size_t child( std::size_t aNode, std::size_t aIndex ) {
+          return Layout::child( aNode, aIndex );
+        }
+
+        static constexpr std::size_t depth( std::size_t aNode ) {
+          return Layout::depth( aNode );
+        }
+
+        static constexpr bool isLeaf( std::size_t aNode ) {
+          return Layout::isLeaf( aNode );
+        }
+
+        ValueRef data( std::size_t aNode ) {
+          return _values[ aNode ];
+        }
+
+        ConstValueRef data( std::size_t aNode ) const {
+          return _values[ aNode ];
+        }
+
+        // Level order payloads
+        ValueType* values( ) {
+          return _values.data( );
+        }
+
+        ValueType const* values( ) const {
+          return _values.data( );
+        }
+
+        Node root( ) {
+          return Node( *this, 0 );
+        }
+
+        ConstNode root( ) const {
+          return ConstNode( *this, 0 );
+        }
+
+        Node node( std::size_t aIndex ) {
+          return Node( *this, aIndex );
+        }
+
+        ConstNode node( std::size_t aIndex ) const {
+          return ConstNode( *this, aIndex );
+        }
+
+        pre_order_iterator pre_order_begin( ) {
+          return pre_order_iterator( *this, _private::StaticPreOrder<Layout>::first( ) );
+        }
+
+        pre_order_iterator pre_order_end( ) {
+          return pre_order_iterator( *this, npos );
+        }
+
+        post_order_iterator post_order_begin( ) {
+          return post_order_iterator( *this, _private::StaticPostOrder<Layout>::first( ) );
+        }
+
+        post_order_iterator post_order_end( ) {
+          return post_order_iterator( *this, npos );
+        }
+
+        level_order_iterator level_order_begin( ) {
+          return level_order_iterator( *this, 0 );
+        }
+
+        level_order_iterator level_order_end( ) {
+          return level_order_iterator( *this, npos );
+        }
+
+        const_pre_order_iterator pre_order_begin( ) const {
+          return const_pre_order_iterator( *this, _private::StaticPreOrder<Layout>::first( ) );
+        }
+
+        const_pre_order_iterator pre_order_end( ) const {
+          return const_pre_order_iterator( *this, npos );
+        }
+
+        const_post_order_iterator post_order_begin( ) const {
+          return const_post_order_iterator( *this, _private::StaticPostOrder<Layout>::first( ) );
+        }
+
+        const_post_order_iterator post_order_end( ) const {
+          return const_post_order_iterator( *this, npos );
+        }
+
+        const_level_order_iterator level_order_begin( ) const {
+          return const_level_order_iterator( *this, 0 );
+        }
+
+        const_level_order_iterator level_order_end( ) const {
+          return const_level_order_iterator( *this, npos );
+        }
+      };
+
+      template<typename T, std::size_t F, std::size_t D>
+      constexpr std::size_t StaticNTree<T, F, D>::Fanout;
+
+      template<typename T, std::size_t F, std::size_t D>
+      constexpr std::size_t StaticNTree<T, F, D>::Depth;
+
+      template<typename T, std::size_t F, std::size_t D>
+      constexpr std::size_t StaticNTree<T, F, D>::Size;
+
+      template<typename T, std::size_t F, std::size_t D>
+      constexpr std::size_t StaticNTree<T, F, D>::npos;
+
+      // Visitor walks, aVisitor( node ) gets a StaticNode. The same names
+      // walk an NTree in PrefetchTraversal.hpp.
+      template<typename T, std::size_t F, std::size_t D, typename Visitor>
+      void visitPreOrder( StaticNTree<T, F, D>& aTree, Visitor aVisitor ) {
+        for ( auto it = aTree.pre_order_begin( ); it != aTree.pre_order_end( ); ++it ) {
+          aVisitor( *it );
+        }
+      }
+
+      template<typename T, std::size_t F, std::size_t D, typename Visitor>
+      void visitPostOrder( StaticNTree<T, F, D>& aTree, Visitor aVisitor ) {
+        for ( auto it = aTree.post_order_begin( ); it != aTree.post_order_end( ); ++it ) {
+          aVisitor( *it );
+        }
+      }
+
+      // Level order is the storage order, a plain loop over the array
+      template<typename T, std::size_t F, std::size_t D, typename Visitor>
+      void visitLevelOrder( StaticNTree<T, F, D>& aTree, Visitor aVisitor ) {
+        for ( std::size_t i = 0; i < aTree.size( ); ++i ) {
+          aVisitor( aTree.node( i ) );
+        }
+      }
+    }
+  }
+}
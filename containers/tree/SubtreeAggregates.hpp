@@ -0,0 +1,162 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include "NTree.hpp"
+
+namespace blib {
+  namespace container {
+    namespace tree {
+      //=====================================================================
+      // Monoid Augmentation
+      // Keeps a monoid aggregate of every subtree inside its root, so that
+      // subtreeAggregate( node ) is O(1). A monoid is
+      //   typedef ... ValueType;
+      //   static ValueType identity( );
+      //   template<typename NodeType>
+      //   static ValueType lift( NodeType const& aNode );   // the node alone
+      //   static void combine( ValueType& aAcc, ValueType const& aOther );
+      // When combine is commutative and every value has an inverse it may
+      // also give
+      //   static void subtract( ValueType& aAcc, ValueType const& aOther );
+      // and then addChild, removeChild and data writes cost O(depth). Without
+      // it each ancestor an update changes recombines its children, stopping
+      // at the first aggregate that comes out unchanged: O(log fanout) for a
+      // node with 16 children or more, which keeps them in a tournament
+      // tree, O(fanout) for a narrower one. Inserting or removing a child
+      // other than the last rebuilds its parent's tournament, O(fanout).
+      namespace _private {
+        template<typename Monoid, bool Invertible>
+        struct MonoidInverse {};
+
+        template<typename Monoid>
+        struct MonoidInverse<Monoid, true> {
+          static void subtract( typename Monoid::ValueType& aAcc, typename Monoid::ValueType const& aPart ) {
+            Monoid::subtract( aAcc, aPart );
+          }
+        };
+
+        template<typename Monoid>
+        class MonoidHasSubtract {
+        private:
+          template<typename M>
+          static std::true_type test( decltype( M::subtract( std::declval<typename M::ValueType&>( ),
+                                                             std::declval<typename M::ValueType const&>( ) ) )* );
+
+          template<typename M>
+          static std::false_type test( ... );
+
+        public:
+          static const bool value = decltype( test<Monoid>( nullptr ) )::value;
+        };
+      } // _private
+
+      template<typename Monoid>
+      struct MonoidAugmentation :
+        public _private::MonoidInverse<Monoid, _private::MonoidHasSubtract<Monoid>::value> {
+        typedef typename Monoid::ValueType SummaryType;
+
+        template<typename NodeType>
+        static SummaryType leaf( NodeType const& aNode ) {
+          return Monoid::lift( aNode );
+        }
+
+        static void combine( SummaryType& aAcc, SummaryType const& aChild ) {
+          Monoid::combine( aAcc, aChild );
+        }
+      };
+
+      //=====================================================================
+      // Monoids
+      // Number of nodes in the subtree
+      struct SubtreeSize {
+        typedef std::size_t ValueType;
+
+        static ValueType identity( ) {
+          return 0;
+        }
+
+        template<typename NodeType>
+        static ValueType lift( NodeType const& ) {
+          return 1;
+        }
+
+        static void combine( ValueType& aAcc, ValueType const& aOther ) {
+          aAcc += aOther;
+        }
+
+        static void subtract( ValueType& aAcc, ValueType const& aOther ) {
+          aAcc -= aOther;
+        }
+      };
+
+      // Sum of the node values, nodes without data count as T( ). With
+      // floating point values the incremental updates accumulate rounding.
+      template<typename T>
+      struct SubtreeSum {
+        typedef T ValueType;
+
+        static ValueType identity( ) {
+          return ValueType( );
+        }
+
+        template<typename NodeType>
+        static ValueType lift( NodeType const& aNode ) {
+          return aNode ? ValueType( aNode.data( ) ) : identity( );
+        }
+
+        static void combine( ValueType& aAcc, ValueType const& aOther ) {
+          aAcc += aOther;
+        }
+
+        static void subtract( ValueType& aAcc, ValueType const& aOther ) {
+          aAcc -= aOther;
+        }
+      };
+
+      // Largest node value, lowest( ) for a subtree without data. Not
+      // invertible, so lowering the maximum rescans the siblings on the way
+      // up.
+      template<typename T>
+      struct SubtreeMax {
+        typedef T ValueType;
+
+        static ValueType identity( ) {
+          return std::numeric_limits<ValueType>::lowest( );
+        }
+
+        template<typename NodeType>
+        static ValueType lift( NodeType const& aNode ) {
+          return aNode ? ValueType( aNode.data( ) ) : identity( );
+        }
+
+        static void combine( ValueType& aAcc, ValueType const& aOther ) {
+          if ( aAcc < aOther ) {
+            aAcc = aOther;
+          }
+        }
+      };
+
+      // Node that carries the Monoid aggregate of its subtree
+      template<typename NodeDataType, typename Monoid>
+      using AggregateNode = Node<NodeDataType, std::allocator<NodeDataType>, std::allocator, MonoidAugmentation<Monoid>>;
+
+      template<typename NodeType>
+      typename NodeType::SummaryType const& subtreeAggregate( NodeType const& aNode ) {
+        return aNode.summary( );
+      }
+
+      template<typename NodeType>
+      typename NodeType::SummaryType const& subtreeAggregate( NTree<NodeType> const& aTree ) {
+        return aTree.root( ).summary( );
+      }
+    }
+  }
+}
@@ -0,0 +1,522 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+// Succinct NTree: immutable tree whose topology is a balanced parentheses
+// (BP) sequence of 2n bits. A node is identified by the position of its
+// open parenthesis, the root is position 0.
+//
+//   rank / select    512 bit superblocks, ~12.5% on top of the 2n bits
+//   rmM tree         minimum excess per 512 bit block, ~12.5% more
+//
+// Depth, preorder rank, first child and leaf tests are O(1). Next sibling,
+// parent and subtree size need a matching parenthesis search; it is answered
+// inside one block with byte tables, and only crosses blocks through the rmM
+// tree (O(log n) worst case, one block in the common case).
+// Payloads live in a separate array in preorder.
+namespace blib {
+  namespace container {
+    namespace tree {
+      namespace _private {
+        inline unsigned popcount64( std::uint64_t aWord ) {
+#if defined( _MSC_VER ) && defined( _M_X64 )
+          return static_cast< unsigned >( __popcnt64( aWord ) );
+#elif defined( __GNUC__ )
+          return static_cast< unsigned >( __builtin_popcountll( aWord ) );
+#else
+          aWord = aWord - ( ( aWord >> 1 ) & 0x5555555555555555ULL );
+          aWord = ( aWord & 0x3333333333333333ULL ) + ( ( aWord >> 2 ) & 0x3333333333333333ULL );
+          aWord = ( aWord + ( aWord >> 4 ) ) & 0x0F0F0F0F0F0F0F0FULL;
+          return static_cast< unsigned >( ( aWord * 0x0101010101010101ULL ) >> 56 );
+#endif
+        }
+
+        //=====================================================================
+        // Excess tables for one byte, bits are read least significant first.
+        // '(' is +1 and ')' is -1.
+        struct ByteExcessTable {
+          signed char total[ 256 ];
+          signed char minPrefix[ 256 ];
+
+          ByteExcessTable( ) {
+            for ( int b = 0; b < 256; ++b ) {
+              int e = 0;
+              int m = 8;
+              for ( int i = 0; i < 8; ++i ) {
+                e += ( ( b >> i ) & 1 ) ? 1 : -1;
+                if ( e < m ) {
+                  m = e;
+                }
+              }
+              total[ b ] = static_cast< signed char >( e );
+              minPrefix[ b ] = static_cast< signed char >( m );
+            }
+          }
+
+          static ByteExcessTable const& instance( ) {
+            static const ByteExcessTable table;
+            return table;
+          }
+        };
+
+        //=====================================================================
+        // Balanced parentheses bit vector with rank, select and rmM search
+        class BalancedParentheses {
+        public:
+          typedef std::int64_t Position;
+
+          static const std::size_t BlockBits = 512;
+          static const std::size_t WordsPerBlock = BlockBits / 64;
+
+        private:
+          std::vector<std::uint64_t> _words;
+          std::size_t _size;
+          // Number of ones before each block
+          std::vector<std::uint64_t> _rank;
+          // Block holding every BlockBits-th one
+          std::vector<std::uint32_t> _selectSamples;
+          // Min excess segment tree over the blocks, leaves start at _leaves
+          std::vector<std::int32_t> _rmm;
+          std::size_t _leaves;
+
+        public:
+          BalancedParentheses( ) :
+            _size( 0 ), _leaves( 0 ) {}
+
+          void push_back( bool aOpen ) {
+            if ( _size % 64 == 0 ) {
+              _words.push_back( 0 );
+            }
+            if ( aOpen ) {
+              _words.back( ) |= std::uint64_t( 1 ) << ( _size % 64 );
+            }
+            ++_size;
+          }
+
+          std::size_t size( ) const {
+            return _size;
+          }
+
+          bool operator[]( std::size_t aPos ) const {
+            return ( ( _words[ aPos / 64 ] >> ( aPos % 64 ) ) & 1 ) != 0;
+          }
+
+          std::size_t bytes( ) const {
+            return _words.capacity( ) * sizeof( std::uint64_t ) +
+              _rank.capacity( ) * sizeof( std::uint64_t ) +
+              _selectSamples.capacity( ) * sizeof( std::uint32_t ) +
+              _rmm.capacity( ) * sizeof( std::int32_t );
+          }
+
+          // Build the rank, select and rmM directories, call once after
+          // the last push_back.
+          void seal( ) {
+            _words.shrink_to_fit( );
+            const std::size_t blocks = ( _size + BlockBits - 1 ) / BlockBits;
+            _rank.assign( blocks + 1, 0 );
+            _selectSamples.clear( );
+
+            std::uint64_t ones = 0;
+            for ( std::size_t b = 0; b < blocks; ++b ) {
+              _rank[ b ] = ones;
+              for ( std::size_t w = b * WordsPerBlock; w < ( b + 1 ) * WordsPerBlock && w < _words.size( ); ++w ) {
+                const std::uint64_t before = ones;
+                ones += popcount64( _words[ w ] );
+                // Sample the block of every BlockBits-th one
+                while ( _selectSamples.size( ) * BlockBits < ones &&
+                        _selectSamples.size( ) * BlockBits >= before ) {
+                  _selectSamples.push_back( static_cast< std::uint32_t >( b ) );
+                }
+              }
+            }
+            _rank[ blocks ] = ones;
+
+            _leaves = 1;
+            while ( _leaves < blocks ) {
+              _leaves <<= 1;
+            }
+            _rmm.assign( 2 * _leaves, std::numeric_limits<std::int32_t>::max( ) );
+            ByteExcessTable const& table = ByteExcessTable::instance( );
+            std::int64_t e = 0;
+            for ( std::size_t b = 0; b < blocks; ++b ) {
+              std::int64_t m = std::numeric_limits<std::int32_t>::max( );
+              const std::size_t end = ( b + 1 ) * BlockBits < _size ? ( b + 1 ) * BlockBits : _size;
+              std::size_t p = b * BlockBits;
+              for ( ; p + 8 <= end; p += 8 ) {
+                const unsigned byte = byteAt( p );
+                if ( e + table.minPrefix[ byte ] < m ) {
+                  m = e + table.minPrefix[ byte ];
+                }
+                e += table.total[ byte ];
+              }
+              for ( ; p < end; ++p ) {
+                e += ( *this )[ p ] ? 1 : -1;
+                if ( e < m ) {
+                  m = e;
+                }
+              }
+              _rmm[ _leaves + b ] = static_cast< std::int32_t >( m );
+            }
+            for ( std::size_t n = _leaves; n-- > 1; ) {
+              _rmm[ n ] = _rmm[ 2 * n ] < _rmm[ 2 * n + 1 ] ? _rmm[ 2 * n ] : _rmm[ 2 * n + 1 ];
+            }
+          }
+
+          // Number of ones in [ 0, aPos )
+          std::uint64_t rank1( std::size_t aPos ) const {
+            const std::size_t block = aPos / BlockBits;
+            std::uint64_t ret = _rank[ block ];
+            const std::size_t word = aPos / 64;
+            for ( std::size_t w = block * WordsPerBlock; w < word; ++w ) {
+              ret += popcount64( _words[ w ] );
+            }
+            if ( aPos % 64 ) {
+              ret += popcount64( _words[ word ] & ( ( std::uint64_t( 1 ) << ( aPos % 64 ) ) - 1 ) );
+            }
+            return ret;
+          }
+
+          // Position of the aRank-th one, counting from zero
+          std::size_t select1( std::uint64_t aRank ) const {
+            std::size_t block = _selectSamples[ aRank / BlockBits ];
+            while ( block + 1 < _rank.size( ) - 1 && _rank[ block + 1 ] <= aRank ) {
+              ++block;
+            }
+            std::uint64_t left = aRank - _rank[ block ];
+            std::size_t w = block * WordsPerBlock;
+            for ( ;; ++w ) {
+              const unsigned c = popcount64( _words[ w ] );
+              if ( left < c ) {
+                break;
+              }
+              left -= c;
+            }
+            std::uint64_t word = _words[ w ];
+            for ( ; left; --left ) {
+              word &= word - 1;
+            }
+            std::size_t bit = 0;
+            while ( !( ( word >> bit ) & 1 ) ) {
+              ++bit;
+            }
+            return w * 64 + bit;
+          }
+
+          // Excess after aPos: opens minus closes in [ 0, aPos ]
+          Position excess( Position aPos ) const {
+            const Position len = aPos + 1;
+            return 2 * static_cast< Position >( rank1( static_cast< std::size_t >( len ) ) ) - len;
+          }
+
+          // Smallest j > aPos with excess( j ) == aTarget, aTarget below
+          // excess( aPos ). Returns -2 when there is none.
+          Position fwdSearch( Position aPos, Position aTarget ) const {
+            Position cur = excess( aPos );
+            std::size_t block = static_cast< std::size_t >( aPos ) / BlockBits;
+            Position ret = scanForward( aPos + 1, blockEnd( block ), cur, aTarget );
+            if ( ret == -2 ) {
+              block = nextBlock( block, aTarget );
+              if ( block != npos( ) ) {
+                const Position start = static_cast< Position >( block * BlockBits );
+                cur = excess( start - 1 );
+                ret = scanForward( start, blockEnd( block ), cur, aTarget );
+              }
+            }
+            return ret;
+          }
+
+          // Largest j < aPos with excess( j ) == aTarget, aTarget below
+          // excess( aPos - 1 ). j == -1 stands for the empty prefix.
+          // Returns -2 when there is none.
+          Position bwdSearch( Position aPos, Position aTarget ) const {
+            if ( aPos == 0 ) {
+              return aTarget == 0 ? -1 : -2;
+            }
+            std::size_t block = static_cast< std::size_t >( aPos - 1 ) / BlockBits;
+            Position cur = excess( aPos - 1 );
+            Position ret = scanBackward( aPos - 1, static_cast< Position >( block * BlockBits ), cur, aTarget );
+            if ( ret == -2 ) {
+              block = prevBlock( block, aTarget );
+              if ( block != npos( ) ) {
+                const Position last = blockEnd( block ) - 1;
+                cur = excess( last );
+                ret = scanBackward( last, static_cast< Position >( block * BlockBits ), cur, aTarget );
+              }
+              else if ( aTarget == 0 ) {
+                ret = -1;
+              }
+            }
+            return ret;
+          }
+
+        private:
+          static std::size_t npos( ) {
+            return static_cast< std::size_t >( -1 );
+          }
+
+          Position blockEnd( std::size_t aBlock ) const {
+            const std::size_t end = ( aBlock + 1 ) * BlockBits;
+            return static_cast< Position >( end < _size ? end : _size );
+          }
+
+          unsigned byteAt( std::size_t aPos ) const {
+            return static_cast< unsigned >( ( _words[ aPos / 64 ] >> ( aPos % 64 ) ) & 0xFF );
+          }
+
+          int delta( Position aPos ) const {
+            return ( *this )[ static_cast< std::size_t >( aPos ) ] ? 1 : -1;
+          }
+
+          // aCur is the excess at aFrom - 1
+          Position scanForward( Position aFrom, Position aEnd, Position aCur, Position aTarget ) const {
+            ByteExcessTable const& table = ByteExcessTable::instance( );
+            Position p = aFrom;
+            while ( p < aEnd ) {
+              if ( p % 8 == 0 && p + 8 <= aEnd ) {
+                const unsigned byte = byteAt( static_cast< std::size_t >( p ) );
+                if ( aCur + table.minPrefix[ byte ] > aTarget ) {
+                  aCur += table.total[ byte ];
+                  p += 8;
+                  continue;
+                }
+              }
+              aCur += delta( p );
+              if ( aCur == aTarget ) {
+                return p;
+              }
+              ++p;
+            }
+            return -2;
+          }
+
+          // aCur is the excess at aFrom, positions aFrom down to aStart are tested
+          Position scanBackward( Position aFrom, Position aStart, Position aCur, Position aTarget ) const {
+            ByteExcessTable const& table = ByteExcessTable::instance( );
+            Position p = aFrom;
+            while ( p >= aStart ) {
+              if ( ( p + 1 ) % 8 == 0 && p - 7 >= aStart ) {
+                const unsigned byte = byteAt( static_cast< std::size_t >( p - 7 ) );
+                const Position before = aCur - table.total[ byte ];
+                if ( before + table.minPrefix[ byte ] > aTarget ) {
+                  aCur = before;
+                  p -= 8;
+                  continue;
+                }
+              }
+              if ( aCur == aTarget ) {
+                return p;
+              }
+              aCur -= delta( p );
+              --p;
+            }
+            return -2;
+          }
+
+          std::size_t nextBlock( std::size_t aBlock, Position aTarget ) const {
+            std::size_t n = _leaves + aBlock;
+            while ( n > 1 ) {
+              if ( n % 2 == 0 && _rmm[ n + 1 ] <= aTarget ) {
+                n = n + 1;
+                while ( n < _leaves ) {
+                  n = _rmm[ 2 * n ] <= aTarget ? 2 * n : 2 * n + 1;
+                }
+                return n - _leaves;
+              }
+              n /= 2;
+            }
+            return npos( );
+          }
+
+          std::size_t prevBlock( std::size_t aBlock, Position aTarget ) const {
+            std::size_t n = _leaves + aBlock;
+            while ( n > 1 ) {
+              if ( n % 2 == 1 && _rmm[ n - 1 ] <= aTarget ) {
+                n = n - 1;
+                while ( n < _leaves ) {
+                  n = _rmm[ 2 * n + 1 ] <= aTarget ? 2 * n + 1 : 2 * n;
+                }
+                return n - _leaves;
+              }
+              n /= 2;
+            }
+            return npos( );
+          }
+        };
+      } // _private
+
+      //=====================================================================
+      // Succinct NTree
+      template<typename NodeDataType>
+      class SuccinctNTree {
+      public:
+        typedef NodeDataType ValueType;
+        typedef ValueType const& ConstValueRef;
+        // Position of the node's open parenthesis
+        typedef std::uint64_t NodeId;
+        typedef SuccinctNTree<ValueType> SelfType;
+
+        static const NodeId npos = static_cast< NodeId >( -1 );
+
+      private:
+        typedef _private::BalancedParentheses Parentheses;
+        typedef Parentheses::Position Position;
+
+        Parentheses _bp;
+        std::vector<ValueType> _values;
+
+      public:
+        SuccinctNTree( ) {}
+
+        // Nodes without data are stored with a value initialized ValueType.
+        template<typename TreeType>
+        explicit SuccinctNTree( TreeType& aTree ) {
+          build( aTree.root( ) );
+        }
+
+        std::size_t size( ) const {
+          return _values.size( );
+        }
+
+        bool empty( ) const {
+          return _values.empty( );
+        }
+
+        NodeId root( ) const {
+          return empty( ) ? npos : 0;
+        }
+
+        // Preorder rank of the node, also the index into values( )
+        std::size_t preorder( NodeId aNode ) const {
+          return static_cast< std::size_t >( _bp.rank1( static_cast< std::size_t >( aNode ) ) );
+        }
+
+        // Node with the given preorder rank
+        NodeId node( std::size_t aPreorder ) const {
+          return _bp.select1( aPreorder );
+        }
+
+        ConstValueRef data( NodeId aNode ) const {
+          return _values[ preorder( aNode ) ];
+        }
+
+        std::vector<ValueType> const& values( ) const {
+          return _values;
+        }
+
+        bool isLeaf( NodeId aNode ) const {
+          return !_bp[ static_cast< std::size_t >( aNode ) + 1 ];
+        }
+
+        // Root has depth 0
+        std::size_t depth( NodeId aNode ) const {
+          return static_cast< std::size_t >( _bp.excess( static_cast< Position >( aNode ) ) - 1 );
+        }
+
+        NodeId firstChild( NodeId aNode ) const {
+          return isLeaf( aNode ) ? npos : aNode + 1;
+        }
+
+        NodeId nextSibling( NodeId aNode ) const {
+          NodeId ret = npos;
+          const std::size_t next = static_cast< std::size_t >( findClose( aNode ) ) + 1;
+          if ( next < _bp.size( ) && _bp[ next ] ) {
+            ret = next;
+          }
+          return ret;
+        }
+
+        NodeId parent( NodeId aNode ) const {
+          NodeId ret = npos;
+          if ( aNode != 0 ) {
+            const Position pos = static_cast< Position >( aNode );
+            ret = static_cast< NodeId >( _bp.bwdSearch( pos, _bp.excess( pos ) - 2 ) + 1 );
+          }
+          return ret;
+        }
+
+        // Number of nodes in the subtree, the node included
+        std::size_t subtreeSize( NodeId aNode ) const {
+          return static_cast< std::size_t >( ( findClose( aNode ) - aNode + 1 ) / 2 );
+        }
+
+        std::size_t numberOfChildren( NodeId aNode ) const {
+          std::size_t ret = 0;
+          for ( NodeId c = firstChild( aNode ); c != npos; c = nextSibling( c ) ) {
+            ++ret;
+          }
+          return ret;
+        }
+
+        // Bytes used by the topology, directories included
+        std::size_t topologyBytes( ) const {
+          return _bp.bytes( );
+        }
+
+        std::size_t valueBytes( ) const {
+          return _values.capacity( ) * sizeof( ValueType );
+        }
+
+      private:
+        NodeId findClose( NodeId aNode ) const {
+          const Position pos = static_cast< Position >( aNode );
+          return static_cast< NodeId >( _bp.fwdSearch( pos, _bp.excess( pos ) - 1 ) );
+        }
+
+        // Iterative DFS writing '(' and the payload on entry and ')' on exit
+        template<typename NodeType>
+        void build( NodeType& aRoot ) {
+          typedef typename NodeType::child_node_ltor_iterator ChildIterator;
+          typedef std::pair<NodeType*, ChildIterator> Entry;
+
+          if ( !aRoot && !aRoot.hasChildren( ) ) {
+            return;
+          }
+
+          std::vector<Entry> stack;
+          enter( aRoot );
+          stack.push_back( Entry( &aRoot, aRoot.begin( ) ) );
+          while ( !stack.empty( ) ) {
+            Entry& top = stack.back( );
+            if ( top.second != top.first->end( ) ) {
+              NodeType& child = *top.second;
+              ++top.second;
+              enter( child );
+              stack.push_back( Entry( &child, child.begin( ) ) );
+            }
+            else {
+              _bp.push_back( false );
+              stack.pop_back( );
+            }
+          }
+          _bp.seal( );
+          _values.shrink_to_fit( );
+        }
+
+        template<typename NodeType>
+        void enter( NodeType& aNode ) {
+          if ( _values.size( ) >= static_cast< std::size_t >( std::numeric_limits<std::int32_t>::max( ) ) ) {
+            throw std::length_error( "SuccinctNTree: too many nodes" );
+          }
+          _bp.push_back( true );
+          _values.push_back( aNode ? aNode.data( ) : ValueType( ) );
+        }
+      };
+
+      template<typename NodeDataType>
+      const typename SuccinctNTree<NodeDataType>::NodeId SuccinctNTree<NodeDataType>::npos;
+    }
+  }
+}
@@ -0,0 +1,441 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "NTree.hpp"
+#include "MerkleHash.hpp"
+
+// Tree diff: computes an edit script that turns one NTree into another.
+//
+// Children are matched per parent in three rounds: identical subtree
+// hashes, equal keys, then leftovers of the same shape by position.
+// Matched children keep their place when they lie on the longest
+// increasing run of old positions, the others become moves, so the number
+// of moves among siblings is minimal for the matching.
+//
+// With MerkleHash nodes identical subtrees are skipped in O(1), and the
+// cost follows the changed region: the ancestors of the changes and the
+// children lists along them. Other node types are compared node by node.
+//
+// Paths are child indices from the root and are valid at the time the
+// operation is replayed, so EditScript::apply( ) simply runs in order.
+namespace blib {
+  namespace container {
+    namespace tree {
+      enum class EditKind {
+        Insert,  // insert node at index under path
+        Delete,  // delete the subtree at path
+        Relabel, // give the node at path the value of node
+        Move,    // move child from index to index under path
+        Clear    // take the value away from the node at path
+      };
+
+      template<typename NodeType>
+      struct EditOperation {
+        typedef std::vector<std::size_t> Path;
+
+        EditKind kind;
+        Path path;
+        std::size_t from;
+        std::size_t index;
+        // Insert: the subtree, shared with the new tree; apply( ) inserts a
+        // deep copy of it. Relabel: the new node.
+        NodeType node;
+
+        EditOperation( EditKind aKind, Path const& aPath, std::size_t aFrom = 0,
+                       std::size_t aIndex = 0, NodeType const& aNode = NodeType( ) ) :
+          kind( aKind ), path( aPath ), from( aFrom ), index( aIndex ), node( aNode ) {}
+      };
+
+      // Default key: the node value
+      struct ValueDiffKey {
+        template<typename NodeType>
+        typename NodeType::ValueType operator()( NodeType const& aNode ) const {
+          return aNode ? aNode.data( ) : typename NodeType::ValueType( );
+        }
+      };
+
+      namespace _private {
+        template<typename AugmentPolicy>
+        struct HasSubtreeHash : std::false_type {};
+
+        template<template<typename> class Hash>
+        struct HasSubtreeHash<MerkleHash<Hash>> : std::true_type {};
+
+        template<typename NodeType, bool = HasSubtreeHash<typename NodeType::AugmentPolicyType>::value>
+        struct SubtreeIdentity {
+          static bool enabled( ) {
+            return false;
+          }
+
+          static bool same( NodeType const&, NodeType const& ) {
+            return false;
+          }
+
+          static std::uint64_t hash( NodeType const& ) {
+            return 0;
+          }
+        };
+
+        template<typename NodeType>
+        struct SubtreeIdentity<NodeType, true> {
+          static bool enabled( ) {
+            return true;
+          }
+
+          static bool same( NodeType const& aLeft, NodeType const& aRight ) {
+            return aLeft.summary( ) == aRight.summary( );
+          }
+
+          static std::uint64_t hash( NodeType const& aNode ) {
+            return aNode.summary( );
+          }
+        };
+      } // _private
+
+      //=====================================================================
+      // Edit Script
+      template<typename NodeType>
+      class EditScript {
+      public:
+        typedef EditOperation<NodeType> Operation;
+        typedef typename Operation::Path Path;
+        typedef std::vector<Operation> Operations;
+        typedef typename Operations::const_iterator const_iterator;
+
+      private:
+        Operations _ops;
+
+      public:
+        void push_back( Operation const& aOp ) {
+          _ops.push_back( aOp );
+        }
+
+        std::size_t size( ) const {
+          return _ops.size( );
+        }
+
+        bool empty( ) const {
+          return _ops.empty( );
+        }
+
+        Operation const& operator[]( std::size_t aIndex ) const {
+          return _ops[ aIndex ];
+        }
+
+        const_iterator begin( ) const {
+          return _ops.begin( );
+        }
+
+        const_iterator end( ) const {
+          return _ops.end( );
+        }
+
+        // Replay onto the tree the script was computed from
+        void apply( NTree<NodeType>& aTree ) const {
+          for ( auto const& op : _ops ) {
+            switch ( op.kind ) {
+            case EditKind::Insert: {
+              // Nothing of the new tree ends up shared with aTree
+              NodeType& parent = resolve( aTree.root( ), op.path, op.path.size( ) );
+              const NTree<NodeType> subtree = SubtreeView<NodeType const>( op.node ).deep_clone( );
+              parent.insertChild( child( parent, op.index ), subtree.root( ) );
+              break;
+            }
+            case EditKind::Delete: {
+              if ( op.path.empty( ) ) {
+                throw std::invalid_argument( "EditScript: cannot delete the root" );
+              }
+              NodeType& parent = resolve( aTree.root( ), op.path, op.path.size( ) - 1 );
+              parent.removeChild( child( parent, op.path.back( ) ) );
+              break;
+            }
+            case EditKind::Relabel: {
+              NodeType& node = resolve( aTree.root( ), op.path, op.path.size( ) );
+              node.data( op.node.data( ) );
+              break;
+            }
+            case EditKind::Move: {
+              NodeType& parent = resolve( aTree.root( ), op.path, op.path.size( ) );
+              const NodeType moved( parent[ op.from ] );
+              parent.removeChild( child( parent, op.from ) );
+              parent.insertChild( child( parent, op.index ), moved );
+              break;
+            }
+            case EditKind::Clear: {
+              resolve( aTree.root( ), op.path, op.path.size( ) ).clearData( );
+              break;
+            }
+            }
+          }
+        }
+
+      private:
+        static NodeType& resolve( NodeType& aRoot, Path const& aPath, std::size_t aLength ) {
+          NodeType* n = &aRoot;
+          for ( std::size_t i = 0; i < aLength; ++i ) {
+            n = &( *n )[ aPath[ i ] ];
+          }
+          return *n;
+        }
+
+        static typename NodeType::child_node_ltor_iterator child( NodeType& aParent, std::size_t aIndex ) {
+          return std::next( aParent.begin( ), static_cast< std::ptrdiff_t >( aIndex ) );
+        }
+      };
+
+      //=====================================================================
+      // Tree Diff
+      template<typename NodeType, typename KeyFn = ValueDiffKey>
+      class TreeDiff {
+      public:
+        typedef EditScript<NodeType> Script;
+        typedef typename Script::Operation Operation;
+        typedef typename Script::Path Path;
+        typedef typename std::decay<decltype( std::declval<KeyFn&>( )( std::declval<NodeType const&>( ) ) )>::type KeyType;
+
+      private:
+        typedef _private::SubtreeIdentity<NodeType> Identity;
+        typedef _private::NodeUtility::ChildrenType<NodeType> Children;
+
+        static const std::size_t Unmatched = static_cast< std::size_t >( -1 );
+
+        KeyFn _key;
+        Script _script;
+
+      public:
+        explicit TreeDiff( KeyFn aKey = KeyFn( ) ) :
+          _key( aKey ) {}
+
+        Script diff( NodeType const& aOld, NodeType const& aNew ) {
+          _script = Script( );
+          Path path;
+          diffNode( aOld, aNew, path );
+          return _script;
+        }
+
+        Script diff( NTree<NodeType> const& aOld, NTree<NodeType> const& aNew ) {
+          return diff( aOld.root( ), aNew.root( ) );
+        }
+
+      private:
+        static bool sameValue( NodeType const& aLeft, NodeType const& aRight ) {
+          return bool( aLeft ) == bool( aRight ) && ( !aLeft || aLeft.data( ) == aRight.data( ) );
+        }
+
+        static bool sameShape( NodeType const& aLeft, NodeType const& aRight ) {
+          return aLeft.numberOfChildren( ) == aRight.numberOfChildren( );
+        }
+
+        void diffNode( NodeType const& aOld, NodeType const& aNew, Path& aPath ) {
+          if ( Identity::same( aOld, aNew ) ) {
+            return;
+          }
+          if ( !sameValue( aOld, aNew ) ) {
+            _script.push_back( aNew ? Operation( EditKind::Relabel, aPath, 0, 0, aNew ) : Operation( EditKind::Clear, aPath ) );
+          }
+          diffChildren( aOld, aNew, aPath );
+        }
+
+        void diffChildren( NodeType const& aOld, NodeType const& aNew, Path& aPath ) {
+          Children const& oc = _private::NodeUtility::children( aOld );
+          Children const& nc = _private::NodeUtility::children( aNew );
+
+          // Identical prefix and suffix need no matching at all
+          std::size_t head = 0;
+          while ( head < oc.size( ) && head < nc.size( ) && Identity::same( oc[ head ], nc[ head ] ) ) {
+            ++head;
+          }
+          std::size_t tail = 0;
+          while ( tail < oc.size( ) - head && tail < nc.size( ) - head &&
+                  Identity::same( oc[ oc.size( ) - 1 - tail ], nc[ nc.size( ) - 1 - tail ] ) ) {
+            ++tail;
+          }
+          const std::size_t oldCount = oc.size( ) - head - tail;
+          const std::size_t newCount = nc.size( ) - head - tail;
+          if ( oldCount == 0 && newCount == 0 ) {
+            return;
+          }
+
+          // match[ new ] = old, both relative to head
+          std::vector<std::size_t> match( newCount, Unmatched );
+          std::vector<bool> oldUsed( oldCount, false );
+          std::vector<bool> recurse( newCount, false );
+
+          if ( Identity::enabled( ) ) {
+            std::unordered_multimap<std::uint64_t, std::size_t> byHash;
+            for ( std::size_t i = oldCount; i-- > 0; ) {
+              byHash.insert( std::make_pair( Identity::hash( oc[ head + i ] ), i ) );
+            }
+            for ( std::size_t j = 0; j < newCount; ++j ) {
+              auto range = byHash.equal_range( Identity::hash( nc[ head + j ] ) );
+              for ( auto it = range.first; it != range.second; ++it ) {
+                if ( !oldUsed[ it->second ] ) {
+                  oldUsed[ it->second ] = true;
+                  match[ j ] = it->second;
+                  break;
+                }
+              }
+            }
+          }
+
+          {
+            std::unordered_map<KeyType, std::vector<std::size_t>> byKey;
+            for ( std::size_t i = oldCount; i-- > 0; ) {
+              if ( !oldUsed[ i ] ) {
+                byKey[ _key( oc[ head + i ] ) ].push_back( i );
+              }
+            }
+            for ( std::size_t j = 0; j < newCount; ++j ) {
+              if ( match[ j ] != Unmatched ) {
+                continue;
+              }
+              auto it = byKey.find( _key( nc[ head + j ] ) );
+              if ( it != byKey.end( ) && !it->second.empty( ) ) {
+                match[ j ] = it->second.back( );
+                it->second.pop_back( );
+                oldUsed[ match[ j ] ] = true;
+                recurse[ j ] = true;
+              }
+            }
+          }
+
+          // Leftovers of the same shape are paired in order and relabelled
+          {
+            std::size_t i = 0;
+            for ( std::size_t j = 0; j < newCount; ++j ) {
+              if ( match[ j ] != Unmatched ) {
+                continue;
+              }
+              while ( i < oldCount && oldUsed[ i ] ) {
+                ++i;
+              }
+              if ( i == oldCount ) {
+                break;
+              }
+              if ( sameShape( oc[ head + i ], nc[ head + j ] ) ) {
+                match[ j ] = i;
+                oldUsed[ i ] = true;
+                recurse[ j ] = true;
+              }
+            }
+          }
+
+          // Deletes, last first so the earlier indices stay valid
+          for ( std::size_t i = oldCount; i-- > 0; ) {
+            if ( !oldUsed[ i ] ) {
+              aPath.push_back( head + i );
+              _script.push_back( Operation( EditKind::Delete, aPath ) );
+              aPath.pop_back( );
+            }
+          }
+
+          place( nc, head, match, aPath );
+
+          for ( std::size_t j = 0; j < newCount; ++j ) {
+            if ( recurse[ j ] ) {
+              aPath.push_back( head + j );
+              diffNode( oc[ head + match[ j ] ], nc[ head + j ], aPath );
+              aPath.pop_back( );
+            }
+          }
+        }
+
+        // Marks the matched children on a longest increasing run of old
+        // positions, those stay where they are.
+        static std::vector<bool> stable( std::vector<std::size_t> const& aMatch ) {
+          std::vector<std::size_t> tails;
+          std::vector<std::size_t> tailIndex;
+          std::vector<std::size_t> previous( aMatch.size( ), Unmatched );
+          for ( std::size_t j = 0; j < aMatch.size( ); ++j ) {
+            if ( aMatch[ j ] == Unmatched ) {
+              continue;
+            }
+            const std::size_t k = static_cast< std::size_t >(
+              std::lower_bound( tails.begin( ), tails.end( ), aMatch[ j ] ) - tails.begin( ) );
+            if ( k == tails.size( ) ) {
+              tails.push_back( aMatch[ j ] );
+              tailIndex.push_back( j );
+            }
+            else {
+              tails[ k ] = aMatch[ j ];
+              tailIndex[ k ] = j;
+            }
+            previous[ j ] = k ? tailIndex[ k - 1 ] : Unmatched;
+          }
+          std::vector<bool> ret( aMatch.size( ), false );
+          for ( std::size_t j = tailIndex.empty( ) ? Unmatched : tailIndex.back( ); j != Unmatched; j = previous[ j ] ) {
+            ret[ j ] = true;
+          }
+          return ret;
+        }
+
+        // Builds the new order right to left: every child is placed in front
+        // of the one after it, which is already final.
+        void place( Children const& aNew, std::size_t aHead,
+                    std::vector<std::size_t> const& aMatch, Path const& aPath ) {
+          const std::vector<bool> keep = stable( aMatch );
+
+          // Simulated children list relative to head: old index, or
+          // Unmatched for inserted nodes
+          std::vector<std::size_t> cur;
+          for ( std::size_t j = 0; j < aMatch.size( ); ++j ) {
+            if ( aMatch[ j ] != Unmatched ) {
+              cur.push_back( aMatch[ j ] );
+            }
+          }
+          std::sort( cur.begin( ), cur.end( ) );
+
+          std::size_t anchor = cur.size( );
+          for ( std::size_t j = aMatch.size( ); j-- > 0; ) {
+            if ( aMatch[ j ] == Unmatched ) {
+              cur.insert( cur.begin( ) + static_cast< std::ptrdiff_t >( anchor ), Unmatched );
+              _script.push_back( Operation( EditKind::Insert, aPath, 0, aHead + anchor, aNew[ aHead + j ] ) );
+              continue;
+            }
+            const std::size_t p = static_cast< std::size_t >(
+              std::find( cur.begin( ), cur.end( ), aMatch[ j ] ) - cur.begin( ) );
+            if ( keep[ j ] ) {
+              anchor = p;
+              continue;
+            }
+            const std::size_t target = p < anchor ? anchor - 1 : anchor;
+            if ( p != target ) {
+              cur.erase( cur.begin( ) + static_cast< std::ptrdiff_t >( p ) );
+              cur.insert( cur.begin( ) + static_cast< std::ptrdiff_t >( target ), aMatch[ j ] );
+              _script.push_back( Operation( EditKind::Move, aPath, aHead + p, aHead + target ) );
+            }
+            anchor = target;
+          }
+        }
+      };
+
+      template<typename NodeType, typename KeyFn>
+      const std::size_t TreeDiff<NodeType, KeyFn>::Unmatched;
+
+      // Edit script turning aOld into aNew, see TreeDiff
+      template<typename NodeType>
+      EditScript<NodeType> diff( NTree<NodeType> const& aOld, NTree<NodeType> const& aNew ) {
+        TreeDiff<NodeType> engine;
+        return engine.diff( aOld, aNew );
+      }
+
+      template<typename NodeType, typename KeyFn>
+      EditScript<NodeType> diff( NTree<NodeType> const& aOld, NTree<NodeType> const& aNew, KeyFn aKey ) {
+        TreeDiff<NodeType, KeyFn> engine( aKey );
+        return engine.diff( aOld, aNew );
+      }
+    }
+  }
+}
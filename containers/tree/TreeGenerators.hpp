@@ -0,0 +1,327 @@
+#pragma once
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+// Author: BrainlessLibraries
+
+#include "NTree.hpp"
+
+// Lazy traversals as C++20 coroutines, one co_yield per node.
+//
+//   for ( auto& n : preOrderNodes( tree ) | std::views::take( 10 ) ) ...
+//
+// A generator is a std::ranges view, so it composes with the standard
+// range adaptors, and the walk only advances when the consumer pulls. The
+// walk state lives in the coroutine frame: pre and post order keep one
+// ( node, next child ) pair per level, O(depth); level order has to keep
+// the current level, O(width).
+//
+// Every generator has an overload taking ( std::allocator_arg, pool ) in
+// front: the frame and the walk state are then allocated from that
+// std::pmr::memory_resource, for example an unsynchronized_pool_resource
+// that is reused across walks. The pool must outlive the generator.
+//
+// The tree must not change shape while a generator walks it. Only built
+// when the compiler supports coroutines.
+#if defined( __cpp_impl_coroutine )
+
+#include <coroutine>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <ranges>
+#include <utility>
+#include <vector>
+
+namespace blib {
+  namespace container {
+    namespace tree {
+      //=====================================================================
+      // Generator
+      template<typename NodeType>
+      class Generator :
+        public std::ranges::view_base {
+      public:
+        class promise_type;
+        typedef std::coroutine_handle<promise_type> Handle;
+
+        class promise_type {
+        private:
+          friend class Generator;
+
+          NodeType* _current = nullptr;
+          std::exception_ptr _exception;
+
+          // The pool is stored behind the frame, so delete knows where the
+          // frame came from
+          static std::size_t poolOffset( std::size_t aSize ) {
+            return ( aSize + alignof( std::pmr::memory_resource* ) - 1 ) & ~( alignof( std::pmr::memory_resource* ) - 1 );
+          }
+
+          static void* allocate( std::size_t aSize, std::pmr::memory_resource* aPool ) {
+            const std::size_t offset = poolOffset( aSize );
+            void* ret = aPool->allocate( offset + sizeof( aPool ), alignof( std::max_align_t ) );
+            std::memcpy( static_cast< char* >( ret ) + offset, &aPool, sizeof( aPool ) );
+            return ret;
+          }
+
+        public:
+          template<typename... Args>
+          static void* operator new( std::size_t aSize, std::allocator_arg_t, std::pmr::memory_resource* aPool, Args const&... ) {
+            return allocate( aSize, aPool );
+          }
+
+          template<typename... Args>
+          static void* operator new( std::size_t aSize, Args const&... ) {
+            return allocate( aSize, std::pmr::new_delete_resource( ) );
+          }
+
+          static void operator delete( void* aFrame, std::size_t aSize ) {
+            const std::size_t offset = poolOffset( aSize );
+            std::pmr::memory_resource* pool;
+            std::memcpy( &pool, static_cast< char* >( aFrame ) + offset, sizeof( pool ) );
+            pool->deallocate( aFrame, offset + sizeof( pool ), alignof( std::max_align_t ) );
+          }
+
+          Generator get_return_object( ) {
+            return Generator( Handle::from_promise( *this ) );
+          }
+
+          std::suspend_always initial_suspend( ) noexcept {
+            return {};
+          }
+
+          std::suspend_always final_suspend( ) noexcept {
+            return {};
+          }
+
+          std::suspend_always yield_value( NodeType& aNode ) noexcept {
+            _current = std::addressof( aNode );
+            return {};
+          }
+
+          void return_void( ) noexcept {}
+
+          void unhandled_exception( ) {
+            _exception = std::current_exception( );
+          }
+
+          // Generators only yield
+          template<typename T>
+          std::suspend_never await_transform( T&& ) = delete;
+        };
+
+        class iterator {
+        private:
+          Handle _handle;
+
+        public:
+          typedef std::input_iterator_tag iterator_concept;
+          typedef std::ptrdiff_t difference_type;
+          typedef NodeType value_type;
+
+          iterator( ) = default;
+
+          explicit iterator( Handle aHandle ) :
+            _handle( aHandle ) {}
+
+          NodeType& operator*( ) const {
+            return *_handle.promise( )._current;
+          }
+
+          NodeType* operator->( ) const {
+            return _handle.promise( )._current;
+          }
+
+          iterator& operator++( ) {
+            Generator::advance( _handle );
+            return *this;
+          }
+
+          void operator++( int ) {
+            ++*this;
+          }
+
+          friend bool operator==( iterator const& aIt, std::default_sentinel_t ) {
+            return !aIt._handle || aIt._handle.done( );
+          }
+        };
+
+      private:
+        Handle _handle;
+
+        static void advance( Handle aHandle ) {
+          aHandle.resume( );
+          if ( aHandle.promise( )._exception ) {
+            std::rethrow_exception( aHandle.promise( )._exception );
+          }
+        }
+
+        explicit Generator( Handle aHandle ) :
+          _handle( aHandle ) {}
+
+      public:
+        Generator( ) = default;
+
+        Generator( Generator&& aOther ) noexcept :
+          _handle( std::exchange( aOther._handle, nullptr ) ) {}
+
+        Generator& operator=( Generator&& aOther ) noexcept {
+          if ( this != &aOther ) {
+            if ( _handle ) {
+              _handle.destroy( );
+            }
+            _handle = std::exchange( aOther._handle, nullptr );
+          }
+          return *this;
+        }
+
+        ~Generator( ) {
+          if ( _handle ) {
+            _handle.destroy( );
+          }
+        }
+
+        // Starts the walk, a generator is iterated once
+        iterator begin( ) {
+          if ( _handle ) {
+            advance( _handle );
+          }
+          return iterator( _handle );
+        }
+
+        std::default_sentinel_t end( ) const noexcept {
+          return std::default_sentinel;
+        }
+      };
+
+      //=====================================================================
+      // Generators
+      template<typename NodeType, typename Select, typename Descend>
+      Generator<NodeType> walkNodes( std::allocator_arg_t, std::pmr::memory_resource* aPool,
+                                     NodeType& aRoot, Select aSelect, Descend aDescend ) {
+        typedef std::pair<NodeType*, std::size_t> Level;
+        std::pmr::vector<Level> stack( aPool );
+        if ( aSelect( static_cast< NodeType const& >( aRoot ) ) ) {
+          co_yield aRoot;
+        }
+        if ( aDescend( static_cast< NodeType const& >( aRoot ) ) ) {
+          stack.emplace_back( &aRoot, 0 );
+        }
+        while ( !stack.empty( ) ) {
+          auto& children = _private::NodeUtility::children( *stack.back( ).first );
+          if ( stack.back( ).second == children.size( ) ) {
+            stack.pop_back( );
+            continue;
+          }
+          NodeType& c = children[ stack.back( ).second++ ];
+          if ( aSelect( static_cast< NodeType const& >( c ) ) ) {
+            co_yield c;
+          }
+          if ( aDescend( static_cast< NodeType const& >( c ) ) ) {
+            stack.emplace_back( &c, 0 );
+          }
+        }
+      }
+
+      template<typename NodeType>
+      Generator<NodeType> preOrderNodes( std::allocator_arg_t, std::pmr::memory_resource* aPool, NodeType& aRoot ) {
+        typedef std::pair<NodeType*, std::size_t> Level;
+        std::pmr::vector<Level> stack( aPool );
+        co_yield aRoot;
+        stack.emplace_back( &aRoot, 0 );
+        while ( !stack.empty( ) ) {
+          auto& children = _private::NodeUtility::children( *stack.back( ).first );
+          if ( stack.back( ).second == children.size( ) ) {
+            stack.pop_back( );
+            continue;
+          }
+          NodeType& c = children[ stack.back( ).second++ ];
+          co_yield c;
+          stack.emplace_back( &c, 0 );
+        }
+      }
+
+      template<typename NodeType>
+      Generator<NodeType> postOrderNodes( std::allocator_arg_t, std::pmr::memory_resource* aPool, NodeType& aRoot ) {
+        typedef std::pair<NodeType*, std::size_t> Level;
+        std::pmr::vector<Level> stack( aPool );
+        stack.emplace_back( &aRoot, 0 );
+        while ( !stack.empty( ) ) {
+          NodeType& n = *stack.back( ).first;
+          auto& children = _private::NodeUtility::children( n );
+          if ( stack.back( ).second == children.size( ) ) {
+            stack.pop_back( );
+            co_yield n;
+            continue;
+          }
+          stack.emplace_back( &children[ stack.back( ).second++ ], 0 );
+        }
+      }
+
+      template<typename NodeType>
+      Generator<NodeType> levelOrderNodes( std::allocator_arg_t, std::pmr::memory_resource* aPool, NodeType& aRoot ) {
+        std::pmr::vector<NodeType*> level( aPool );
+        std::pmr::vector<NodeType*> next( aPool );
+        level.push_back( &aRoot );
+        while ( !level.empty( ) ) {
+          for ( NodeType* n : level ) {
+            co_yield *n;
+            for ( auto& c : _private::NodeUtility::children( *n ) ) {
+              next.push_back( &c );
+            }
+          }
+          level.swap( next );
+          next.clear( );
+        }
+      }
+
+      // Overloads on the default heap and on whole trees
+      template<typename NodeType, typename Select, typename Descend>
+      Generator<NodeType> walkNodes( NodeType& aRoot, Select aSelect, Descend aDescend ) {
+        return walkNodes( std::allocator_arg, std::pmr::new_delete_resource( ), aRoot, aSelect, aDescend );
+      }
+
+      template<typename NodeType, typename Select, typename Descend>
+      Generator<NodeType> walkNodes( NTree<NodeType>& aTree, Select aSelect, Descend aDescend ) {
+        return walkNodes( std::allocator_arg, std::pmr::new_delete_resource( ), aTree.root( ), aSelect, aDescend );
+      }
+
+      template<typename NodeType>
+      Generator<NodeType> preOrderNodes( NodeType& aRoot ) {
+        return preOrderNodes( std::allocator_arg, std::pmr::new_delete_resource( ), aRoot );
+      }
+
+      template<typename NodeType>
+      Generator<NodeType> preOrderNodes( NTree<NodeType>& aTree ) {
+        return preOrderNodes( std::allocator_arg, std::pmr::new_delete_resource( ), aTree.root( ) );
+      }
+
+      template<typename NodeType>
+      Generator<NodeType> postOrderNodes( NodeType& aRoot ) {
+        return postOrderNodes( std::allocator_arg, std::pmr::new_delete_resource( ), aRoot );
+      }
+
+      template<typename NodeType>
+      Generator<NodeType> postOrderNodes( NTree<NodeType>& aTree ) {
+        return postOrderNodes( std::allocator_arg, std::pmr::new_delete_resource( ), aTree.root( ) );
+      }
+
+      template<typename NodeType>
+      Generator<NodeType> levelOrderNodes( NodeType& aRoot ) {
+        return levelOrderNodes( std::allocator_arg, std::pmr::new_delete_resource( ), aRoot );
+      }
+
+      template<typename NodeType>
+      Generator<NodeType> levelOrderNodes( NTree<NodeType>& aTree ) {
+        return levelOrderNodes( std::allocator_arg, std::pmr::new_delete_resource( ), aTree.root( ) );
+      }
+    }
+  }
+}
+
+#endif
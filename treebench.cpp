@@ -0,0 +1,388 @@
+#include "containers/tree/NTree.hpp"
+#include "containers/tree/PrefetchTraversal.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// NTree benchmark driver.
+//
+//   treebench [maxNodes] [--chain-depth N] [--prefetch-distance N] [--csv]
+//
+// For every shape and every size from 10^3 up to maxNodes (default 10^6,
+// 10^8 for the full sweep) it times construction, the three traversals,
+// deep copy, removeChild, compaction and destruction, and prints one JSON
+// object per line (or CSV) so runs can be diffed across commits.
+//
+// The *_visit phases run the visitor traversals without prefetching and
+// the *_prefetch phases with --prefetch-distance (default 8); the gap only
+// shows once the tree is well past the last level cache, 10^6 nodes and up.
+//
+// Deep chains are capped at --chain-depth nodes (default 10^4): node
+// destruction is recursive, so a very deep chain overflows the stack.
+
+typedef blib::container::tree::Node<int> Node;
+typedef blib::container::tree::NTree<Node> Tree;
+using blib::container::tree::LayoutOrder;
+
+//=====================================================================
+// Allocation accounting for bytes per node, atomic because the parallel
+// phases allocate from several threads
+namespace {
+  std::atomic<std::size_t> gLiveBytes( 0 );
+  std::atomic<std::size_t> gAllocations( 0 );
+}
+
+void* operator new( std::size_t aSize ) {
+  std::size_t* p = static_cast< std::size_t* >( std::malloc( aSize + sizeof( std::max_align_t ) ) );
+  if ( !p ) {
+    throw std::bad_alloc( );
+  }
+  *p = aSize;
+  gLiveBytes += aSize;
+  ++gAllocations;
+  return reinterpret_cast< char* >( p ) + sizeof( std::max_align_t );
+}
+
+void operator delete( void* aPtr ) noexcept {
+  if ( aPtr ) {
+    std::size_t* p = reinterpret_cast< std::size_t* >( static_cast< char* >( aPtr ) - sizeof( std::max_align_t ) );
+    gLiveBytes -= *p;
+    std::free( p );
+  }
+}
+
+void operator delete( void* aPtr, std::size_t ) noexcept {
+  operator delete( aPtr );
+}
+
+//=====================================================================
+// Shapes, described as children lists so generation is not timed
+struct Shape {
+  std::string name;
+  std::vector<std::vector<int>> children;
+};
+
+Shape wideShape( int aNodes ) {
+  Shape s;
+  s.name = "wide";
+  s.children.resize( aNodes );
+  for ( int i = 1; i < aNodes; ++i ) {
+    s.children[ 0 ].push_back( i );
+  }
+  return s;
+}
+
+Shape chainShape( int aNodes ) {
+  Shape s;
+  s.name = "chain";
+  s.children.resize( aNodes );
+  for ( int i = 1; i < aNodes; ++i ) {
+    s.children[ i - 1 ].push_back( i );
+  }
+  return s;
+}
+
+Shape randomShape( int aNodes ) {
+  Shape s;
+  s.name = "random";
+  s.children.resize( aNodes );
+  std::mt19937 rng( 42 );
+  for ( int i = 1; i < aNodes; ++i ) {
+    s.children[ rng( ) % i ].push_back( i );
+  }
+  return s;
+}
+
+Shape karyShape( int aNodes, int aFanout ) {
+  Shape s;
+  s.name = "kary" + std::to_string( aFanout );
+  s.children.resize( aNodes );
+  for ( int i = 1; i < aNodes; ++i ) {
+    s.children[ ( i - 1 ) / aFanout ].push_back( i );
+  }
+  return s;
+}
+
+//=====================================================================
+// Reporting
+class Reporter {
+private:
+  bool _csv;
+
+public:
+  explicit Reporter( bool aCsv ) :
+    _csv( aCsv ) {
+    if ( _csv ) {
+      std::cout << "shape,nodes,phase,seconds,nodes_per_sec,bytes_per_node,allocations" << std::endl;
+    }
+  }
+
+  void report( Shape const& aShape, std::string const& aPhase, std::size_t aItems,
+               double aSeconds, double aBytesPerNode, std::size_t aAllocations ) {
+    const double rate = aSeconds > 0 ? aItems / aSeconds : 0;
+    if ( _csv ) {
+      std::cout << aShape.name << "," << aShape.children.size( ) << "," << aPhase << ","
+        << aSeconds << "," << rate << "," << aBytesPerNode << "," << aAllocations << std::endl;
+    }
+    else {
+      std::cout << "{\"shape\":\"" << aShape.name << "\",\"nodes\":" << aShape.children.size( )
+        << ",\"phase\":\"" << aPhase << "\",\"seconds\":" << aSeconds
+        << ",\"nodes_per_sec\":" << rate << ",\"bytes_per_node\":" << aBytesPerNode
+        << ",\"allocations\":" << aAllocations << "}" << std::endl;
+    }
+  }
+};
+
+class Timer {
+private:
+  std::chrono::steady_clock::time_point _start;
+  std::size_t _allocations;
+
+public:
+  Timer( ) :
+    _start( std::chrono::steady_clock::now( ) ), _allocations( gAllocations ) {}
+
+  double seconds( ) const {
+    return std::chrono::duration<double>( std::chrono::steady_clock::now( ) - _start ).count( );
+  }
+
+  std::size_t allocations( ) const {
+    return gAllocations - _allocations;
+  }
+};
+
+//=====================================================================
+// Phases
+// Breadth first, all children of a node are added before any of them is
+// descended into, so the references into the children vectors stay valid.
+void build( Tree& aTree, Shape const& aShape, std::vector<Node*>& aNodes ) {
+  aTree.root( 0 );
+  aNodes.assign( aShape.children.size( ), nullptr );
+  aNodes[ 0 ] = &aTree.root( );
+  for ( std::size_t id = 0; id < aShape.children.size( ); ++id ) {
+    std::vector<int> const& kids = aShape.children[ id ];
+    Node& n = *aNodes[ id ];
+    for ( int k : kids ) {
+      n.addChild( k );
+    }
+    std::size_t i = 0;
+    for ( auto& c : n ) {
+      aNodes[ kids[ i++ ] ] = &c;
+    }
+  }
+}
+
+long long sumPreOrder( Tree& aTree, std::size_t& aCount ) {
+  long long ret = 0;
+  for ( auto it = aTree.pre_order_begin( ); it != aTree.pre_order_end( ); ++it ) {
+    ret += it->data( );
+    ++aCount;
+  }
+  return ret;
+}
+
+long long sumPostOrder( Tree& aTree, std::size_t& aCount ) {
+  long long ret = 0;
+  for ( auto it = aTree.post_order_begin( ); it != aTree.post_order_end( ); ++it ) {
+    ret += it->data( );
+    ++aCount;
+  }
+  return ret;
+}
+
+long long sumLevelOrder( Tree& aTree, std::size_t& aCount ) {
+  long long ret = 0;
+  for ( auto it = aTree.level_order_begin( ); it != aTree.level_order_end( ); ++it ) {
+    ret += it->data( );
+    ++aCount;
+  }
+  return ret;
+}
+
+long long sumPreOrderVisit( Tree& aTree, std::size_t& aCount, std::size_t aDistance ) {
+  long long ret = 0;
+  blib::container::tree::visitPreOrder( aTree, [ & ]( Node& aNode ) {
+    ret += aNode.data( );
+    ++aCount;
+  }, aDistance );
+  return ret;
+}
+
+long long sumLevelOrderVisit( Tree& aTree, std::size_t& aCount, std::size_t aDistance ) {
+  long long ret = 0;
+  blib::container::tree::visitLevelOrder( aTree, [ & ]( Node& aNode ) {
+    ret += aNode.data( );
+    ++aCount;
+  }, aDistance );
+  return ret;
+}
+
+void run( Shape const& aShape, std::size_t aPrefetch, Reporter& aReporter ) {
+  const std::size_t n = aShape.children.size( );
+  const std::size_t baseBytes = gLiveBytes;
+  std::vector<Node*> nodes;
+  Tree tree;
+  {
+    Timer t;
+    build( tree, aShape, nodes );
+    const double s = t.seconds( );
+    const double bytes = static_cast< double >( gLiveBytes - baseBytes -
+                                                nodes.capacity( ) * sizeof( Node* ) ) / n;
+    aReporter.report( aShape, "build", n, s, bytes, t.allocations( ) );
+  }
+  const double bytesPerNode = static_cast< double >( gLiveBytes - baseBytes -
+                                                     nodes.capacity( ) * sizeof( Node* ) ) / n;
+
+  volatile long long sink = 0;
+  {
+    std::size_t count = 0;
+    Timer t;
+    sink = sink + sumPreOrder( tree, count );
+    aReporter.report( aShape, "pre_order", count, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    std::size_t count = 0;
+    Timer t;
+    sink = sink + sumPostOrder( tree, count );
+    aReporter.report( aShape, "post_order", count, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    std::size_t count = 0;
+    Timer t;
+    sink = sink + sumLevelOrder( tree, count );
+    aReporter.report( aShape, "level_order", count, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    std::size_t count = 0;
+    Timer t;
+    sink = sink + sumPreOrderVisit( tree, count, 0 );
+    aReporter.report( aShape, "pre_order_visit", count, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    std::size_t count = 0;
+    Timer t;
+    sink = sink + sumPreOrderVisit( tree, count, aPrefetch );
+    aReporter.report( aShape, "pre_order_prefetch", count, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    std::size_t count = 0;
+    Timer t;
+    sink = sink + sumLevelOrderVisit( tree, count, 0 );
+    aReporter.report( aShape, "level_order_visit", count, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    std::size_t count = 0;
+    Timer t;
+    sink = sink + sumLevelOrderVisit( tree, count, aPrefetch );
+    aReporter.report( aShape, "level_order_prefetch", count, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    Timer t;
+    const Tree copy = tree.deep_clone( );
+    aReporter.report( aShape, "deep_copy", n, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    // Remove the last child of random internal nodes, the removed subtree
+    // is destroyed as part of the operation. The removals are planned on
+    // the shape beforehand: nodes of a removed subtree are freed and must
+    // not be picked afterwards. Removing the last child moves none of its
+    // siblings, so the pointers to the other nodes stay valid.
+    std::mt19937 rng( 7 );
+    std::vector<int> internal;
+    std::vector<std::size_t> left( n );
+    for ( std::size_t i = 0; i < n; ++i ) {
+      left[ i ] = aShape.children[ i ].size( );
+      if ( left[ i ] ) {
+        internal.push_back( static_cast< int >( i ) );
+      }
+    }
+    std::vector<char> removed( n, 0 );
+    std::vector<Node*> parents;
+    const std::size_t ops = std::min<std::size_t>( 1000, n / 10 );
+    for ( std::size_t i = 0; i < ops && !internal.empty( ); ++i ) {
+      const int p = internal[ rng( ) % internal.size( ) ];
+      if ( removed[ p ] || !left[ p ] ) {
+        continue;
+      }
+      std::vector<int> stack( 1, aShape.children[ p ][ --left[ p ] ] );
+      while ( !stack.empty( ) ) {
+        const int c = stack.back( );
+        stack.pop_back( );
+        removed[ c ] = 1;
+        stack.insert( stack.end( ), aShape.children[ c ].begin( ), aShape.children[ c ].begin( ) + left[ c ] );
+      }
+      parents.push_back( nodes[ p ] );
+    }
+    const std::size_t done = parents.size( );
+    Timer t;
+    for ( Node* p : parents ) {
+      p->removeChild( std::next( p->begin( ), static_cast< std::ptrdiff_t >( p->numberOfChildren( ) - 1 ) ) );
+    }
+    aReporter.report( aShape, "remove_child", done, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    // After the churn above, so the relayout has something to undo
+    Timer t;
+    tree.compact( LayoutOrder::PreOrder );
+    aReporter.report( aShape, "compact", n, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    std::size_t count = 0;
+    Timer t;
+    sink = sink + sumPreOrder( tree, count );
+    aReporter.report( aShape, "pre_order_compacted", count, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  {
+    Timer t;
+    tree = Tree( );
+    aReporter.report( aShape, "destroy", n, t.seconds( ), bytesPerNode, t.allocations( ) );
+  }
+  (void)sink;
+}
+
+int main( int argc, char** argv ) {
+  std::size_t maxNodes = 1000000;
+  std::size_t maxChain = 10000;
+  std::size_t prefetch = blib::container::tree::DefaultPrefetchDistance;
+  bool csv = false;
+  for ( int i = 1; i < argc; ++i ) {
+    if ( std::strcmp( argv[ i ], "--csv" ) == 0 ) {
+      csv = true;
+    }
+    else if ( std::strcmp( argv[ i ], "--chain-depth" ) == 0 && i + 1 < argc ) {
+      maxChain = std::strtoull( argv[ ++i ], nullptr, 10 );
+    }
+    else if ( std::strcmp( argv[ i ], "--prefetch-distance" ) == 0 && i + 1 < argc ) {
+      prefetch = std::strtoull( argv[ ++i ], nullptr, 10 );
+    }
+    else {
+      maxNodes = std::strtoull( argv[ i ], nullptr, 10 );
+    }
+  }
+
+  try {
+    Reporter reporter( csv );
+    for ( std::size_t n = 1000; n <= maxNodes; n *= 10 ) {
+      const int nodes = static_cast< int >( n );
+      run( wideShape( nodes ), prefetch, reporter );
+      if ( n <= maxChain ) {
+        run( chainShape( nodes ), prefetch, reporter );
+      }
+      run( randomShape( nodes ), prefetch, reporter );
+      run( karyShape( nodes, 2 ), prefetch, reporter );
+      run( karyShape( nodes, 8 ), prefetch, reporter );
+    }
+  }
+  catch ( std::exception& e ) {
+    std::cout << "exception = " << e.what( ) << std::endl;
+    return 1;
+  }
+  return 0;
+}
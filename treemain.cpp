@@ -23,7 +23,7 @@ void nodeOperationsTest( ) {
     n.addChild( i );
   }
 
-  for ( auto c : n ) {
+  for ( auto const& c : n ) {
     if ( c ) {
       std::cout << c.data( ) << " ";
     }
@@ -39,7 +39,7 @@ void nodeOperationsTest( ) {
   auto it = n.begin( );
   n.removeChild( it );
 
-  for ( auto c : n ) {
+  for ( auto const& c : n ) {
     if ( c ) {
       std::cout << c.data( ) << " ";
     }
@@ -91,7 +91,7 @@ void preOrderTest( ) {
   Tree t;
   createTree( t );
   for ( auto it = t.pre_order_begin( ); it != t.pre_order_end( ); ++it ) {
-    auto n = *it;
+    auto const& n = *it;
     if ( n ) {
       std::cout << n.data( ) << " ";
     }
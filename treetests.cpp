@@ -0,0 +1,2235 @@
+#include "containers/tree/NTree.hpp"
+#include "containers/tree/CanonicalLabeling.hpp"
+#include "containers/tree/ChainNTree.hpp"
+#include "containers/tree/FrozenNTree.hpp"
+#include "containers/tree/FrozenScan.hpp"
+#include "containers/tree/HashConsedNTree.hpp"
+#include "containers/tree/HeavyLightIndex.hpp"
+#include "containers/tree/MerkleHash.hpp"
+#include "containers/tree/NTreeProfiler.hpp"
+#include "containers/tree/ParallelBfs.hpp"
+#include "containers/tree/PathQuery.hpp"
+#include "containers/tree/Rerooting.hpp"
+#include "containers/tree/StaticNTree.hpp"
+#include "containers/tree/SubtreeAggregates.hpp"
+#include "containers/tree/SuccinctNTree.hpp"
+#include "containers/tree/TreeDiff.hpp"
+#include "containers/tree/TreeGenerators.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <queue>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Behavior tests for the tree containers.
+//
+//   treetests
+//
+// Every representation is checked against the NTree it was built from:
+// round trips for the flat images, brute force walks of the NTree for the
+// indexes and aggregates. Prints one line per failed check and exits with
+// a non zero status if there was any.
+
+typedef blib::container::tree::Node<int> Node;
+typedef blib::container::tree::NTree<Node> Tree;
+using blib::container::tree::_private::NodeUtility;
+using blib::container::tree::FrozenHeader;
+using blib::container::tree::FrozenLayout;
+using blib::container::tree::FrozenNTree;
+using blib::container::tree::FrozenNTreeView;
+using blib::container::tree::FrozenNTreeWriter;
+using blib::container::tree::ScanIsa;
+using blib::container::tree::ScanPredicate;
+using blib::container::tree::SuccinctNTree;
+
+namespace {
+  int gFailures = 0;
+}
+
+void check( bool aOk, std::string const& aWhat ) {
+  if ( !aOk ) {
+    std::cout << "  failed: " << aWhat << std::endl;
+    ++gFailures;
+  }
+}
+
+template<typename Exception>
+void checkThrows( std::function<void( )> aFunction, std::string const& aWhat ) {
+  bool thrown = false;
+  try {
+    aFunction( );
+  }
+  catch ( Exception const& ) {
+    thrown = true;
+  }
+  check( thrown, aWhat + " throws" );
+}
+
+//=====================================================================
+// Shapes and brute force helpers
+// Parent of node i is a random earlier node, so node 0 is the root
+std::vector<std::vector<int>> randomShape( int aNodes, unsigned aSeed ) {
+  std::vector<std::vector<int>> ret( aNodes );
+  std::mt19937 rng( aSeed );
+  for ( int i = 1; i < aNodes; ++i ) {
+    ret[ rng( ) % i ].push_back( i );
+  }
+  return ret;
+}
+
+// Breadth first, all children of a node are added before any of them is
+// descended into, so the pointers into the children vectors stay valid.
+// Node i gets aValue( i ).
+template<typename TreeType, typename ValueFunction>
+void build( TreeType& aTree, std::vector<std::vector<int>> const& aShape, ValueFunction aValue ) {
+  typedef typename TreeType::Node NodeType;
+  aTree.root( aValue( 0 ) );
+  std::vector<NodeType*> nodes( aShape.size( ), nullptr );
+  nodes[ 0 ] = &aTree.root( );
+  for ( std::size_t id = 0; id < aShape.size( ); ++id ) {
+    for ( int k : aShape[ id ] ) {
+      nodes[ id ]->addChild( aValue( k ) );
+    }
+    std::size_t i = 0;
+    for ( auto& c : *nodes[ id ] ) {
+      nodes[ aShape[ id ][ i++ ] ] = &c;
+    }
+  }
+}
+
+// The nodes in preorder with the preorder index of their parent, -1 for
+// the root
+template<typename NodeType>
+void preorder( NodeType& aRoot, std::vector<NodeType*>& aNodes, std::vector<int>& aParents ) {
+  std::vector<std::pair<NodeType*, int>> stack( 1, std::make_pair( &aRoot, -1 ) );
+  while ( !stack.empty( ) ) {
+    NodeType* n = stack.back( ).first;
+    const int parent = stack.back( ).second;
+    stack.pop_back( );
+    const int self = static_cast< int >( aNodes.size( ) );
+    aNodes.push_back( n );
+    aParents.push_back( parent );
+    auto& children = NodeUtility::children( *n );
+    for ( std::size_t i = children.size( ); i-- > 0; ) {
+      stack.push_back( std::make_pair( &children[ i ], self ) );
+    }
+  }
+}
+
+// Same shape and the same data, nodes without data included
+template<typename NodeType>
+bool sameTree( NodeType const& aLeft, NodeType const& aRight ) {
+  std::vector<std::pair<NodeType const*, NodeType const*>> stack( 1, std::make_pair( &aLeft, &aRight ) );
+  while ( !stack.empty( ) ) {
+    NodeType const& l = *stack.back( ).first;
+    NodeType const& r = *stack.back( ).second;
+    stack.pop_back( );
+    if ( bool( l ) != bool( r ) || ( l && l.data( ) != r.data( ) ) || l.numberOfChildren( ) != r.numberOfChildren( ) ) {
+      return false;
+    }
+    for ( std::size_t i = 0; i < l.numberOfChildren( ); ++i ) {
+      stack.push_back( std::make_pair( &l[ i ], &r[ i ] ) );
+    }
+  }
+  return true;
+}
+
+// Every child names the node holding it as its parent
+template<typename NodeType>
+bool linked( NodeType const& aRoot ) {
+  std::vector<NodeType const*> stack( 1, &aRoot );
+  while ( !stack.empty( ) ) {
+    NodeType const* n = stack.back( );
+    stack.pop_back( );
+    for ( auto const& c : NodeUtility::children( *n ) ) {
+      if ( NodeUtility::parentOf( c ) != n ) {
+        return false;
+      }
+      stack.push_back( &c );
+    }
+  }
+  return true;
+}
+
+// No children storage and no payload of one tree is in the other
+template<typename NodeType>
+bool disjoint( NodeType& aLeft, NodeType& aRight ) {
+  std::set<void const*> left;
+  std::vector<NodeType*> nodes;
+  std::vector<int> parents;
+  preorder( aLeft, nodes, parents );
+  for ( NodeType* n : nodes ) {
+    left.insert( &NodeUtility::children( *n ) );
+    left.insert( NodeUtility::dataPtr( *n ).get( ) );
+  }
+  left.erase( nullptr );
+  nodes.clear( );
+  preorder( aRight, nodes, parents );
+  for ( NodeType* n : nodes ) {
+    if ( left.count( &NodeUtility::children( *n ) ) || left.count( NodeUtility::dataPtr( *n ).get( ) ) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Frozen image of aTree in 8 byte aligned memory, the sections need the
+// alignment of their type
+template<typename TreeType>
+std::vector<std::uint64_t> frozenImage( TreeType& aTree, std::size_t& aBytes ) {
+  std::ostringstream out;
+  FrozenNTreeWriter<TreeType>( aTree ).write( out );
+  const std::string image = out.str( );
+  std::vector<std::uint64_t> ret( ( image.size( ) + 7 ) / 8 );
+  std::memcpy( ret.data( ), image.data( ), image.size( ) );
+  aBytes = image.size( );
+  return ret;
+}
+
+//=====================================================================
+// Frozen NTree
+void frozenTest( ) {
+  typedef FrozenLayout::IndexType IndexType;
+  Tree tree;
+  build( tree, randomShape( 2000, 1 ), []( int i ) { return i * 7; } );
+  std::vector<Node*> nodes;
+  std::vector<int> parents;
+  preorder( tree.root( ), nodes, parents );
+
+  std::size_t bytes = 0;
+  std::vector<std::uint64_t> image = frozenImage( tree, bytes );
+
+  FrozenNTreeView<int> view( image.data( ), bytes );
+  view.verify( );
+  check( view.size( ) == nodes.size( ), "frozen size" );
+  bool same = true;
+  for ( std::size_t i = 0; i < nodes.size( ); ++i ) {
+    const IndexType p = parents[ i ] < 0 ? FrozenNTreeView<int>::npos : static_cast< IndexType >( parents[ i ] );
+    same = same && view.data( i ) == nodes[ i ]->data( ) && view.parent( i ) == p &&
+      view.numberOfChildren( i ) == nodes[ i ]->numberOfChildren( );
+  }
+  check( same, "frozen values, parents and fanouts match the tree" );
+
+  blib::container::tree::freeze( tree, "treetests.fnt" );
+  {
+    FrozenNTree<int> file( "treetests.fnt" );
+    check( file.size( ) == nodes.size( ) && file.data( nodes.size( ) - 1 ) == nodes.back( )->data( ),
+           "frozen file round trip" );
+  }
+  std::remove( "treetests.fnt" );
+
+  // Damaged images are rejected, by attach( ) or by verify( )
+  auto header = [ &image ]( ) -> FrozenHeader& {
+    return *reinterpret_cast< FrozenHeader* >( image.data( ) );
+  };
+  auto damaged = [ &image ]( std::size_t aSize ) {
+    FrozenNTreeView<int> v( image.data( ), aSize );
+  };
+  checkThrows<std::runtime_error>( [ & ]( ) { damaged( bytes - 1 ); }, "frozen truncated image" );
+  const std::vector<std::uint64_t> good = image;
+  header( ).firstChildOffset += 2;
+  checkThrows<std::runtime_error>( [ & ]( ) { damaged( bytes ); }, "frozen misaligned section" );
+  image = good;
+  header( ).subtreeEndOffset = header( ).fileSize - 4;
+  checkThrows<std::runtime_error>( [ & ]( ) { damaged( bytes ); }, "frozen section past the end" );
+  image = good;
+  header( ).nodeCount = static_cast< std::uint64_t >( -1 ) / 2;
+  checkThrows<std::runtime_error>( [ & ]( ) { damaged( bytes ); }, "frozen node count overflowing" );
+  const char* sections[] = { "parent", "firstChild", "nextSibling", "subtreeEnd" };
+  for ( int s = 0; s < 4; ++s ) {
+    image = good;
+    const std::uint64_t offsets[] = { header( ).parentOffset, header( ).firstChildOffset,
+                                      header( ).nextSiblingOffset, header( ).subtreeEndOffset };
+    IndexType* links = reinterpret_cast< IndexType* >( reinterpret_cast< char* >( image.data( ) ) + offsets[ s ] );
+    links[ nodes.size( ) / 2 ] = static_cast< IndexType >( nodes.size( ) + 5 );
+    // Attaching looks at the header only, verify( ) at the links
+    FrozenNTreeView<int> v( image.data( ), bytes );
+    checkThrows<std::runtime_error>( [ &v ]( ) { v.verify( ); },
+                                     std::string( "frozen " ) + sections[ s ] + " index out of range" );
+  }
+  image = good;
+  checkThrows<std::runtime_error>( [ & ]( ) { damaged( sizeof( FrozenHeader ) - 1 ); }, "frozen image smaller than a header" );
+}
+
+//=====================================================================
+// Frozen Scan
+// Every kernel the CPU has, on whole images and on subtree intervals that
+// start and end inside a word, against the predicate itself
+template<typename ValueType>
+void scanCheck( std::vector<ValueType> const& aValues, std::vector<ScanPredicate<ValueType>> const& aPredicates,
+                std::string const& aWhat ) {
+  typedef blib::container::tree::Node<ValueType> ScanNode;
+  blib::container::tree::NTree<ScanNode> tree;
+  build( tree, randomShape( static_cast< int >( aValues.size( ) ), 2 ), [ &aValues ]( int i ) { return aValues[ i ]; } );
+  std::size_t bytes = 0;
+  const std::vector<std::uint64_t> image = frozenImage( tree, bytes );
+  const FrozenNTreeView<ValueType> view( image.data( ), bytes );
+
+  const ScanIsa isas[] = { ScanIsa::Sse2, ScanIsa::Avx2, ScanIsa::Avx512, ScanIsa::Auto };
+  for ( std::size_t p = 0; p < aPredicates.size( ); ++p ) {
+    ScanPredicate<ValueType> const& predicate = aPredicates[ p ];
+    std::vector<FrozenLayout::IndexType> expected;
+    for ( std::size_t i = 0; i < view.size( ); ++i ) {
+      if ( predicate( view.data( i ) ) ) {
+        expected.push_back( static_cast< FrozenLayout::IndexType >( i ) );
+      }
+    }
+    const std::string what = aWhat + " predicate " + std::to_string( p );
+    check( blib::container::tree::scanIndices( view, predicate, ScanIsa::Scalar ) == expected, what + " scalar" );
+    for ( ScanIsa isa : isas ) {
+      check( blib::container::tree::scanIndices( view, predicate, isa ) == expected,
+             what + " isa " + std::to_string( static_cast< int >( isa ) ) );
+      for ( FrozenLayout::IndexType root = 1; root < view.size( ); root += 97 ) {
+        check( blib::container::tree::scanSubtreeIndices( view, predicate, root, isa ) ==
+               blib::container::tree::scanSubtreeIndices( view, predicate, root, ScanIsa::Scalar ),
+               what + " subtree " + std::to_string( root ) );
+      }
+    }
+  }
+}
+
+template<typename FloatType>
+void floatScanCheck( std::string const& aWhat ) {
+  typedef ScanPredicate<FloatType> P;
+  const FloatType nan = std::numeric_limits<FloatType>::quiet_NaN( );
+  const FloatType inf = std::numeric_limits<FloatType>::infinity( );
+  std::mt19937 rng( 3 );
+  std::vector<FloatType> values( 1000 );
+  for ( auto& v : values ) {
+    const unsigned r = rng( ) % 16;
+    v = r == 0 ? nan : r == 1 ? inf : r == 2 ? -inf : static_cast< FloatType >( static_cast< int >( rng( ) % 201 ) - 100 ) / 4;
+  }
+  values[ 0 ] = nan;
+  scanCheck( values, std::vector<P>{ P::range( -10, 10 ), P::range( -inf, inf ), P::equal( 0 ), P::equal( nan ),
+                                     P::range( nan, 1 ), P::range( 1, nan ), P::range( 5, -5 ) }, aWhat );
+}
+
+template<typename IntType>
+void integerScanCheck( std::string const& aWhat ) {
+  typedef ScanPredicate<IntType> P;
+  std::mt19937_64 rng( 4 );
+  std::vector<IntType> values( 1000 );
+  for ( auto& v : values ) {
+    v = static_cast< IntType >( rng( ) % 3 ? static_cast< IntType >( rng( ) % 64 ) - 32 : static_cast< IntType >( rng( ) ) );
+  }
+  values[ 1 ] = std::numeric_limits<IntType>::min( );
+  values[ 2 ] = std::numeric_limits<IntType>::max( );
+  scanCheck( values, std::vector<P>{ P::range( -8, 8 ), P::range( std::numeric_limits<IntType>::min( ), 0 ),
+                                     P::equal( 3 ), P::anyBits( 5 ), P::allBits( 6 ) }, aWhat );
+}
+
+void scanTest( ) {
+  floatScanCheck<float>( "float" );
+  floatScanCheck<double>( "double" );
+  integerScanCheck<std::int32_t>( "int32" );
+  integerScanCheck<std::int64_t>( "int64" );
+}
+
+//=====================================================================
+// Succinct NTree
+// Navigation on the parentheses against the preorder walk, nodes without
+// data read back as a value initialized int
+void succinctTest( ) {
+  typedef SuccinctNTree<int>::NodeId NodeId;
+  Tree empty;
+  check( SuccinctNTree<int>( empty ).root( ) == SuccinctNTree<int>::npos, "succinct empty tree" );
+
+  Tree tree;
+  build( tree, randomShape( 3000, 8 ), []( int i ) { return i * 3 + 1; } );
+  std::vector<Node*> nodes;
+  std::vector<int> parents;
+  preorder( tree.root( ), nodes, parents );
+  for ( std::size_t i = 0; i < nodes.size( ); i += 11 ) {
+    nodes[ i ]->clearData( );
+  }
+
+  std::vector<std::size_t> sizes( nodes.size( ), 1 );
+  std::vector<std::size_t> depths( nodes.size( ), 0 );
+  for ( std::size_t i = nodes.size( ); i-- > 1; ) {
+    sizes[ parents[ i ] ] += sizes[ i ];
+  }
+  for ( std::size_t i = 1; i < nodes.size( ); ++i ) {
+    depths[ i ] = depths[ parents[ i ] ] + 1;
+  }
+
+  const SuccinctNTree<int> succinct( tree );
+  check( succinct.size( ) == nodes.size( ), "succinct size" );
+  bool values = true;
+  bool links = true;
+  for ( std::size_t i = 0; i < nodes.size( ); ++i ) {
+    const NodeId n = succinct.node( i );
+    values = values && succinct.preorder( n ) == i && succinct.data( n ) == ( *nodes[ i ] ? nodes[ i ]->data( ) : 0 );
+    const NodeId p = succinct.parent( n );
+    const NodeId first = succinct.firstChild( n );
+    const NodeId next = succinct.nextSibling( n );
+    const std::size_t end = i + sizes[ i ];
+    const std::size_t parentEnd = parents[ i ] < 0 ? nodes.size( ) : parents[ i ] + sizes[ parents[ i ] ];
+    links = links && ( parents[ i ] < 0 ? p == SuccinctNTree<int>::npos : succinct.preorder( p ) == std::size_t( parents[ i ] ) ) &&
+      ( sizes[ i ] > 1 ? succinct.preorder( first ) == i + 1 : first == SuccinctNTree<int>::npos ) &&
+      ( end < parentEnd ? succinct.preorder( next ) == end : next == SuccinctNTree<int>::npos ) &&
+      succinct.isLeaf( n ) == nodes[ i ]->isLeaf( ) && succinct.subtreeSize( n ) == sizes[ i ] &&
+      succinct.depth( n ) == depths[ i ] && succinct.numberOfChildren( n ) == nodes[ i ]->numberOfChildren( );
+  }
+  check( values, "succinct values in preorder" );
+  check( links, "succinct parents, children, siblings, sizes and depths match the tree" );
+}
+
+//=====================================================================
+// Tree Diff
+// Random relabels, cleared values, inserts, deletes and moves on a deep
+// copy; the script replayed on the original must give the copy back.
+template<typename TreeType>
+void diffCheck( std::string const& aWhat ) {
+  typedef typename TreeType::Node NodeType;
+  std::mt19937 rng( 5 );
+  for ( int round = 0; round < 20; ++round ) {
+    TreeType before;
+    build( before, randomShape( 60, round ), []( int i ) { return i % 10; } );
+    TreeType after = before.deep_clone( );
+    for ( int edit = 0; edit < 1 + round; ++edit ) {
+      std::vector<NodeType*> nodes;
+      std::vector<int> parents;
+      preorder( after.root( ), nodes, parents );
+      NodeType& n = *nodes[ rng( ) % nodes.size( ) ];
+      switch ( rng( ) % 5 ) {
+      case 0:
+        n.data( static_cast< int >( rng( ) % 10 ) );
+        break;
+      case 1:
+        n.clearData( );
+        break;
+      case 2: {
+        NodeType leaf;
+        if ( rng( ) % 2 ) {
+          leaf.data( static_cast< int >( rng( ) % 10 ) );
+        }
+        n.insertChild( std::next( n.begin( ), static_cast< std::ptrdiff_t >( rng( ) % ( n.numberOfChildren( ) + 1 ) ) ), leaf );
+        break;
+      }
+      case 3:
+        if ( n.numberOfChildren( ) ) {
+          n.removeChild( std::next( n.begin( ), static_cast< std::ptrdiff_t >( rng( ) % n.numberOfChildren( ) ) ) );
+        }
+        break;
+      default:
+        if ( n.numberOfChildren( ) > 1 ) {
+          const std::size_t from = rng( ) % n.numberOfChildren( );
+          const NodeType moved( n[ from ] );
+          n.removeChild( std::next( n.begin( ), static_cast< std::ptrdiff_t >( from ) ) );
+          n.insertChild( std::next( n.begin( ), static_cast< std::ptrdiff_t >( rng( ) % ( n.numberOfChildren( ) + 1 ) ) ), moved );
+        }
+        break;
+      }
+    }
+    const blib::container::tree::EditScript<NodeType> script = blib::container::tree::diff( before, after );
+    script.apply( before );
+    check( sameTree( before.root( ), after.root( ) ), aWhat + " round trip " + std::to_string( round ) );
+    check( disjoint( before.root( ), after.root( ) ) && linked( before.root( ) ) && linked( after.root( ) ),
+           aWhat + " round trip " + std::to_string( round ) + " shares nothing" );
+  }
+
+  // An inserted subtree is a copy, the patched tree can change and go away
+  TreeType source;
+  source.root( 0 );
+  TreeType target;
+  target.root( 0 );
+  target.root( ).addChild( 5 );
+  target.root( )[ 0 ].addChild( 6 );
+  target.root( )[ 0 ].addChild( 7 );
+  {
+    TreeType patched = source.deep_clone( );
+    blib::container::tree::diff( source, target ).apply( patched );
+    check( sameTree( patched.root( ), target.root( ) ), aWhat + " inserted subtree" );
+    patched.root( )[ 0 ].addChild( 99 );
+    patched.root( )[ 0 ][ 1 ].data( 70 );
+  }
+  check( target.root( )[ 0 ].numberOfChildren( ) == 2 && target.root( )[ 0 ][ 1 ].data( ) == 7 && linked( target.root( ) ),
+         aWhat + " tree diffed against untouched by the patched one" );
+
+  // A value taken away, at the root and below it
+  TreeType from;
+  build( from, randomShape( 5, 6 ), []( int i ) { return i; } );
+  TreeType to = from.deep_clone( );
+  to.root( ).clearData( );
+  to.root( )[ 0 ].clearData( );
+  const blib::container::tree::EditScript<NodeType> script = blib::container::tree::diff( from, to );
+  check( !script.empty( ), aWhat + " cleared values give operations" );
+  script.apply( from );
+  check( sameTree( from.root( ), to.root( ) ), aWhat + " cleared values round trip" );
+}
+
+void diffTest( ) {
+  diffCheck<Tree>( "plain" );
+  diffCheck<blib::container::tree::NTree<blib::container::tree::MerkleNode<int>>>( "merkle" );
+}
+
+//=====================================================================
+// Heavy Light Index
+// Path and subtree sums and adds, single and batched, and lowest common
+// ancestors against walks up the parents of the preorder
+void heavyLightTest( ) {
+  typedef blib::container::tree::HeavyLightIndex<Tree, long long> Index;
+  typedef Index::IndexType IndexType;
+  Tree tree;
+  build( tree, randomShape( 2000, 11 ), []( int i ) { return i % 100; } );
+  std::vector<Node*> nodes;
+  std::vector<int> parents;
+  preorder( tree.root( ), nodes, parents );
+  std::vector<IndexType> depths( nodes.size( ), 0 );
+  std::vector<IndexType> sizes( nodes.size( ), 1 );
+  for ( std::size_t i = 1; i < nodes.size( ); ++i ) {
+    depths[ i ] = depths[ parents[ i ] ] + 1;
+  }
+  for ( std::size_t i = nodes.size( ); i-- > 1; ) {
+    sizes[ parents[ i ] ] += sizes[ i ];
+  }
+  std::vector<long long> values( nodes.size( ) );
+  for ( std::size_t i = 0; i < nodes.size( ); ++i ) {
+    values[ i ] = nodes[ i ]->data( );
+  }
+  // The nodes of the path from aFrom to aTo, the common ancestor last
+  auto path = [ &parents, &depths ]( IndexType aFrom, IndexType aTo ) {
+    std::vector<IndexType> ret;
+    while ( aFrom != aTo ) {
+      IndexType& deeper = depths[ aFrom ] >= depths[ aTo ] ? aFrom : aTo;
+      ret.push_back( deeper );
+      deeper = static_cast< IndexType >( parents[ deeper ] );
+    }
+    ret.push_back( aFrom );
+    return ret;
+  };
+  auto pathSum = [ &path, &values ]( IndexType aFrom, IndexType aTo ) {
+    long long ret = 0;
+    for ( IndexType n : path( aFrom, aTo ) ) {
+      ret += values[ n ];
+    }
+    return ret;
+  };
+
+  Index index( tree );
+  check( index.size( ) == nodes.size( ), "heavy light size" );
+  bool shape = true;
+  for ( std::size_t i = 0; i < nodes.size( ); ++i ) {
+    const IndexType p = parents[ i ] < 0 ? Index::npos : static_cast< IndexType >( parents[ i ] );
+    shape = shape && index.id( *nodes[ i ] ) == i && index.parent( static_cast< IndexType >( i ) ) == p &&
+      index.depth( static_cast< IndexType >( i ) ) == depths[ i ] && index.subtreeSize( static_cast< IndexType >( i ) ) == sizes[ i ];
+  }
+  check( shape, "heavy light ids, parents, depths and sizes match the tree" );
+
+  std::mt19937 rng( 12 );
+  const IndexType n = static_cast< IndexType >( nodes.size( ) );
+  bool single = true;
+  for ( int q = 0; q < 3000 && single; ++q ) {
+    const IndexType a = rng( ) % n;
+    const IndexType b = rng( ) % n;
+    const long long delta = static_cast< long long >( rng( ) % 11 ) - 5;
+    switch ( rng( ) % 4 ) {
+    case 0:
+      index.pathAdd( a, b, delta );
+      for ( IndexType v : path( a, b ) ) {
+        values[ v ] += delta;
+      }
+      break;
+    case 1:
+      index.subtreeAdd( a, delta );
+      for ( IndexType v = a; v < a + sizes[ a ]; ++v ) {
+        values[ v ] += delta;
+      }
+      break;
+    case 2: {
+      long long sum = 0;
+      for ( IndexType v = a; v < a + sizes[ a ]; ++v ) {
+        sum += values[ v ];
+      }
+      single = index.subtreeSum( a ) == sum && index.value( a ) == values[ a ];
+      break;
+    }
+    default:
+      single = index.pathSum( a, b ) == pathSum( a, b ) && index.lca( a, b ) == path( a, b ).back( );
+      break;
+    }
+  }
+  check( single, "heavy light single queries and updates" );
+
+  // Batches large enough to be flattened and small enough not to be
+  for ( std::size_t batch : { std::size_t( 3 ), nodes.size( ) } ) {
+    std::vector<Index::PathUpdate> updates;
+    for ( std::size_t i = 0; i < batch; ++i ) {
+      const Index::PathUpdate u = { static_cast< IndexType >( rng( ) % n ), static_cast< IndexType >( rng( ) % n ),
+                                    static_cast< long long >( rng( ) % 7 ) };
+      updates.push_back( u );
+      for ( IndexType v : path( u.from, u.to ) ) {
+        values[ v ] += u.delta;
+      }
+    }
+    index.pathAdd( updates );
+    std::vector<Index::Path> queries;
+    for ( std::size_t i = 0; i < batch; ++i ) {
+      queries.push_back( Index::Path( rng( ) % n, rng( ) % n ) );
+    }
+    const std::vector<long long> sums = index.pathSum( queries );
+    bool same = sums.size( ) == queries.size( );
+    for ( std::size_t i = 0; same && i < queries.size( ); ++i ) {
+      same = sums[ i ] == pathSum( queries[ i ].first, queries[ i ].second );
+    }
+    check( same, "heavy light batch of " + std::to_string( batch ) );
+  }
+
+  index.writeBack( );
+  bool written = true;
+  for ( std::size_t i = 0; i < nodes.size( ); ++i ) {
+    written = written && nodes[ i ]->data( ) == values[ i ];
+  }
+  check( written, "heavy light write back" );
+}
+
+//=====================================================================
+// Canonical Labeling
+// Labels against parenthesized strings of every subtree, the children's
+// strings sorted unless the labeling is ordered: two subtrees must have the
+// same label exactly when they have the same string. Every tree comes with
+// a mirrored copy, which is isomorphic only when the order is ignored.
+std::string shapeString( Node const& aNode, bool aOrdered, std::vector<std::string>& aPreorder ) {
+  const std::size_t self = aPreorder.size( );
+  aPreorder.push_back( std::string( ) );
+  std::vector<std::string> children;
+  for ( std::size_t i = 0; i < aNode.numberOfChildren( ); ++i ) {
+    children.push_back( shapeString( aNode[ i ], aOrdered, aPreorder ) );
+  }
+  if ( !aOrdered ) {
+    std::sort( children.begin( ), children.end( ) );
+  }
+  std::string ret = "(";
+  for ( auto const& c : children ) {
+    ret += c;
+  }
+  ret += ")";
+  aPreorder[ self ] = ret;
+  return ret;
+}
+
+void canonicalTest( ) {
+  std::vector<Tree> forest;
+  std::mt19937 rng( 14 );
+  for ( int k = 0; k < 40; ++k ) {
+    std::vector<std::vector<int>> shape = randomShape( 1 + static_cast< int >( rng( ) % 40 ), rng( ) % 8 );
+    forest.push_back( Tree( ) );
+    build( forest.back( ), shape, []( int i ) { return i; } );
+    for ( auto& children : shape ) {
+      std::reverse( children.begin( ), children.end( ) );
+    }
+    forest.push_back( Tree( ) );
+    build( forest.back( ), shape, []( int i ) { return -i; } );
+  }
+
+  for ( bool ordered : { false, true } ) {
+    const std::string what = ordered ? "ordered labels" : "unordered labels";
+    blib::container::tree::CanonicalLabeling<Node> serial( ordered );
+    for ( auto const& t : forest ) {
+      serial.add( t );
+    }
+    std::map<std::string, std::uint32_t> labelOf;
+    std::map<std::uint32_t, std::string> stringOf;
+    bool same = true;
+    std::size_t nodes = 0;
+    for ( std::size_t t = 0; t < forest.size( ); ++t ) {
+      std::vector<std::string> strings;
+      shapeString( forest[ t ].root( ), ordered, strings );
+      same = same && serial.size( t ) == strings.size( );
+      for ( std::size_t i = 0; same && i < strings.size( ); ++i ) {
+        const std::uint32_t label = serial.label( t, static_cast< std::uint32_t >( i ) );
+        same = labelOf.insert( std::make_pair( strings[ i ], label ) ).first->second == label &&
+          stringOf.insert( std::make_pair( label, strings[ i ] ) ).first->second == strings[ i ];
+      }
+      nodes += strings.size( );
+    }
+    check( same, what + " match the shape strings" );
+    check( serial.shapes( ) == labelOf.size( ), what + " shape count" );
+    check( serial.form( 0 ).empty( ) && stringOf[ 0 ] == "()", what + " leaf is label 0" );
+    if ( !ordered ) {
+      bool mirrored = true;
+      for ( std::size_t t = 0; t < forest.size( ); t += 2 ) {
+        mirrored = mirrored && serial.isomorphic( t, 0, t + 1, 0 );
+      }
+      check( mirrored, what + " of mirrored trees" );
+    }
+    std::size_t counted = 0;
+    for ( std::size_t c : serial.histogram( ) ) {
+      counted += c;
+    }
+    check( counted == nodes, what + " histogram" );
+
+    for ( std::size_t threads : { std::size_t( 1 ), std::size_t( 3 ), std::size_t( 8 ) } ) {
+      const blib::container::tree::CanonicalLabeling<Node> parallel =
+        blib::container::tree::canonicalLabels( forest, ordered, threads );
+      bool equal = parallel.trees( ) == forest.size( ) && parallel.shapes( ) == serial.shapes( );
+      for ( std::size_t t = 0; equal && t < forest.size( ); ++t ) {
+        equal = parallel.labels( t ) == serial.labels( t );
+      }
+      check( equal, what + " on " + std::to_string( threads ) + " threads like one after the other" );
+    }
+  }
+}
+
+//=====================================================================
+// Hash Consed NTree
+// The consed tree against its source, and its statistics against the
+// distinct ( data, children ) tuples found bottom up. Identical subtrees
+// must share their children, and no node below the root names a parent.
+void hashConsTest( ) {
+  // Values by depth in a full ternary tree, every level one shape
+  std::vector<std::vector<int>> full( 1 );
+  std::vector<int> depth( 1, 0 );
+  for ( std::size_t i = 0; i < full.size( ) && full.size( ) < 1093; ++i ) {
+    for ( int k = 0; k < 3; ++k ) {
+      full[ i ].push_back( static_cast< int >( full.size( ) ) );
+      full.push_back( std::vector<int>( ) );
+      depth.push_back( depth[ i ] + 1 );
+    }
+  }
+  std::mt19937 rng( 16 );
+  std::vector<int> bits( 3000 );
+  for ( auto& b : bits ) {
+    b = static_cast< int >( rng( ) % 2 );
+  }
+  std::vector<Tree> sources( 2 );
+  build( sources[ 0 ], full, [ &depth ]( int i ) { return depth[ i ]; } );
+  build( sources[ 1 ], randomShape( 3000, 17 ), [ &bits ]( int i ) { return bits[ i ]; } );
+  std::vector<Node*> cleared;
+  std::vector<int> parents;
+  preorder( sources[ 1 ].root( ), cleared, parents );
+  for ( std::size_t i = 5; i < cleared.size( ); i += 13 ) {
+    cleared[ i ]->clearData( );
+  }
+
+  for ( std::size_t t = 0; t < sources.size( ); ++t ) {
+    const std::string what = "hash cons tree " + std::to_string( t );
+    Tree& source = sources[ t ];
+    const Tree before = source.deep_clone( );
+    std::vector<Node*> nodes;
+    parents.clear( );
+    preorder( source.root( ), nodes, parents );
+    std::vector<std::vector<int>> children( nodes.size( ) );
+    for ( std::size_t i = 1; i < nodes.size( ); ++i ) {
+      children[ parents[ i ] ].push_back( static_cast< int >( i ) );
+    }
+    // Value, -1 without data, and the children's ids
+    std::map<std::pair<int, std::vector<int>>, int> ids;
+    std::vector<int> id( nodes.size( ) );
+    for ( std::size_t i = nodes.size( ); i-- > 0; ) {
+      std::vector<int> key;
+      for ( int c : children[ i ] ) {
+        key.push_back( id[ c ] );
+      }
+      const std::pair<int, std::vector<int>> tuple( *nodes[ i ] ? nodes[ i ]->data( ) : -1, key );
+      id[ i ] = ids.insert( std::make_pair( tuple, static_cast< int >( ids.size( ) ) ) ).first->second;
+    }
+
+    blib::container::tree::HashConsStats stats;
+    Tree consed = blib::container::tree::hashCons( source, &stats );
+    check( sameTree( consed.root( ), source.root( ) ), what + " same values and shape" );
+    check( sameTree( source.root( ), before.root( ) ), what + " source untouched" );
+    check( stats.logicalNodes == nodes.size( ) && stats.uniqueNodes == ids.size( ), what + " stats" );
+    check( stats.compressionRatio( ) == static_cast< double >( nodes.size( ) ) / static_cast< double >( ids.size( ) ),
+           what + " compression ratio" );
+
+    std::vector<Node*> shared;
+    std::vector<int> sharedParents;
+    preorder( consed.root( ), shared, sharedParents );
+    std::set<void const*> storage;
+    bool orphans = true;
+    for ( Node* n : shared ) {
+      storage.insert( &NodeUtility::children( *n ) );
+      orphans = orphans && !n->parent( );
+    }
+    check( storage.size( ) == ids.size( ), what + " identical subtrees share their children" );
+    check( orphans, what + " no parent handles" );
+  }
+  check( sources[ 0 ].root( ).numberOfChildren( ) == 3 &&
+         blib::container::tree::hashCons( sources[ 0 ] ).root( )[ 2 ][ 1 ].data( ) == 2, "hash cons navigation" );
+}
+
+//=====================================================================
+// Rerooting
+// Sum of distances and eccentricity of every node against a breadth first
+// search from it. The eccentricity keeps the two largest heights so that
+// one can be taken out.
+struct DistanceSum {
+  // Nodes and distance sum
+  typedef std::pair<long long, long long> ValueType;
+
+  ValueType identity( ) const {
+    return ValueType( 0, 0 );
+  }
+
+  ValueType combine( ValueType const& aLeft, ValueType const& aRight ) const {
+    return ValueType( aLeft.first + aRight.first, aLeft.second + aRight.second );
+  }
+
+  ValueType lift( ValueType const& aSide, Node const&, Node const& ) const {
+    return ValueType( aSide.first, aSide.second + aSide.first );
+  }
+
+  ValueType exclude( ValueType const& aAll, ValueType const& aPart ) const {
+    return ValueType( aAll.first - aPart.first, aAll.second - aPart.second );
+  }
+
+  ValueType finalize( ValueType const& aCombined, Node const& ) const {
+    return ValueType( aCombined.first + 1, aCombined.second );
+  }
+};
+
+struct Eccentricity {
+  // Largest and second largest height, -1 for none
+  typedef std::pair<int, int> ValueType;
+
+  ValueType identity( ) const {
+    return ValueType( -1, -1 );
+  }
+
+  ValueType combine( ValueType const& aLeft, ValueType const& aRight ) const {
+    int heights[] = { aLeft.first, aLeft.second, aRight.first, aRight.second };
+    std::sort( heights, heights + 4 );
+    return ValueType( heights[ 3 ], heights[ 2 ] );
+  }
+
+  ValueType lift( ValueType const& aSide, Node const&, Node const& ) const {
+    return ValueType( aSide.first + 1, -1 );
+  }
+
+  ValueType exclude( ValueType const& aAll, ValueType const& aPart ) const {
+    return ValueType( aAll.first == aPart.first ? aAll.second : aAll.first, -1 );
+  }
+
+  ValueType finalize( ValueType const& aCombined, Node const& ) const {
+    return ValueType( std::max( aCombined.first, 0 ), -1 );
+  }
+};
+
+template<typename TreeType>
+void rerootingCheck( TreeType& aTree, std::size_t aSources, std::string const& aWhat ) {
+  typedef blib::container::tree::Rerooting<TreeType, DistanceSum> Distances;
+  typedef blib::container::tree::Rerooting<TreeType, Eccentricity> Eccentricities;
+  const Distances distances( aTree );
+  const Eccentricities eccentricities( aTree );
+  const std::size_t n = distances.size( );
+  std::vector<std::vector<std::size_t>> neighbours( n );
+  for ( std::size_t i = 1; i < n; ++i ) {
+    neighbours[ i ].push_back( distances.parent( static_cast< typename Distances::IndexType >( i ) ) );
+    neighbours[ distances.parent( static_cast< typename Distances::IndexType >( i ) ) ].push_back( i );
+  }
+  bool same = true;
+  for ( std::size_t k = 0; k < aSources && same; ++k ) {
+    const std::size_t source = k * n / aSources;
+    std::vector<int> distance( n, -1 );
+    std::queue<std::size_t> queue;
+    distance[ source ] = 0;
+    queue.push( source );
+    long long sum = 0;
+    int farthest = 0;
+    while ( !queue.empty( ) ) {
+      const std::size_t u = queue.front( );
+      queue.pop( );
+      sum += distance[ u ];
+      farthest = std::max( farthest, distance[ u ] );
+      for ( std::size_t v : neighbours[ u ] ) {
+        if ( distance[ v ] < 0 ) {
+          distance[ v ] = distance[ u ] + 1;
+          queue.push( v );
+        }
+      }
+    }
+    const typename Distances::IndexType id = static_cast< typename Distances::IndexType >( source );
+    same = distances.result( id ) == DistanceSum::ValueType( static_cast< long long >( n ), sum ) &&
+      eccentricities.result( id ).first == farthest;
+  }
+  check( same, aWhat + " against breadth first searches" );
+  for ( std::size_t threads : { std::size_t( 2 ), std::size_t( 4 ) } ) {
+    check( blib::container::tree::reroot( aTree, DistanceSum( ), threads ) == distances.results( ) &&
+           blib::container::tree::reroot( aTree, Eccentricity( ), threads ) == eccentricities.results( ),
+           aWhat + " on " + std::to_string( threads ) + " threads" );
+  }
+}
+
+void rerootingTest( ) {
+  Tree random;
+  build( random, randomShape( 800, 13 ), []( int i ) { return i; } );
+  rerootingCheck( random, 800, "rerooting random tree" );
+
+  Tree path;
+  std::vector<std::vector<int>> chain( 600 );
+  for ( int i = 1; i < 600; ++i ) {
+    chain[ i - 1 ].push_back( i );
+  }
+  build( path, chain, []( int i ) { return i; } );
+  rerootingCheck( path, 600, "rerooting path" );
+
+  // Levels wide enough to be split between threads
+  Tree wide;
+  std::vector<std::vector<int>> fans( 1 + 100 + 10000 );
+  for ( int i = 0; i < 100; ++i ) {
+    fans[ 0 ].push_back( 1 + i );
+    for ( int j = 0; j < 100; ++j ) {
+      fans[ 1 + i ].push_back( 101 + i * 100 + j );
+    }
+  }
+  build( wide, fans, []( int i ) { return i; } );
+  rerootingCheck( wide, 50, "rerooting wide tree" );
+}
+
+//=====================================================================
+// Merkle Hash
+// Every hash after random edits, many of them to a wide node, against the
+// hash of a deep copy, which computes them from scratch. Values of augmented nodes are written
+// through data( value ) only, also from the iterators.
+typedef blib::container::tree::MerkleNode<int> MerkleNode;
+typedef blib::container::tree::NTree<MerkleNode> MerkleTree;
+
+static_assert( std::is_const<std::remove_reference<decltype( std::declval<MerkleNode&>( ).data( ) )>::type>::value,
+               "augmented values are read only" );
+static_assert( !std::is_const<std::remove_reference<decltype( std::declval<Node&>( ).data( ) )>::type>::value,
+               "plain values are writable" );
+
+bool sameHashes( MerkleTree const& aTree ) {
+  const MerkleTree fresh = aTree.deep_clone( );
+  std::vector<MerkleNode const*> nodes;
+  std::vector<MerkleNode const*> expected;
+  std::vector<int> parents;
+  preorder( aTree.root( ), nodes, parents );
+  preorder( fresh.root( ), expected, parents );
+  bool ret = nodes.size( ) == expected.size( );
+  for ( std::size_t i = 0; ret && i < nodes.size( ); ++i ) {
+    ret = nodes[ i ]->summary( ) == expected[ i ]->summary( );
+  }
+  return ret;
+}
+
+void merkleTest( ) {
+  std::mt19937 rng( 18 );
+  MerkleTree tree;
+  build( tree, randomShape( 300, 19 ), []( int i ) { return i % 7; } );
+  // A wide root, which a third of the edits go to
+  for ( int i = 0; i < 60; ++i ) {
+    tree.root( ).addChild( i % 7 );
+  }
+  check( sameHashes( tree ), "merkle hashes after building" );
+  for ( int edit = 0; edit < 300; ++edit ) {
+    std::vector<MerkleNode*> nodes;
+    std::vector<int> parents;
+    preorder( tree.root( ), nodes, parents );
+    MerkleNode& n = rng( ) % 3 ? *nodes[ rng( ) % nodes.size( ) ] : tree.root( );
+    const int value = static_cast< int >( rng( ) % 20 );
+    switch ( rng( ) % 5 ) {
+    case 0: {
+      auto it = tree.pre_order_begin( );
+      std::advance( it, rng( ) % nodes.size( ) );
+      it->data( value );
+      break;
+    }
+    case 1:
+      n.addChild( value );
+      break;
+    case 2: {
+      MerkleNode leaf;
+      leaf.data( value );
+      n.insertChild( std::next( n.begin( ), static_cast< std::ptrdiff_t >( rng( ) % ( n.numberOfChildren( ) + 1 ) ) ), leaf );
+      break;
+    }
+    case 3:
+      if ( n.numberOfChildren( ) ) {
+        n.removeChild( std::next( n.begin( ), static_cast< std::ptrdiff_t >( rng( ) % n.numberOfChildren( ) ) ) );
+      }
+      break;
+    default:
+      n.clearData( );
+      break;
+    }
+    if ( !sameHashes( tree ) ) {
+      check( false, "merkle hashes after edit " + std::to_string( edit ) );
+      break;
+    }
+  }
+  const MerkleTree copy = tree.deep_clone( );
+  check( blib::container::tree::structurallyEqual( tree, copy ), "merkle equal to a copy" );
+  tree.root( ).data( 1000 );
+  check( !blib::container::tree::structurallyEqual( tree, copy, false ), "merkle unequal after a write" );
+}
+
+//=====================================================================
+// Subtree Aggregates
+// Random writes, cleared values, inserts and removals, then every node's
+// aggregate against a fold of its subtree. The invertible monoids update by
+// subtraction, SubtreeMax by rescanning narrow nodes and through the
+// tournament tree of wide ones. Values are written through the nodes and
+// through the iterators; data( ) itself is read only.
+static_assert( std::is_const<std::remove_reference<decltype(
+                 std::declval<blib::container::tree::AggregateNode<int, blib::container::tree::SubtreeSize>&>( ).data( ) )>::type>::value,
+               "aggregate values are read only" );
+
+template<typename Monoid>
+bool sameAggregates( blib::container::tree::AggregateNode<int, Monoid> const& aRoot ) {
+  typedef blib::container::tree::AggregateNode<int, Monoid> NodeType;
+  std::vector<NodeType const*> nodes;
+  std::vector<int> parents;
+  preorder( aRoot, nodes, parents );
+  std::vector<typename Monoid::ValueType> folds( nodes.size( ) );
+  for ( std::size_t i = nodes.size( ); i-- > 0; ) {
+    folds[ i ] = Monoid::lift( *nodes[ i ] );
+  }
+  bool ret = true;
+  for ( std::size_t i = nodes.size( ); i-- > 0; ) {
+    ret = ret && blib::container::tree::subtreeAggregate( *nodes[ i ] ) == folds[ i ];
+    if ( parents[ i ] >= 0 ) {
+      Monoid::combine( folds[ parents[ i ] ], folds[ i ] );
+    }
+  }
+  return ret;
+}
+
+template<typename Monoid>
+void aggregateCheck( std::string const& aWhat ) {
+  typedef blib::container::tree::AggregateNode<int, Monoid> NodeType;
+  typedef blib::container::tree::NTree<NodeType> TreeType;
+  std::mt19937 rng( 9 );
+  TreeType tree;
+  build( tree, randomShape( 300, 10 ), []( int i ) { return i % 50; } );
+  check( sameAggregates<Monoid>( tree.root( ) ), aWhat + " after building" );
+  for ( int edit = 0; edit < 400; ++edit ) {
+    std::vector<NodeType*> nodes;
+    std::vector<int> parents;
+    preorder( tree.root( ), nodes, parents );
+    NodeType& n = *nodes[ rng( ) % nodes.size( ) ];
+    const int value = static_cast< int >( rng( ) % 100 ) - 50;
+    switch ( rng( ) % 7 ) {
+    case 0:
+      n.data( value );
+      break;
+    case 5: {
+      const std::size_t steps = rng( ) % nodes.size( );
+      if ( rng( ) % 2 ) {
+        auto it = tree.level_order_begin( );
+        std::advance( it, steps );
+        it->data( value );
+      }
+      else {
+        auto it = tree.post_order_begin( );
+        std::advance( it, steps );
+        ( *it ).data( value );
+      }
+      break;
+    }
+    case 1:
+      n.clearData( );
+      break;
+    case 2: {
+      // Writes to the node added from must not reach the tree
+      NodeType leaf;
+      leaf.data( value );
+      n.addChild( leaf );
+      leaf.data( value + 1000 );
+      break;
+    }
+    case 3: {
+      NodeType leaf;
+      leaf.data( value );
+      n.insertChild( std::next( n.begin( ), static_cast< std::ptrdiff_t >( rng( ) % ( n.numberOfChildren( ) + 1 ) ) ), leaf );
+      leaf.clearData( );
+      break;
+    }
+    case 4:
+      if ( n.numberOfChildren( ) ) {
+        n.removeChild( std::next( n.begin( ), static_cast< std::ptrdiff_t >( rng( ) % n.numberOfChildren( ) ) ) );
+      }
+      break;
+    default:
+      n.data( n ? n.data( ) - value : value );
+      break;
+    }
+    if ( !sameAggregates<Monoid>( tree.root( ) ) ) {
+      check( false, aWhat + " after edit " + std::to_string( edit ) );
+      break;
+    }
+  }
+
+  // One node grown past 64 children and shrunk to none again, its
+  // children and grandchildren written with values from a wide range
+  TreeType flat;
+  flat.root( ).addChild( 0 );
+  NodeType& wide = flat.root( )[ 0 ];
+  for ( int edit = 0; edit < 500; ++edit ) {
+    const bool growing = edit < 200;
+    const std::size_t size = wide.numberOfChildren( );
+    const int value = static_cast< int >( rng( ) % 1000 );
+    const unsigned op = rng( ) % 4;
+    if ( op == 0 && growing ) {
+      wide.addChild( value );
+    }
+    else if ( op == 1 && growing ) {
+      NodeType leaf;
+      leaf.data( value );
+      wide.insertChild( std::next( wide.begin( ), static_cast< std::ptrdiff_t >( rng( ) % ( size + 1 ) ) ), leaf );
+    }
+    else if ( size && op == 0 ) {
+      wide.removeChild( std::next( wide.begin( ), static_cast< std::ptrdiff_t >( size - 1 ) ) );
+    }
+    else if ( size && op == 1 ) {
+      wide.removeChild( std::next( wide.begin( ), static_cast< std::ptrdiff_t >( rng( ) % size ) ) );
+    }
+    else if ( size ) {
+      NodeType& c = wide[ rng( ) % size ];
+      if ( op == 2 ) {
+        c.data( value );
+      }
+      else if ( c.numberOfChildren( ) ) {
+        c[ 0 ].data( value );
+      }
+      else {
+        c.addChild( value );
+      }
+    }
+    if ( !sameAggregates<Monoid>( flat.root( ) ) ) {
+      check( false, aWhat + " after wide edit " + std::to_string( edit ) );
+      break;
+    }
+  }
+}
+
+void aggregateTest( ) {
+  aggregateCheck<blib::container::tree::SubtreeSum<long long>>( "sum" );
+  aggregateCheck<blib::container::tree::SubtreeSize>( "size" );
+  aggregateCheck<blib::container::tree::SubtreeMax<int>>( "max" );
+}
+
+//=====================================================================
+// Path Query
+// select( ) and selectAll( ) against a step by step evaluation on the
+// preorder: every parent of the context, or every node below it for //,
+// then the children that pass the test and the predicates in order. The
+// trees mix wide and narrow nodes and nodes without data so that every
+// plan is taken.
+typedef blib::container::tree::PathQuery<int> Query;
+
+std::vector<std::uint32_t> evaluate( Query const& aQuery, std::vector<Node*> const& aNodes,
+                                     std::vector<std::vector<int>> const& aChildren ) {
+  using blib::container::tree::QueryAxis;
+  using blib::container::tree::QueryOp;
+  // -1 stands for the parent of the root
+  std::set<int> context = { -1 };
+  for ( auto const& step : aQuery.steps( ) ) {
+    std::set<int> parents;
+    for ( int c : context ) {
+      std::vector<int> stack( 1, c );
+      while ( !stack.empty( ) ) {
+        const int p = stack.back( );
+        stack.pop_back( );
+        parents.insert( p );
+        if ( step.axis == QueryAxis::Descendant ) {
+          if ( p < 0 ) {
+            stack.push_back( 0 );
+          }
+          else {
+            stack.insert( stack.end( ), aChildren[ p ].begin( ), aChildren[ p ].end( ) );
+          }
+        }
+      }
+    }
+    std::set<int> next;
+    for ( int p : parents ) {
+      std::vector<int> passed;
+      for ( int k : p < 0 ? std::vector<int>( 1, 0 ) : aChildren[ p ] ) {
+        if ( !step.keyed || ( *aNodes[ k ] && aNodes[ k ]->data( ) == step.key ) ) {
+          passed.push_back( k );
+        }
+      }
+      for ( auto const& predicate : step.predicates ) {
+        std::vector<int> kept;
+        for ( std::size_t i = 0; i < passed.size( ); ++i ) {
+          if ( predicate.op == QueryOp::Position ? i + 1 == predicate.position
+                                                 : *aNodes[ passed[ i ] ] && predicate.test( aNodes[ passed[ i ] ]->data( ) ) ) {
+            kept.push_back( passed[ i ] );
+          }
+        }
+        passed.swap( kept );
+      }
+      next.insert( passed.begin( ), passed.end( ) );
+    }
+    context.swap( next );
+  }
+  return std::vector<std::uint32_t>( context.begin( ), context.end( ) );
+}
+
+void pathQueryTest( ) {
+  using blib::container::tree::QueryOp;
+  const char* texts[] = { "/0", "//3", "/0/1", "/0//2/*", "//*[>4]", "//*[2]", "/0/*[3][=1]", "//1//2", "//*//7",
+                          "//*/1[1]", "/ 0 / * [ <= 2 ] [1]", "//*[!=3][2]//*[>=5]", "//9//*//9", "/0//*/*[4]",
+                          "//*//*//5[1]", "//*[<0]", "/1" };
+  std::vector<Query> queries( std::begin( texts ), std::end( texts ) );
+  queries.push_back( Query( ) );
+  queries.back( ).descendant( ).where( QueryOp::Less, 3 ).descendant( 2 ).at( 1 );
+  queries.push_back( Query( ) );
+  queries.back( ).child( 0 ).child( ).where( QueryOp::GreaterEqual, 1 ).descendant( 8 );
+
+  std::mt19937 rng( 15 );
+  std::set<blib::container::tree::QueryPlan> plans;
+  for ( int round = 0; round < 30; ++round ) {
+    // A third of the nodes hang from the root, which makes it wide
+    const int n = 1 + static_cast< int >( rng( ) % 400 );
+    const int values = 3 + static_cast< int >( rng( ) % 8 );
+    std::vector<std::vector<int>> shape( n );
+    for ( int i = 1; i < n; ++i ) {
+      shape[ rng( ) % 3 ? rng( ) % i : 0 ].push_back( i );
+    }
+    std::vector<int> data( n );
+    for ( auto& v : data ) {
+      v = static_cast< int >( rng( ) % values );
+    }
+    data[ 0 ] = 0;
+    Tree tree;
+    build( tree, shape, [ &data ]( int i ) { return data[ i ]; } );
+    std::vector<Node*> nodes;
+    std::vector<int> parents;
+    preorder( tree.root( ), nodes, parents );
+    for ( std::size_t i = 1; i < nodes.size( ); i += 17 ) {
+      nodes[ i ]->clearData( );
+    }
+    std::vector<std::vector<int>> children( nodes.size( ) );
+    for ( std::size_t i = 1; i < nodes.size( ); ++i ) {
+      children[ parents[ i ] ].push_back( static_cast< int >( i ) );
+    }
+
+    const blib::container::tree::QueryIndex<Tree> index( tree );
+    const std::vector<std::vector<std::uint32_t>> batch = index.selectAll( queries );
+    for ( std::size_t q = 0; q < queries.size( ); ++q ) {
+      const std::vector<std::uint32_t> expected = evaluate( queries[ q ], nodes, children );
+      const std::string what = "query " + std::to_string( q ) + " on tree " + std::to_string( round );
+      check( index.select( queries[ q ] ) == expected, what );
+      check( batch[ q ] == expected, what + " in a batch" );
+      for ( auto p : index.plan( queries[ q ] ) ) {
+        plans.insert( p );
+      }
+    }
+  }
+  check( plans.size( ) == 5, "every query plan taken" );
+
+  for ( const char* bad : { "", "a", "/[1]", "/*[0]", "/*[1", "/x", "/\"1" } ) {
+    checkThrows<std::invalid_argument>( [ bad ]( ) { Query q( bad ); }, std::string( "query '" ) + bad + "'" );
+  }
+  const blib::container::tree::PathQuery<std::string> quoted( "/a b//\"c/d\"[!=x]" );
+  check( quoted.steps( )[ 0 ].key == "a b" && quoted.steps( )[ 1 ].key == "c/d", "quoted query values" );
+}
+
+//=====================================================================
+// Subtree View
+// Heights and depths count edges from the root of the view, which is at 0
+void viewTest( ) {
+  Tree lone;
+  lone.root( 1 );
+  check( lone.view( ).height( ) == 0, "view height of a lone root" );
+
+  Tree tree;
+  build( tree, randomShape( 500, 7 ), []( int i ) { return i; } );
+  std::vector<Node*> nodes;
+  std::vector<int> parents;
+  preorder( tree.root( ), nodes, parents );
+  for ( std::size_t i = 0; i < nodes.size( ); i += 37 ) {
+    const blib::container::tree::SubtreeView<Node> view( *nodes[ i ] );
+    std::size_t height = 0;
+    std::size_t size = 0;
+    for ( auto it = view.pre_order_begin( ); it != view.pre_order_end( ); ++it ) {
+      height = std::max( height, it.depth( ) );
+      check( view.depth( *it ) == it.depth( ), "view depth of node " + std::to_string( it->data( ) ) );
+      ++size;
+    }
+    check( view.height( ) == height, "view height below node " + std::to_string( i ) );
+    check( view.height( ) == blib::container::tree::profile( *nodes[ i ] ).height, "view height like the profile" );
+    check( view.size( ) == size, "view size below node " + std::to_string( i ) );
+  }
+}
+
+//=====================================================================
+// Tree Iterators
+// Every traversal yields the nodes stored in the tree, so writes through a
+// mutable iterator reach the tree and two iterators at one node compare
+// equal. A const tree walks the same nodes, and so do the child iterators
+// of its nodes, as Node const&.
+static_assert( std::is_same<decltype( *std::declval<Tree::const_pre_order_iterator>( ) ), Node const&>::value,
+               "const pre-order yields const nodes" );
+static_assert( std::is_same<decltype( *std::declval<Tree const&>( ).level_order_begin( ) ), Node const&>::value,
+               "const tree level order yields const nodes" );
+static_assert( std::is_same<decltype( *std::declval<Node const&>( ).cbegin( ) ), Node const&>::value,
+               "const child iterators yield const nodes" );
+
+template<typename Iterator>
+std::vector<Node const*> addresses( Iterator aBegin, Iterator aEnd ) {
+  std::vector<Node const*> ret;
+  for ( Iterator it = aBegin; it != aEnd; ++it ) {
+    ret.push_back( &*it );
+  }
+  return ret;
+}
+
+// Iterators stepped to one node on their own compare equal, and stop
+// doing so once one of them moves on
+template<typename Iterator>
+bool sameNodeEqual( std::function<Iterator( )> aStart, Iterator aEnd ) {
+  bool ret = true;
+  std::size_t k = 0;
+  for ( Iterator it = aStart( ); it != aEnd && ret; ++it, ++k ) {
+    if ( k % 97 != 0 ) {
+      continue;
+    }
+    Iterator other = aStart( );
+    for ( std::size_t i = 0; i < k; ++i ) {
+      ++other;
+    }
+    ret = other == it && !( other != it );
+    ++other;
+    ret = ret && other != it;
+  }
+  return ret;
+}
+
+void iteratorTest( ) {
+  Tree tree;
+  const int size = 1500;
+  build( tree, randomShape( size, 50 ), []( int i ) { return i; } );
+  Tree const& fixed = tree;
+  std::vector<Node*> nodes;
+  std::vector<int> parents;
+  preorder( tree.root( ), nodes, parents );
+  const std::vector<Node const*> pre( nodes.begin( ), nodes.end( ) );
+  std::vector<Node const*> level( 1, &tree.root( ) );
+  for ( std::size_t i = 0; i < level.size( ); ++i ) {
+    for ( auto& c : NodeUtility::children( *level[ i ] ) ) {
+      level.push_back( &c );
+    }
+  }
+  // Parents before children, last child first, reversed
+  std::vector<Node const*> post;
+  std::vector<Node const*> stack( 1, &tree.root( ) );
+  while ( !stack.empty( ) ) {
+    Node const* n = stack.back( );
+    stack.pop_back( );
+    post.push_back( n );
+    for ( auto& c : NodeUtility::children( *n ) ) {
+      stack.push_back( &c );
+    }
+  }
+  std::reverse( post.begin( ), post.end( ) );
+
+  check( addresses( tree.pre_order_begin( ), tree.pre_order_end( ) ) == pre, "pre-order yields the stored nodes" );
+  check( addresses( tree.post_order_begin( ), tree.post_order_end( ) ) == post, "post-order yields the stored nodes" );
+  check( addresses( tree.level_order_begin( ), tree.level_order_end( ) ) == level, "level order yields the stored nodes" );
+  check( addresses( fixed.pre_order_begin( ), fixed.pre_order_end( ) ) == pre, "const pre-order yields the stored nodes" );
+  check( addresses( fixed.post_order_begin( ), fixed.post_order_end( ) ) == post, "const post-order yields the stored nodes" );
+  check( addresses( fixed.level_order_begin( ), fixed.level_order_end( ) ) == level, "const level order yields the stored nodes" );
+
+  check( sameNodeEqual<Tree::pre_order_iterator>( [ &tree ]( ) { return tree.pre_order_begin( ); }, tree.pre_order_end( ) ),
+         "pre-order iterators at one node are equal" );
+  check( sameNodeEqual<Tree::post_order_iterator>( [ &tree ]( ) { return tree.post_order_begin( ); }, tree.post_order_end( ) ),
+         "post-order iterators at one node are equal" );
+  check( sameNodeEqual<Tree::level_order_iterator>( [ &tree ]( ) { return tree.level_order_begin( ); }, tree.level_order_end( ) ),
+         "level order iterators at one node are equal" );
+  check( sameNodeEqual<Tree::const_pre_order_iterator>( [ &fixed ]( ) { return fixed.pre_order_begin( ); }, fixed.pre_order_end( ) ),
+         "const pre-order iterators at one node are equal" );
+  check( sameNodeEqual<Tree::const_post_order_iterator>( [ &fixed ]( ) { return fixed.post_order_begin( ); }, fixed.post_order_end( ) ),
+         "const post-order iterators at one node are equal" );
+  check( sameNodeEqual<Tree::const_level_order_iterator>( [ &fixed ]( ) { return fixed.level_order_begin( ); }, fixed.level_order_end( ) ),
+         "const level order iterators at one node are equal" );
+
+  // Children of every node of the const tree, forwards, backwards and by index
+  bool children = true;
+  for ( auto it = fixed.pre_order_begin( ); it != fixed.pre_order_end( ) && children; ++it ) {
+    Node const& n = *it;
+    auto const& stored = NodeUtility::children( n );
+    children = static_cast< std::size_t >( n.numberOfChildren( ) ) == stored.size( );
+    std::size_t i = 0;
+    for ( auto c = n.cbegin( ); c != n.cend( ) && children; ++c, ++i ) {
+      children = &*c == &stored[ i ] && &n[ i ] == &stored[ i ];
+    }
+    children = children && i == stored.size( );
+    i = 0;
+    for ( Node const& c : n ) {
+      children = children && i < stored.size( ) && &c == &stored[ i++ ];
+    }
+    for ( auto c = n.child_node_rtol_begin( ); c != n.child_node_rtol_end( ) && children; ++c ) {
+      children = i > 0 && &*c == &stored[ --i ];
+    }
+    children = children && i == 0;
+  }
+  check( children, "const child iterators yield the stored children" );
+
+  // Writes through every kind of mutable iterator, children of the root
+  // get four of them
+  std::vector<int> before;
+  for ( Node* n : nodes ) {
+    before.push_back( n->data( ) );
+  }
+  for ( auto it = tree.pre_order_begin( ); it != tree.pre_order_end( ); ++it ) {
+    it->data( it->data( ) + size );
+  }
+  for ( auto it = tree.post_order_begin( ); it != tree.post_order_end( ); ++it ) {
+    ( *it ).data( it->data( ) + size );
+  }
+  for ( auto it = tree.level_order_begin( ); it != tree.level_order_end( ); ++it ) {
+    it->data( it->data( ) + size );
+  }
+  for ( Node& c : tree.root( ) ) {
+    c.data( c.data( ) + size );
+  }
+  bool written = true;
+  for ( std::size_t i = 0; i < nodes.size( ); ++i ) {
+    written = written && nodes[ i ]->data( ) == before[ i ] + ( parents[ i ] == 0 ? 4 : 3 ) * size;
+  }
+  check( written, "writes through iterators reach the tree" );
+}
+
+//=====================================================================
+// Traversal Limits
+// Pre-order and level order walks cut by a maximum depth, a descend
+// predicate and skip_children( ) against a brute force walk applying the
+// same rule: a node is always visited, its children only when it lies
+// above the maximum depth, passes the predicate and was not skipped.
+typedef std::vector<std::pair<int, std::size_t>> Walk;
+
+bool skipped( Node const& aNode ) {
+  return aNode.data( ) % 7 == 3;
+}
+
+template<typename Iterator>
+Walk walk( Iterator aBegin, Iterator aEnd, bool aSkip ) {
+  Walk ret;
+  for ( Iterator it = aBegin; it != aEnd; ++it ) {
+    ret.push_back( std::make_pair( it->data( ), it.depth( ) ) );
+    if ( aSkip && skipped( *it ) ) {
+      it.skip_children( );
+    }
+  }
+  return ret;
+}
+
+Walk limitedWalk( Node& aRoot, bool aLevelOrder, std::size_t aMaxDepth, Tree::DescendPredicate const& aDescend, bool aSkip ) {
+  Walk ret;
+  std::deque<std::pair<Node*, std::size_t>> pending( 1, std::make_pair( &aRoot, std::size_t( 0 ) ) );
+  while ( !pending.empty( ) ) {
+    Node* n;
+    std::size_t depth;
+    if ( aLevelOrder ) {
+      std::tie( n, depth ) = pending.front( );
+      pending.pop_front( );
+    }
+    else {
+      std::tie( n, depth ) = pending.back( );
+      pending.pop_back( );
+    }
+    ret.push_back( std::make_pair( n->data( ), depth ) );
+    if ( depth < aMaxDepth && ( !aDescend || aDescend( *n ) ) && !( aSkip && skipped( *n ) ) ) {
+      auto& children = NodeUtility::children( *n );
+      if ( aLevelOrder ) {
+        for ( auto& c : children ) {
+          pending.push_back( std::make_pair( &c, depth + 1 ) );
+        }
+      }
+      else {
+        for ( std::size_t i = children.size( ); i-- > 0; ) {
+          pending.push_back( std::make_pair( &children[ i ], depth + 1 ) );
+        }
+      }
+    }
+  }
+  return ret;
+}
+
+void limitsTest( ) {
+  Tree tree;
+  build( tree, randomShape( 2000, 39 ), []( int i ) { return i; } );
+  Tree const& fixed = tree;
+  const std::size_t depths[] = { 0, 1, 3, 6, Tree::UnboundedDepth };
+  const Tree::DescendPredicate predicates[] = {
+    Tree::DescendPredicate( ),
+    []( Node const& aNode ) { return aNode.data( ) % 5 != 4; }
+  };
+  check( limitedWalk( tree.root( ), false, 3, predicates[ 1 ], true ).size( ) > 20, "limited walk goes below the root" );
+  check( limitedWalk( tree.root( ), false, Tree::UnboundedDepth, predicates[ 0 ], false ).size( ) == 2000,
+         "unlimited walk visits every node" );
+
+  for ( std::size_t d = 0; d < sizeof( depths ) / sizeof( depths[ 0 ] ); ++d ) {
+    for ( std::size_t p = 0; p < 2; ++p ) {
+      for ( int skip = 0; skip < 2; ++skip ) {
+        const std::string what = " to depth " + std::to_string( depths[ d ] ) + ( p ? " with a predicate" : "" )
+                                 + ( skip ? " skipping children" : "" );
+        const Walk pre = limitedWalk( tree.root( ), false, depths[ d ], predicates[ p ], skip != 0 );
+        const Walk level = limitedWalk( tree.root( ), true, depths[ d ], predicates[ p ], skip != 0 );
+        check( walk( tree.pre_order_begin( depths[ d ], predicates[ p ] ), tree.pre_order_end( ), skip != 0 ) == pre,
+               "pre-order" + what );
+        check( walk( fixed.pre_order_begin( depths[ d ], predicates[ p ] ), fixed.pre_order_end( ), skip != 0 ) == pre,
+               "const pre-order" + what );
+        check( walk( tree.level_order_begin( depths[ d ], predicates[ p ] ), tree.level_order_end( ), skip != 0 ) == level,
+               "level order" + what );
+        check( walk( fixed.level_order_begin( depths[ d ], predicates[ p ] ), fixed.level_order_end( ), skip != 0 ) == level,
+               "const level order" + what );
+      }
+    }
+  }
+  const Walk all = limitedWalk( tree.root( ), false, Tree::UnboundedDepth, predicates[ 0 ], true );
+  check( walk( tree.pre_order_begin( ), tree.pre_order_end( ), true ) == all, "unlimited pre-order skipping children" );
+}
+
+//=====================================================================
+// Best First
+// The d-ary heap against std::priority_queue, then best first walks and
+// topK on scores that fall from parent to child, where they must come out
+// in descending order, and on random scores, where they must reach the
+// nodes a brute force search admits. A frontier left half full by an
+// abandoned walk must not leak into the next walk sharing it.
+template<typename Less, std::size_t Arity>
+void heapCheck( std::string const& aWhat ) {
+  blib::container::tree::_private::DaryHeap<int, Less, Arity> heap;
+  std::priority_queue<int, std::vector<int>, Less> expected;
+  std::mt19937 rng( static_cast< unsigned >( Arity ) );
+  bool same = true;
+  for ( int round = 0; round < 2; ++round ) {
+    for ( int i = 0; i < 5000 && same; ++i ) {
+      if ( rng( ) % 10 < 6 || expected.empty( ) ) {
+        const int value = static_cast< int >( rng( ) % 1000 );
+        heap.push( value );
+        expected.push( value );
+      }
+      else {
+        heap.pop( );
+        expected.pop( );
+      }
+      same = heap.size( ) == expected.size( ) && ( expected.empty( ) || heap.top( ) == expected.top( ) );
+    }
+    heap.clear( );
+    expected = std::priority_queue<int, std::vector<int>, Less>( );
+    same = same && heap.empty( );
+  }
+  check( same, "heap " + aWhat );
+}
+
+// Ids of the nodes reached from the root through nodes scoring at least
+// aBound, not expanding the skipped ones, in ascending order
+std::vector<int> admitted( std::vector<std::vector<int>> const& aShape, std::vector<int> const& aScores, int aBound, bool aSkip ) {
+  std::vector<int> ret;
+  std::vector<int> pending;
+  if ( aScores[ 0 ] >= aBound ) {
+    pending.push_back( 0 );
+  }
+  while ( !pending.empty( ) ) {
+    const int id = pending.back( );
+    pending.pop_back( );
+    ret.push_back( id );
+    if ( aSkip && id % 7 == 3 ) {
+      continue;
+    }
+    for ( int c : aShape[ id ] ) {
+      if ( aScores[ c ] >= aBound ) {
+        pending.push_back( c );
+      }
+    }
+  }
+  std::sort( ret.begin( ), ret.end( ) );
+  return ret;
+}
+
+// Ids in visiting order, checking the score reported for each
+template<typename Iterator>
+std::vector<int> bestFirst( Iterator aBegin, Iterator aEnd, std::vector<int> const& aScores, bool aSkip ) {
+  std::vector<int> ret;
+  for ( Iterator it = aBegin; it != aEnd; ++it ) {
+    ret.push_back( it.score( ) == aScores[ it->data( ) ] ? it->data( ) : -1 );
+    if ( aSkip && skipped( *it ) ) {
+      it.skip_children( );
+    }
+  }
+  return ret;
+}
+
+std::vector<int> scoresOf( std::vector<int> const& aIds, std::vector<int> const& aScores ) {
+  std::vector<int> ret;
+  for ( int id : aIds ) {
+    ret.push_back( id < 0 ? std::numeric_limits<int>::min( ) : aScores[ id ] );
+  }
+  return ret;
+}
+
+std::vector<int> sorted( std::vector<int> aValues ) {
+  std::sort( aValues.begin( ), aValues.end( ) );
+  return aValues;
+}
+
+void bestFirstTest( ) {
+  heapCheck<std::less<int>, 2>( "of arity 2" );
+  heapCheck<std::less<int>, 4>( "of arity 4" );
+  heapCheck<std::greater<int>, 3>( "of arity 3 ordered by greater" );
+
+  const int size = 3000;
+  const std::vector<std::vector<int>> shape = randomShape( size, 40 );
+  std::mt19937 rng( 40 );
+  std::vector<int> falling( size, 1000000 );
+  std::vector<int> noisy( size, 0 );
+  for ( int id = 0; id < size; ++id ) {
+    for ( int c : shape[ id ] ) {
+      falling[ c ] = falling[ id ] - static_cast< int >( rng( ) % 50 );
+    }
+    noisy[ id ] = static_cast< int >( rng( ) % 1000 );
+  }
+  Tree tree;
+  build( tree, shape, []( int i ) { return i; } );
+  std::size_t scored = 0;
+  auto byFalling = [ &falling, &scored ]( Node const& aNode ) {
+    ++scored;
+    return falling[ aNode.data( ) ];
+  };
+  auto byNoise = [ &noisy ]( Node const& aNode ) { return noisy[ aNode.data( ) ]; };
+  const Tree::best_first_iterator<int> end = tree.best_first_end<int>( );
+  std::vector<int> all( size );
+  for ( int id = 0; id < size; ++id ) {
+    all[ id ] = id;
+  }
+  std::vector<int> descending = falling;
+  std::sort( descending.rbegin( ), descending.rend( ) );
+
+  // Falling scores come out in descending order, bounded or not
+  const std::vector<int> order = bestFirst( tree.best_first_begin( byFalling ), end, falling, false );
+  check( sorted( order ) == all && scoresOf( order, falling ) == descending, "best first in descending order" );
+  for ( int bound : { descending[ 0 ] + 1, descending[ 0 ], descending[ 40 ], descending[ size / 2 ], descending[ size - 1 ] } ) {
+    const std::string what = " above " + std::to_string( bound );
+    const std::vector<int> bounded = bestFirst( tree.best_first_begin( byFalling, bound ), end, falling, false );
+    const std::vector<int> scores = scoresOf( bounded, falling );
+    check( sorted( bounded ) == admitted( shape, falling, bound, false ), "bounded best first admits" + what );
+    check( std::is_sorted( scores.rbegin( ), scores.rend( ) ), "bounded best first in descending order" + what );
+  }
+
+  // Random scores reach what the bound and skip_children( ) let through
+  const std::vector<int> noise = bestFirst( tree.best_first_begin( byNoise ), end, noisy, false );
+  check( sorted( noise ) == all, "best first on random scores visits every node" );
+  for ( int bound : { 0, 100, 300 } ) {
+    for ( int skip = 0; skip < 2; ++skip ) {
+      const std::string what = " above " + std::to_string( bound ) + ( skip ? " skipping children" : "" );
+      check( sorted( bestFirst( tree.best_first_begin( byNoise, bound ), end, noisy, skip != 0 ) ) == admitted( shape, noisy, bound, skip != 0 ),
+             "best first on random scores admits" + what );
+    }
+  }
+
+  // topK stops at its last result, having scored only the root and the
+  // children of the results before it
+  const std::size_t counts[] = { 0, 1, 10, 100, std::size_t( size ), std::size_t( size ) + 5 };
+  for ( std::size_t k : counts ) {
+    const std::string what = " of " + std::to_string( k );
+    scored = 0;
+    const std::vector<std::reference_wrapper<Node>> best = tree.topK( k, byFalling );
+    std::vector<int> ids;
+    for ( Node& n : best ) {
+      ids.push_back( n.data( ) );
+    }
+    const std::size_t taken = std::min( k, std::size_t( size ) );
+    const std::size_t expanded = k > std::size_t( size ) ? taken : ( k > 0 ? k - 1 : 0 );
+    std::size_t expected = 1;
+    for ( std::size_t i = 0; i < expanded; ++i ) {
+      expected += shape[ ids[ i ] ].size( );
+    }
+    check( ids.size( ) == taken && scoresOf( ids, falling ) == std::vector<int>( descending.begin( ), descending.begin( ) + taken ),
+           "topK" + what );
+    check( scored == expected, "topK scores only what it expands" + what );
+  }
+  const int cut = descending[ 5 ];
+  const std::vector<std::reference_wrapper<Node>> bounded = tree.topK( 10, byFalling, cut );
+  check( bounded.size( ) == 6 && falling[ bounded.back( ).get( ).data( ) ] == cut, "bounded topK stops at the bound" );
+
+  // A shared frontier starts every walk empty
+  auto frontier = std::make_shared<Tree::BestFirstFrontier<int>>( );
+  auto abandoned = tree.best_first_begin( byNoise, 0, frontier );
+  for ( int i = 0; i < 50; ++i ) {
+    ++abandoned;
+  }
+  check( abandoned.pending( ) > 0, "abandoned walk leaves the frontier full" );
+  for ( int bound : { 300, 0 } ) {
+    const std::string what = " above " + std::to_string( bound );
+    check( bestFirst( tree.best_first_begin( byNoise, bound, frontier ), end, noisy, true )
+           == bestFirst( tree.best_first_begin( byNoise, bound ), end, noisy, true ), "best first reusing a frontier" + what );
+  }
+  std::vector<int> fresh;
+  std::vector<int> reused;
+  for ( Node& n : tree.topK( 20, byNoise, 0 ) ) {
+    fresh.push_back( n.data( ) );
+  }
+  ++abandoned;
+  for ( Node& n : tree.topK( 20, byNoise, 0, frontier ) ) {
+    reused.push_back( n.data( ) );
+  }
+  check( reused == fresh && scoresOf( reused, noisy ) == scoresOf( fresh, noisy ), "topK reusing a frontier" );
+}
+
+//=====================================================================
+// Deep Clone and Map
+// Copies made on one thread and on several against their source: same
+// shape and values, parent handles naming the copy's own nodes, nothing
+// shared, and writes to either tree not reaching the other. A tree moved
+// from is left empty and shares nothing with the tree it moved to.
+void cloneTest( ) {
+  Tree source;
+  build( source, randomShape( 3000, 21 ), []( int i ) { return i; } );
+  std::vector<Node*> nodes;
+  std::vector<int> parents;
+  preorder( source.root( ), nodes, parents );
+  for ( std::size_t i = 3; i < nodes.size( ); i += 97 ) {
+    nodes[ i ]->clearData( );
+  }
+  const Tree original = source.deep_clone( );
+
+  for ( std::size_t threads = 1; threads <= 4; threads += 3 ) {
+    const std::string suffix = " on " + std::to_string( threads ) + " threads";
+    Tree copy = source.deep_clone( threads );
+    check( sameTree( copy.root( ), source.root( ) ), "clone equals its source" + suffix );
+    check( linked( copy.root( ) ), "clone parent handles" + suffix );
+    check( disjoint( source.root( ), copy.root( ) ), "clone shares nothing" + suffix );
+
+    // Writes to the copy stay there, and the other way around
+    std::vector<Node*> targets;
+    parents.clear( );
+    preorder( copy.root( ), targets, parents );
+    for ( std::size_t i = 0; i < targets.size( ); i += 11 ) {
+      targets[ i ]->data( -1 );
+    }
+    copy.root( ).addChild( -2 );
+    check( sameTree( source.root( ), original.root( ) ), "source untouched by writes to its clone" + suffix );
+    const Tree written = copy.deep_clone( );
+    nodes.clear( );
+    parents.clear( );
+    preorder( source.root( ), nodes, parents );
+    for ( std::size_t i = 0; i < nodes.size( ); i += 13 ) {
+      nodes[ i ]->data( -3 );
+    }
+    source.root( ).removeChild( source.root( ).begin( ) );
+    check( sameTree( copy.root( ), written.root( ) ), "clone untouched by writes to its source" + suffix );
+    source = original.deep_clone( );
+
+    // Same shape, converted payloads, nodes without data stay without
+    typedef blib::container::tree::Node<double> Halved;
+    blib::container::tree::NTree<Halved> mapped = source.map<double>( []( int aValue ) { return aValue / 2.0; }, threads );
+    std::vector<Halved*> halves;
+    std::vector<int> halfParents;
+    preorder( mapped.root( ), halves, halfParents );
+    nodes.clear( );
+    parents.clear( );
+    preorder( source.root( ), nodes, parents );
+    bool same = halves.size( ) == nodes.size( ) && halfParents == parents;
+    for ( std::size_t i = 0; same && i < nodes.size( ); ++i ) {
+      same = bool( *halves[ i ] ) == bool( *nodes[ i ] ) && ( !*nodes[ i ] || halves[ i ]->data( ) == nodes[ i ]->data( ) / 2.0 );
+    }
+    check( same, "map keeps the shape and converts the values" + suffix );
+    check( linked( mapped.root( ) ), "map parent handles" + suffix );
+    nodes[ 1 ]->data( 1000 );
+    check( halves[ 1 ]->data( ) == static_cast< double >( original.root( )[ 0 ].data( ) ) / 2.0, "map independent of its source" + suffix );
+    source = original.deep_clone( );
+  }
+
+  // Moving hands the nodes over and leaves an empty tree behind
+  Tree from = source.deep_clone( );
+  Tree moved( std::move( from ) );
+  check( linked( moved.root( ) ) && sameTree( moved.root( ), original.root( ) ), "moved tree" );
+  check( !from.root( ) && from.root( ).numberOfChildren( ) == 0, "tree moved from is empty" );
+  from.root( ).addChild( 1 );
+  check( moved.root( ).numberOfChildren( ) == original.root( ).numberOfChildren( ), "tree moved from shares nothing" );
+  Tree assigned;
+  assigned = std::move( moved );
+  check( linked( assigned.root( ) ) && sameTree( assigned.root( ), original.root( ) ), "move assigned tree" );
+  check( !moved.root( ) && moved.root( ).numberOfChildren( ) == 0, "tree move assigned from is empty" );
+  moved.root( 5 );
+  check( assigned.root( ).data( ) == original.root( ).data( ), "tree move assigned from shares nothing" );
+}
+
+//=====================================================================
+// Compaction
+// In every layout order, after inserts and removals have scattered the
+// storage: the same shape and values, parent handles naming the new nodes,
+// and summaries that later writes still keep right.
+void compactTest( ) {
+  typedef blib::container::tree::LayoutOrder LayoutOrder;
+  typedef blib::container::tree::AggregateNode<int, blib::container::tree::SubtreeSum<long long>> SumNode;
+  const LayoutOrder orders[] = { LayoutOrder::PreOrder, LayoutOrder::LevelOrder, LayoutOrder::VanEmdeBoas };
+  const char* names[] = { "pre order", "level order", "van Emde Boas" };
+  for ( int o = 0; o < 3; ++o ) {
+    const std::string suffix = std::string( " in " ) + names[ o ];
+    std::mt19937 rng( 23 + o );
+    Tree tree;
+    blib::container::tree::NTree<SumNode> sums;
+    MerkleTree hashes;
+    build( tree, randomShape( 2000, 24 ), []( int i ) { return i; } );
+    build( sums, randomShape( 2000, 24 ), []( int i ) { return i; } );
+    build( hashes, randomShape( 2000, 24 ), []( int i ) { return i; } );
+    for ( int edit = 0; edit < 200; ++edit ) {
+      std::vector<Node*> nodes;
+      std::vector<int> parents;
+      preorder( tree.root( ), nodes, parents );
+      Node& n = *nodes[ rng( ) % nodes.size( ) ];
+      if ( n.numberOfChildren( ) && rng( ) % 2 ) {
+        n.removeChild( std::next( n.begin( ), static_cast< std::ptrdiff_t >( rng( ) % n.numberOfChildren( ) ) ) );
+      }
+      else {
+        n.addChild( edit );
+      }
+    }
+    const Tree before = tree.deep_clone( );
+    tree.compact( orders[ o ] );
+    check( sameTree( tree.root( ), before.root( ) ), "compacted tree unchanged" + suffix );
+    check( linked( tree.root( ) ), "compacted parent handles" + suffix );
+
+    sums.compact( orders[ o ] );
+    hashes.compact( orders[ o ] );
+    check( linked( sums.root( ) ) && sameAggregates<blib::container::tree::SubtreeSum<long long>>( sums.root( ) ),
+           "compacted aggregates" + suffix );
+    check( linked( hashes.root( ) ) && sameHashes( hashes ), "compacted hashes" + suffix );
+    for ( int edit = 0; edit < 50; ++edit ) {
+      std::vector<SumNode*> nodes;
+      std::vector<int> parents;
+      preorder( sums.root( ), nodes, parents );
+      nodes[ rng( ) % nodes.size( ) ]->data( edit );
+      nodes[ rng( ) % nodes.size( ) ]->addChild( edit );
+    }
+    check( sameAggregates<blib::container::tree::SubtreeSum<long long>>( sums.root( ) ), "aggregates after writes to a compacted tree" + suffix );
+  }
+}
+
+//=====================================================================
+// Chain NTree
+// On trees made mostly of long chains and on branchy ones: every logical
+// node in pre, post and level order against the NTree's own traversals,
+// its depth and parent, and expand( ) giving back the tree.
+
+// Parent of node i is node i - 1 three times out of four
+std::vector<std::vector<int>> chainShape( int aNodes, unsigned aSeed ) {
+  std::vector<std::vector<int>> ret( aNodes );
+  std::mt19937 rng( aSeed );
+  for ( int i = 1; i < aNodes; ++i ) {
+    ret[ rng( ) % 4 ? i - 1 : rng( ) % i ].push_back( i );
+  }
+  return ret;
+}
+
+void chainTest( ) {
+  typedef blib::container::tree::ChainNTree<int> Chains;
+  for ( int round = 0; round < 6; ++round ) {
+    const bool chainy = round % 2 == 0;
+    const std::string what = std::string( chainy ? " of a chained tree " : " of a branchy tree " ) + std::to_string( round );
+    Tree tree;
+    const int size = 1 + round * 300;
+    build( tree, chainy ? chainShape( size, round ) : randomShape( size, round ), []( int i ) { return i; } );
+    const Chains chains( tree );
+    Chains copy( tree );
+
+    std::vector<Node*> nodes;
+    std::vector<int> parents;
+    preorder( tree.root( ), nodes, parents );
+    bool same = chains.size( ) == nodes.size( );
+    std::vector<std::size_t> depths( nodes.size( ), 0 );
+    std::size_t i = 0;
+    for ( auto n : chains ) {
+      depths[ i ] = parents[ i ] < 0 ? 0 : depths[ parents[ i ] ] + 1;
+      same = same && i < nodes.size( ) && n.data( ) == nodes[ i ]->data( ) && n.depth( ) == depths[ i ] &&
+        n.numberOfChildren( ) == nodes[ i ]->numberOfChildren( ) &&
+        ( parents[ i ] < 0 ? n.isRoot( ) : n.parent( ).data( ) == nodes[ parents[ i ] ]->data( ) );
+      ++i;
+    }
+    check( same && i == nodes.size( ), "chain pre order" + what );
+    if ( chainy && size > 1 ) {
+      check( chains.segments( ) < chains.size( ) / 2, "chains stored as segments" + what );
+    }
+
+    std::vector<int> expected;
+    for ( auto it = tree.post_order_begin( ); it != tree.post_order_end( ); ++it ) {
+      expected.push_back( it->data( ) );
+    }
+    std::vector<int> seen;
+    blib::container::tree::visitPostOrder( copy, [ &seen ]( Chains::NodeType aNode ) { seen.push_back( aNode.data( ) ); } );
+    check( seen == expected, "chain post order" + what );
+
+    expected.clear( );
+    for ( auto it = tree.level_order_begin( ); it != tree.level_order_end( ); ++it ) {
+      expected.push_back( it->data( ) );
+    }
+    seen.clear( );
+    blib::container::tree::visitLevelOrder( copy, [ &seen ]( Chains::NodeType aNode ) { seen.push_back( aNode.data( ) ); } );
+    check( seen == expected, "chain level order" + what );
+
+    const Tree expanded = chains.expand( );
+    check( sameTree( expanded.root( ), tree.root( ) ) && linked( expanded.root( ) ), "chain round trip" + what );
+  }
+}
+
+//=====================================================================
+// Parallel Bfs
+// On several threads with a small grain, so that most levels are split:
+// deterministic runs against the serial level order, the others level by
+// level against the same sets of nodes, every node visited once at its
+// depth, and an exception from the visitor coming out of run( ).
+void parallelBfsTest( ) {
+  typedef blib::container::tree::ParallelBfs<Node> Bfs;
+  Tree tree;
+  const int size = 20000;
+  build( tree, randomShape( size, 26 ), []( int i ) { return i; } );
+  std::vector<Node*> serial;
+  for ( auto it = tree.level_order_begin( ); it != tree.level_order_end( ); ++it ) {
+    serial.push_back( &*it );
+  }
+  std::vector<Node*> nodes;
+  std::vector<int> parents;
+  preorder( tree.root( ), nodes, parents );
+  std::vector<std::size_t> depths( size, 0 );
+  for ( std::size_t i = 1; i < nodes.size( ); ++i ) {
+    depths[ nodes[ i ]->data( ) ] = depths[ nodes[ parents[ i ] ]->data( ) ] + 1;
+  }
+  std::vector<std::size_t> bounds( 1, 0 );
+  for ( std::size_t i = 1; i < serial.size( ); ++i ) {
+    if ( depths[ serial[ i ]->data( ) ] != depths[ serial[ i - 1 ]->data( ) ] ) {
+      bounds.push_back( i );
+    }
+  }
+  bounds.push_back( serial.size( ) );
+
+  for ( std::size_t threads = 1; threads <= 4; threads *= 2 ) {
+    const std::string suffix = " on " + std::to_string( threads ) + " threads";
+    Bfs bfs( threads, 16 );
+    for ( int deterministic = 1; deterministic >= 0; --deterministic ) {
+      const std::string what = std::string( deterministic ? " deterministic" : "" ) + suffix;
+      // Every node is visited by one thread, which alone writes its slots;
+      // sleeping now and then interleaves the threads even on one core
+      std::vector<int> visits( size, 0 );
+      std::vector<std::size_t> seen( size, 0 );
+      const std::size_t count = bfs.run( tree, [ &visits, &seen ]( Node& aNode, std::size_t aDepth ) {
+        ++visits[ aNode.data( ) ];
+        seen[ aNode.data( ) ] = aDepth;
+        if ( aNode.data( ) % 64 == 0 ) {
+          std::this_thread::sleep_for( std::chrono::microseconds( 20 ) );
+        }
+      }, deterministic != 0 );
+      check( count == serial.size( ) && std::count( visits.begin( ), visits.end( ), 1 ) == size && seen == depths,
+             "parallel bfs visits every node once at its depth" + what );
+      check( bfs.levelBounds( ) == bounds && bfs.height( ) == bounds.size( ) - 2, "parallel bfs levels" + what );
+      if ( deterministic ) {
+        check( bfs.order( ) == serial, "parallel bfs in level order" + what );
+      }
+      else {
+        bool same = bfs.order( ).size( ) == serial.size( );
+        for ( std::size_t l = 0; same && l + 1 < bounds.size( ); ++l ) {
+          const std::set<Node*> got( bfs.order( ).begin( ) + bounds[ l ], bfs.order( ).begin( ) + bounds[ l + 1 ] );
+          const std::set<Node*> want( serial.begin( ) + bounds[ l ], serial.begin( ) + bounds[ l + 1 ] );
+          same = got == want;
+        }
+        check( same, "parallel bfs levels hold the same nodes" + what );
+      }
+    }
+
+    // Thrown deep in a level that is split between the threads
+    const int thrower = serial[ bounds[ bounds.size( ) / 2 ] + 40 ]->data( );
+    checkThrows<std::runtime_error>( [ &bfs, &tree, thrower ]( ) {
+      bfs.run( tree, [ thrower ]( Node& aNode, std::size_t ) {
+        if ( aNode.data( ) == thrower ) {
+          throw std::runtime_error( "visitor" );
+        }
+      } );
+    }, "parallel bfs visitor exception" + suffix );
+    check( bfs.run( tree, []( Node&, std::size_t ) {}, true ) == serial.size( ) && bfs.order( ) == serial,
+           "parallel bfs runs again after an exception" + suffix );
+  }
+  check( blib::container::tree::parallelLevelOrder( tree, []( Node&, std::size_t ) {}, 2 ) == serial.size( ),
+         "parallel level order counts the nodes" );
+}
+
+//=====================================================================
+// Static NTree
+// Against the same complete tree built as an NTree and numbered in level
+// order: the sizes and level offsets, the three orders, and each node's
+// depth, parent, fanout and subtree size. The layout constants are
+// checked at compile time as well.
+static_assert( blib::container::tree::StaticNTree<int, 4, 5>::Size == 341, "static size" );
+static_assert( blib::container::tree::StaticNTree<int, 1, 6>::Size == 6, "static size of a chain" );
+static_assert( blib::container::tree::StaticNTree<int, 3, 4>::levelOffset( 3 ) == 13, "static level offset" );
+static_assert( blib::container::tree::StaticNTree<int, 2, 3>::levelWidth( 2 ) == 4, "static level width" );
+static_assert( blib::container::tree::StaticNTree<int, 3, 4>::depth( 13 ) == 3, "static depth" );
+
+template<std::size_t Fanout, std::size_t Depth>
+void staticCheck( ) {
+  typedef blib::container::tree::StaticNTree<int, Fanout, Depth> Static;
+  const std::string what = " of fanout " + std::to_string( Fanout ) + " and depth " + std::to_string( Depth );
+  Tree tree;
+  tree.root( 0 );
+  std::vector<Node*> level( 1, &tree.root( ) );
+  std::vector<std::size_t> offsets( 1, 0 );
+  int next = 1;
+  for ( std::size_t d = 1; d < Depth; ++d ) {
+    offsets.push_back( static_cast< std::size_t >( next ) );
+    std::vector<Node*> below;
+    for ( Node* n : level ) {
+      for ( std::size_t k = 0; k < Fanout; ++k ) {
+        n->addChild( next++ );
+      }
+      for ( auto& c : *n ) {
+        below.push_back( &c );
+      }
+    }
+    level.swap( below );
+  }
+  offsets.push_back( static_cast< std::size_t >( next ) );
+
+  bool layout = Static::Size == offsets.back( ) && Static::size( ) == offsets.back( );
+  for ( std::size_t d = 0; d < Depth; ++d ) {
+    layout = layout && Static::levelOffset( d ) == offsets[ d ] && Static::levelWidth( d ) == offsets[ d + 1 ] - offsets[ d ];
+  }
+  check( layout && Static::levelOffset( Depth ) == Static::Size, "static layout" + what );
+
+  Static t;
+  for ( std::size_t i = 0; i < Static::Size; ++i ) {
+    t.data( i ) = static_cast< int >( i );
+  }
+  Static const& c = t;
+  std::vector<int> expected;
+  std::vector<int> seen;
+  for ( auto it = tree.pre_order_begin( ); it != tree.pre_order_end( ); ++it ) {
+    expected.push_back( it->data( ) );
+  }
+  for ( auto it = t.pre_order_begin( ); it != t.pre_order_end( ); ++it ) {
+    seen.push_back( it->data( ) );
+  }
+  check( seen == expected, "static pre order" + what );
+  seen.clear( );
+  for ( auto it = c.pre_order_begin( ); it != c.pre_order_end( ); ++it ) {
+    seen.push_back( static_cast< int >( it->index( ) ) );
+  }
+  check( seen == expected, "static const pre order" + what );
+
+  expected.clear( );
+  seen.clear( );
+  for ( auto it = tree.post_order_begin( ); it != tree.post_order_end( ); ++it ) {
+    expected.push_back( it->data( ) );
+  }
+  for ( auto it = t.post_order_begin( ); it != t.post_order_end( ); ++it ) {
+    seen.push_back( it->data( ) );
+  }
+  check( seen == expected, "static post order" + what );
+
+  expected.clear( );
+  seen.clear( );
+  for ( auto it = tree.level_order_begin( ); it != tree.level_order_end( ); ++it ) {
+    expected.push_back( it->data( ) );
+  }
+  for ( auto it = c.level_order_begin( ); it != c.level_order_end( ); ++it ) {
+    seen.push_back( it->data( ) );
+  }
+  check( seen == expected, "static level order" + what );
+
+  std::vector<Node*> nodes;
+  std::vector<int> parents;
+  preorder( tree.root( ), nodes, parents );
+  std::vector<std::size_t> depths( nodes.size( ), 0 );
+  std::vector<std::size_t> sizes( nodes.size( ), 1 );
+  for ( std::size_t i = nodes.size( ); i-- > 1; ) {
+    sizes[ parents[ i ] ] += sizes[ i ];
+  }
+  bool same = true;
+  for ( std::size_t i = 0; i < nodes.size( ); ++i ) {
+    depths[ i ] = parents[ i ] < 0 ? 0 : depths[ parents[ i ] ] + 1;
+    const auto n = t.node( static_cast< std::size_t >( nodes[ i ]->data( ) ) );
+    same = same && n.depth( ) == depths[ i ] && n.numberOfChildren( ) == nodes[ i ]->numberOfChildren( ) &&
+      n.isLeaf( ) == ( nodes[ i ]->numberOfChildren( ) == 0 ) && n.subtreeSize( ) == sizes[ i ] &&
+      n.parent( ).data( ) == ( parents[ i ] < 0 ? 0 : nodes[ parents[ i ] ]->data( ) );
+    for ( std::size_t k = 0; same && k < n.numberOfChildren( ); ++k ) {
+      same = n[ k ].data( ) == ( *nodes[ i ] )[ k ].data( );
+    }
+  }
+  check( same, "static nodes" + what );
+}
+
+void staticTest( ) {
+  staticCheck<2, 1>( );
+  staticCheck<1, 6>( );
+  staticCheck<2, 5>( );
+  staticCheck<3, 4>( );
+  staticCheck<4, 5>( );
+  staticCheck<8, 3>( );
+}
+
+//=====================================================================
+// Tree Generators
+// Every generator against the iterator of the same order, walkNodes( )
+// against a pruned preorder, the pool overloads against a resource that
+// counts what is outstanding, and a composition with the range adaptors.
+// Only where the generators are built.
+#if defined( __cpp_impl_coroutine )
+using blib::container::tree::Generator;
+using blib::container::tree::levelOrderNodes;
+using blib::container::tree::postOrderNodes;
+using blib::container::tree::preOrderNodes;
+using blib::container::tree::walkNodes;
+
+class CountingResource :
+  public std::pmr::memory_resource {
+public:
+  std::size_t allocations = 0;
+  std::size_t outstanding = 0;
+
+private:
+  void* do_allocate( std::size_t aBytes, std::size_t aAlign ) override {
+    ++allocations;
+    outstanding += aBytes;
+    return std::pmr::new_delete_resource( )->allocate( aBytes, aAlign );
+  }
+
+  void do_deallocate( void* aPtr, std::size_t aBytes, std::size_t aAlign ) override {
+    outstanding -= aBytes;
+    std::pmr::new_delete_resource( )->deallocate( aPtr, aBytes, aAlign );
+  }
+
+  bool do_is_equal( std::pmr::memory_resource const& aOther ) const noexcept override {
+    return this == &aOther;
+  }
+};
+
+template<typename Range>
+std::vector<int> values( Range&& aRange ) {
+  std::vector<int> ret;
+  for ( auto& n : aRange ) {
+    ret.push_back( n.data( ) );
+  }
+  return ret;
+}
+
+void generatorsTest( ) {
+  Tree tree;
+  build( tree, randomShape( 2000, 25 ), []( int i ) { return i; } );
+  std::vector<int> pre;
+  for ( auto it = tree.pre_order_begin( ); it != tree.pre_order_end( ); ++it ) {
+    pre.push_back( it->data( ) );
+  }
+  std::vector<int> post;
+  for ( auto it = tree.post_order_begin( ); it != tree.post_order_end( ); ++it ) {
+    post.push_back( it->data( ) );
+  }
+  std::vector<int> level;
+  for ( auto it = tree.level_order_begin( ); it != tree.level_order_end( ); ++it ) {
+    level.push_back( it->data( ) );
+  }
+  check( values( preOrderNodes( tree ) ) == pre, "generated pre order" );
+  check( values( postOrderNodes( tree ) ) == post, "generated post order" );
+  check( values( levelOrderNodes( tree ) ) == level, "generated level order" );
+
+  // Even values, not below the values that are 4 mod 5
+  auto select = []( Node const& aNode ) { return aNode.data( ) % 2 == 0; };
+  auto descend = []( Node const& aNode ) { return aNode.data( ) % 5 != 4; };
+  std::vector<int> pruned;
+  std::vector<Node const*> stack( 1, &tree.root( ) );
+  while ( !stack.empty( ) ) {
+    Node const* n = stack.back( );
+    stack.pop_back( );
+    if ( select( *n ) ) {
+      pruned.push_back( n->data( ) );
+    }
+    if ( descend( *n ) ) {
+      for ( std::size_t i = n->numberOfChildren( ); i-- > 0; ) {
+        stack.push_back( &( *n )[ i ] );
+      }
+    }
+  }
+  check( pruned.size( ) > 100 && pruned.size( ) < pre.size( ) / 2, "pruned walk reaches below the root" );
+  check( values( walkNodes( tree, select, descend ) ) == pruned, "generated pruned walk" );
+
+  CountingResource pool;
+  check( values( preOrderNodes( std::allocator_arg, &pool, tree.root( ) ) ) == pre &&
+         values( postOrderNodes( std::allocator_arg, &pool, tree.root( ) ) ) == post &&
+         values( levelOrderNodes( std::allocator_arg, &pool, tree.root( ) ) ) == level &&
+         values( walkNodes( std::allocator_arg, &pool, tree.root( ), select, descend ) ) == pruned,
+         "generated orders from a pool" );
+  check( pool.allocations > 0 && pool.outstanding == 0, "generators allocate from the pool and give it all back" );
+  {
+    // Dropped in the middle of the walk
+    Generator<Node> walk = levelOrderNodes( std::allocator_arg, &pool, tree.root( ) );
+    auto it = walk.begin( );
+    for ( int i = 0; i < 100; ++i ) {
+      ++it;
+    }
+    check( it->data( ) == level[ 100 ] && pool.outstanding > 0, "generator suspended in the middle" );
+  }
+  check( pool.outstanding == 0, "generator dropped in the middle gives the pool back" );
+
+  static_assert( std::ranges::view<Generator<Node>>, "generators are views" );
+  std::vector<int> firstEven;
+  for ( int v : pre ) {
+    if ( firstEven.size( ) < 5 && v % 2 == 0 ) {
+      firstEven.push_back( v );
+    }
+  }
+  check( values( preOrderNodes( tree ) | std::views::filter( select ) | std::views::take( 5 ) ) == firstEven,
+         "generator composed with range adaptors" );
+
+  // Subtrees, and writes through the yielded nodes
+  Node& sub = tree.root( )[ 0 ];
+  for ( Node& n : preOrderNodes( sub ) ) {
+    n.data( -n.data( ) );
+  }
+  std::vector<Node*> nodes;
+  std::vector<int> parents;
+  preorder( sub, nodes, parents );
+  bool negated = true;
+  for ( Node* n : nodes ) {
+    negated = negated && n->data( ) < 0;
+  }
+  check( negated && tree.root( ).data( ) == 0 && tree.root( )[ 1 ].data( ) > 0,
+         "writes through generated nodes" );
+}
+#endif
+
+//=====================================================================
+// Driver
+void run( char const* aName, void ( *aTest )( ) ) {
+  const int before = gFailures;
+  try {
+    aTest( );
+  }
+  catch ( std::exception& e ) {
+    check( false, std::string( "exception = " ) + e.what( ) );
+  }
+  std::cout << aName << ( gFailures == before ? " passed" : " FAILED" ) << std::endl;
+}
+
+int main( int/* argc*/, char ** /*argv[]*/ ) {
+  run( "frozen", frozenTest );
+  run( "scan", scanTest );
+  run( "succinct", succinctTest );
+  run( "diff", diffTest );
+  run( "merkle", merkleTest );
+  run( "view", viewTest );
+  run( "iterators", iteratorTest );
+  run( "limits", limitsTest );
+  run( "best first", bestFirstTest );
+  run( "clone", cloneTest );
+  run( "compact", compactTest );
+  run( "chain", chainTest );
+  run( "parallel bfs", parallelBfsTest );
+  run( "static", staticTest );
+#if defined( __cpp_impl_coroutine )
+  run( "generators", generatorsTest );
+#endif
+  run( "aggregate", aggregateTest );
+  run( "heavy light", heavyLightTest );
+  run( "rerooting", rerootingTest );
+  run( "canonical", canonicalTest );
+  run( "hash cons", hashConsTest );
+  run( "path query", pathQueryTest );
+  return gFailures ? 1 : 0;
+}